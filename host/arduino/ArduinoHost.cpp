@@ -0,0 +1,390 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+SPIClass SPI;
+
+namespace
+{
+    struct Pin
+    {
+        uint8_t mode;
+        uint8_t output;
+        uint8_t input;
+        SpiDevice *device;
+    };
+
+    Pin pins[HOST_NUM_PINS];
+    // Inputs idle high, like the pulled up button and the open drain INT line
+    const bool isPinsInitialized = []() {
+        for (uint8_t i = 0; i < HOST_NUM_PINS; i++)
+            pins[i].input = HIGH;
+        return true;
+    }();
+    SpiDevice *selectedDevice = nullptr;
+    void (*pinWriteListener)(uint8_t pin, uint8_t val) = nullptr;
+
+    void (*isrs[HOST_NUM_PINS])() = {};
+    int isrModes[HOST_NUM_PINS] = {};
+    bool isrPending[HOST_NUM_PINS] = {};
+    int interruptsDisabled = 0;
+
+    bool isVirtualClock = false;
+    uint64_t virtualMicros = 0;
+    void (*clockListener)() = nullptr;
+    const auto startTime = std::chrono::steady_clock::now();
+
+    bool isSerialEcho = false;
+    void (*serialOutput)(const uint8_t *buffer, size_t size) = nullptr;
+    uint8_t serialInput[4096];
+    size_t serialInputHead = 0;
+    size_t serialInputTail = 0;
+    // TX buffer of the AVR core, 64 bytes with one kept free
+    const uint8_t serialTxSize = 63;
+    bool isSerialTxModel = false;
+    unsigned long serialBaud = 0;
+    uint32_t serialTxQueued = 0;
+    uint64_t serialTxDrainedAt = 0;
+    uint64_t serialTxBits = 0; // Bits sent times 1 000 000, less than a byte after draining
+
+    // Bytes the UART sent since the last call, 10 bits each
+    void drainSerialTx()
+    {
+        if (!isSerialTxModel || !serialBaud)
+            return;
+        if (virtualMicros < serialTxDrainedAt || !serialTxQueued)
+        {
+            serialTxDrainedAt = virtualMicros;
+            serialTxBits = 0;
+            return;
+        }
+        serialTxBits += (virtualMicros - serialTxDrainedAt) * serialBaud;
+        serialTxDrainedAt = virtualMicros;
+
+        uint64_t sent = serialTxBits / 10000000;
+        if (sent >= serialTxQueued)
+        {
+            serialTxQueued = 0;
+            serialTxBits = 0;
+            return;
+        }
+        serialTxQueued -= sent;
+        serialTxBits -= sent * 10000000;
+    }
+
+    void runPendingInterrupts()
+    {
+        for (uint8_t i = 0; i < HOST_NUM_PINS && interruptsDisabled == 0; i++)
+        {
+            if (isrPending[i])
+            {
+                isrPending[i] = false;
+                // Handlers run with interrupts masked, like on the AVR
+                interruptsDisabled++;
+                isrs[i]();
+                interruptsDisabled--;
+            }
+        }
+    }
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin < HOST_NUM_PINS)
+        pins[pin].mode = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin >= HOST_NUM_PINS)
+        return;
+
+    pins[pin].output = val;
+    if (pinWriteListener)
+        pinWriteListener(pin, val);
+
+    SpiDevice *device = pins[pin].device;
+    if (!device)
+        return;
+
+    if (val == LOW && selectedDevice != device)
+    {
+        selectedDevice = device;
+        device->select();
+    }
+    else if (val == HIGH && selectedDevice == device)
+    {
+        selectedDevice = nullptr;
+        device->deselect();
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    if (pin >= HOST_NUM_PINS)
+        return LOW;
+    if (pins[pin].mode == OUTPUT)
+        return pins[pin].output;
+    return pins[pin].input;
+}
+
+unsigned long micros()
+{
+    if (isVirtualClock)
+        return (unsigned long)(uint32_t)virtualMicros;
+
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return (unsigned long)(uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+unsigned long millis()
+{
+    if (isVirtualClock)
+        return (unsigned long)(uint32_t)(virtualMicros / 1000);
+
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return (unsigned long)(uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+void delay(unsigned long ms)
+{
+    if (isVirtualClock)
+        host::advanceMicros(ms * 1000);
+    else
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    if (isVirtualClock)
+        host::advanceMicros(us);
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void noInterrupts()
+{
+    interruptsDisabled++;
+}
+
+void interrupts()
+{
+    if (interruptsDisabled > 0)
+        interruptsDisabled--;
+    runPendingInterrupts();
+}
+
+uint8_t digitalPinToInterrupt(uint8_t pin)
+{
+    return pin;
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int mode)
+{
+    if (interruptNum >= HOST_NUM_PINS)
+        return;
+    isrs[interruptNum] = isr;
+    isrModes[interruptNum] = mode;
+    isrPending[interruptNum] = false;
+}
+
+void detachInterrupt(uint8_t interruptNum)
+{
+    if (interruptNum < HOST_NUM_PINS)
+        isrs[interruptNum] = nullptr;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    serialBaud = baud;
+}
+
+int HardwareSerial::available()
+{
+    return (int)(serialInputHead - serialInputTail);
+}
+
+int HardwareSerial::read()
+{
+    if (serialInputTail == serialInputHead)
+        return -1;
+    uint8_t c = serialInput[serialInputTail++];
+    if (serialInputTail == serialInputHead)
+        serialInputTail = serialInputHead = 0;
+    return c;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (isSerialTxModel && serialBaud)
+    {
+        drainSerialTx();
+        // A full buffer blocks the caller until the UART makes room
+        if (serialTxQueued + size > serialTxSize)
+        {
+            uint64_t wait = (serialTxQueued + size - serialTxSize) * 10000000ULL;
+            host::advanceMicros((wait + serialBaud - 1) / serialBaud);
+            drainSerialTx();
+        }
+        serialTxQueued += size;
+    }
+    if (serialOutput)
+        serialOutput(buffer, size);
+    if (isSerialEcho)
+        fwrite(buffer, 1, size, stdout);
+    return size;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    if (!isSerialTxModel || !serialBaud)
+        return serialTxSize;
+    drainSerialTx();
+    return serialTxQueued < serialTxSize ? serialTxSize - serialTxQueued : 0;
+}
+
+void HardwareSerial::flush()
+{
+    if (isSerialEcho)
+        fflush(stdout);
+}
+
+size_t HardwareSerial::print(const char *str)
+{
+    return write((const uint8_t *)str, strlen(str));
+}
+
+size_t HardwareSerial::print(char c)
+{
+    return write((uint8_t)c);
+}
+
+size_t HardwareSerial::print(unsigned long n, int base)
+{
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%lu", n);
+    return print(buffer);
+}
+
+size_t HardwareSerial::print(long n, int base)
+{
+    if (base == HEX)
+        return print((unsigned long)n, base);
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "%ld", n);
+    return print(buffer);
+}
+
+size_t HardwareSerial::println()
+{
+    return print("\r\n");
+}
+
+void SPIClass::begin() {}
+void SPIClass::end() {}
+void SPIClass::beginTransaction(SPISettings settings) { noInterrupts(); }
+void SPIClass::endTransaction() { interrupts(); }
+void SPIClass::usingInterrupt(uint8_t interruptNumber) {}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    return selectedDevice ? selectedDevice->transfer(data) : 0xFF;
+}
+
+namespace host
+{
+    void attachSpiDevice(uint8_t csPin, SpiDevice *device)
+    {
+        if (csPin < HOST_NUM_PINS)
+            pins[csPin].device = device;
+    }
+
+    void setPinInput(uint8_t pin, uint8_t level)
+    {
+        if (pin >= HOST_NUM_PINS)
+            return;
+
+        uint8_t previous = pins[pin].input;
+        pins[pin].input = level;
+
+        if (!isrs[pin] || previous == level)
+            return;
+
+        int mode = isrModes[pin];
+        if (mode == CHANGE || (mode == FALLING && level == LOW) || (mode == RISING && level == HIGH))
+        {
+            isrPending[pin] = true;
+            runPendingInterrupts();
+        }
+    }
+
+    uint8_t getPinOutput(uint8_t pin)
+    {
+        return pin < HOST_NUM_PINS ? pins[pin].output : LOW;
+    }
+
+    void setPinWriteListener(void (*listener)(uint8_t pin, uint8_t val))
+    {
+        pinWriteListener = listener;
+    }
+
+    void useVirtualClock(bool isVirtual)
+    {
+        isVirtualClock = isVirtual;
+    }
+
+    void setMicros(uint32_t us)
+    {
+        virtualMicros = us;
+    }
+
+    void advanceMicros(uint32_t us)
+    {
+        virtualMicros += us;
+        if (clockListener)
+            clockListener();
+    }
+
+    void setClockListener(void (*listener)())
+    {
+        clockListener = listener;
+    }
+
+    void setSerialEcho(bool isEnabled)
+    {
+        isSerialEcho = isEnabled;
+    }
+
+    void setSerialOutput(void (*output)(const uint8_t *buffer, size_t size))
+    {
+        serialOutput = output;
+    }
+
+    void setSerialTxModel(bool isEnabled)
+    {
+        isSerialTxModel = isEnabled && isVirtualClock;
+        serialTxQueued = 0;
+        serialTxDrainedAt = virtualMicros;
+        serialTxBits = 0;
+    }
+
+    void feedSerial(const uint8_t *buffer, size_t size)
+    {
+        for (size_t i = 0; i < size && serialInputHead < sizeof(serialInput); i++)
+        {
+            serialInput[serialInputHead++] = buffer[i];
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#include <EEPROM.h>
+
+EEPROMClass EEPROM;
+
+namespace
+{
+    uint8_t cells[1024];
+    const bool isErased = []() {
+        memset(cells, 0xFF, sizeof(cells));
+        return true;
+    }();
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+    return address >= 0 && address < (int)sizeof(cells) ? cells[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+    if (address >= 0 && address < (int)sizeof(cells))
+    {
+        cells[address] = value;
+        writes++;
+    }
+}
+
+void EEPROMClass::update(int address, uint8_t value)
+{
+    if (read(address) != value)
+        write(address, value);
+}
+
+uint16_t EEPROMClass::length()
+{
+    return sizeof(cells);
+}
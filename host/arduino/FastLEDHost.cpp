@@ -0,0 +1,46 @@
+#include <FastLED.h>
+
+CFastLED FastLED;
+/*
+  Plain six sector HSV to RGB, close enough to the FastLED rainbow for
+  checking what the LEDs would show.
+*/
+CRGB::CRGB(const CHSV &hsv)
+{
+    uint16_t h = (uint16_t)hsv.h * 6;
+    uint8_t sector = h >> 8;
+    uint8_t fraction = h & 0xFF;
+    uint8_t p = (hsv.v * (255 - hsv.s)) / 255;
+    uint8_t q = (hsv.v * (255 - (hsv.s * fraction) / 255)) / 255;
+    uint8_t t = (hsv.v * (255 - (hsv.s * (255 - fraction)) / 255)) / 255;
+
+    switch (sector)
+    {
+    case 0: r = hsv.v; g = t; b = p; break;
+    case 1: r = q; g = hsv.v; b = p; break;
+    case 2: r = p; g = hsv.v; b = t; break;
+    case 3: r = p; g = q; b = hsv.v; break;
+    case 4: r = t; g = p; b = hsv.v; break;
+    default: r = hsv.v; g = p; b = q; break;
+    }
+}
+
+CRGB &CRGB::nscale8(uint8_t scale)
+{
+    r = (r * (scale + 1)) >> 8;
+    g = (g * (scale + 1)) >> 8;
+    b = (b * (scale + 1)) >> 8;
+    return *this;
+}
+
+void fill_solid(CRGB *leds, int count, const CRGB &color)
+{
+    for (int i = 0; i < count; i++)
+        leds[i] = color;
+}
+
+void fadeToBlackBy(CRGB *leds, int count, uint8_t fadeBy)
+{
+    for (int i = 0; i < count; i++)
+        leds[i].nscale8(255 - fadeBy);
+}
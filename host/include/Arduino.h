@@ -0,0 +1,110 @@
+#pragma once
+
+/*
+  Minimal Arduino API for host builds. GPIO and SPI are routed to devices
+  attached with host::attachSpiDevice() and host::setPinInput(), time comes
+  from the real clock or from a virtual one advanced by the caller.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+
+#define PROGMEM
+#define F(str) (str)
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+
+#define HOST_NUM_PINS 32
+
+static const uint8_t A0 = 14;
+static const uint8_t A1 = 15;
+static const uint8_t A2 = 16;
+static const uint8_t A3 = 17;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void noInterrupts();
+void interrupts();
+uint8_t digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    int availableForWrite();
+    void flush();
+
+    size_t print(const char *str);
+    size_t print(char c);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t println();
+    template <typename T>
+    size_t println(T value) { return print(value) + println(); }
+    template <typename T>
+    size_t println(T value, int base) { return print(value, base) + println(); }
+};
+
+extern HardwareSerial Serial;
+
+namespace host
+{
+    // Pin level driven by a device, falling edges run the attached interrupt
+    void setPinInput(uint8_t pin, uint8_t level);
+    uint8_t getPinOutput(uint8_t pin);
+    // Called on every digitalWrite, for tracing GPIO toggles
+    void setPinWriteListener(void (*listener)(uint8_t pin, uint8_t val));
+
+    // Virtual clock only moves with advanceMicros() and delay()
+    void useVirtualClock(bool isVirtual);
+    void setMicros(uint32_t us);
+    void advanceMicros(uint32_t us);
+    // Called after the virtual clock moves, for traffic that arrives over time
+    void setClockListener(void (*listener)());
+
+    // Serial output goes to stdout when enabled, input is fed by the test
+    void setSerialEcho(bool isEnabled);
+    void setSerialOutput(void (*output)(const uint8_t *buffer, size_t size));
+    void feedSerial(const uint8_t *buffer, size_t size);
+    // With the virtual clock, availableForWrite() follows a 64 byte TX
+    // buffer draining at the Serial.begin() baud, and full writes block
+    void setSerialTxModel(bool isEnabled);
+}
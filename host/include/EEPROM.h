@@ -0,0 +1,21 @@
+#pragma once
+
+/*
+  Minimal EEPROM API for host builds, 1 KB like the ATmega328 and erased to
+  0xFF at start. Writes are counted so wear can be checked.
+*/
+
+#include "Arduino.h"
+
+class EEPROMClass
+{
+public:
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value);
+    uint16_t length();
+
+    uint32_t writes;
+};
+
+extern EEPROMClass EEPROM;
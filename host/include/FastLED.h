@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+  Minimal FastLED API for host builds. Pixels are kept in memory so the
+  colors can be inspected, show() only counts frames.
+*/
+
+#include "Arduino.h"
+
+#define HUE_RED    0
+#define HUE_YELLOW 64
+#define HUE_GREEN  96
+#define HUE_BLUE   160
+
+enum
+{
+    NEOPIXEL
+};
+
+struct CHSV
+{
+    uint8_t h;
+    uint8_t s;
+    uint8_t v;
+
+    CHSV(uint8_t hue, uint8_t sat, uint8_t val) : h(hue), s(sat), v(val) {}
+};
+
+struct CRGB
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+
+    enum HTMLColorCode
+    {
+        Black = 0x000000,
+        White = 0xFFFFFF
+    };
+
+    CRGB() : r(0), g(0), b(0) {}
+    CRGB(uint8_t red, uint8_t green, uint8_t blue) : r(red), g(green), b(blue) {}
+    CRGB(HTMLColorCode code) : r(code >> 16), g(code >> 8), b(code) {}
+    CRGB(const CHSV &hsv);
+    CRGB &nscale8(uint8_t scale);
+};
+
+class CFastLED
+{
+public:
+    template <int TYPE, uint8_t PIN>
+    void addLeds(CRGB *leds, int count)
+    {
+        if (_controllerCount < 4)
+        {
+            _leds[_controllerCount] = leds;
+            _counts[_controllerCount++] = count;
+        }
+    }
+    void setBrightness(uint8_t scale) { brightness = scale; }
+    uint8_t getBrightness() { return brightness; }
+    void show() { frames++; }
+
+    uint8_t brightness = 255;
+    uint32_t frames = 0;
+
+private:
+    CRGB *_leds[4];
+    int _counts[4];
+    uint8_t _controllerCount = 0;
+};
+
+extern CFastLED FastLED;
+
+void fill_solid(CRGB *leds, int count, const CRGB &color);
+void fadeToBlackBy(CRGB *leds, int count, uint8_t fadeBy);
+
+class CEveryNMillis
+{
+public:
+    CEveryNMillis(uint32_t period) : _period(period), _last(millis()) {}
+    operator bool()
+    {
+        uint32_t now = millis();
+        if (now - _last < _period)
+            return false;
+        _last = now;
+        return true;
+    }
+
+private:
+    uint32_t _period;
+    uint32_t _last;
+};
+
+#define FASTLED_CONCAT_(a, b) a##b
+#define FASTLED_CONCAT(a, b) FASTLED_CONCAT_(a, b)
+#define EVERY_N_MILLISECONDS(n) \
+    static CEveryNMillis FASTLED_CONCAT(everyNMillis, __LINE__)(n); \
+    if (FASTLED_CONCAT(everyNMillis, __LINE__))
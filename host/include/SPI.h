@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Arduino.h"
+
+#define MSBFIRST  1
+#define LSBFIRST  0
+#define SPI_MODE0 0x00
+
+class SPISettings
+{
+public:
+    SPISettings() {}
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {}
+};
+
+/*
+  Device on the host SPI bus. select() and deselect() follow its chip select
+  pin, transfer() clocks one byte in both directions.
+*/
+class SpiDevice
+{
+public:
+    virtual ~SpiDevice() {}
+    virtual void select() = 0;
+    virtual void deselect() = 0;
+    virtual uint8_t transfer(uint8_t data) = 0;
+};
+
+class SPIClass
+{
+public:
+    void begin();
+    void end();
+    void beginTransaction(SPISettings settings);
+    void endTransaction();
+    uint8_t transfer(uint8_t data);
+    void usingInterrupt(uint8_t interruptNumber);
+};
+
+extern SPIClass SPI;
+
+namespace host
+{
+    // Device is selected while csPin is driven LOW
+    void attachSpiDevice(uint8_t csPin, SpiDevice *device);
+}
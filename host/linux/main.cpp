@@ -0,0 +1,29 @@
+/*
+  Runs the sketch on a Linux board on top of SocketCAN.
+
+  usage: program [interface]    default is CAN_INTERFACE
+*/
+#include <Arduino.h>
+#include "can_controller.h"
+
+extern CanController CAN;
+
+void setup();
+void loop();
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        CAN.setInterface(argv[1]);
+    }
+    host::setSerialEcho(true);
+
+    setup();
+    while (true)
+    {
+        loop();
+        // Sleep in poll() instead of spinning, LEDs and SID still update every ms
+        CAN.waitForFrames(1);
+    }
+}
@@ -0,0 +1,611 @@
+#include "MCP2515Model.h"
+
+#define TXB_CTRL(n) (MCP_TXB0CTRL + 0x10 * (n))
+#define RXB_CTRL(n) (MCP_RXB0CTRL + 0x10 * (n))
+
+#define CANINTF_WAKIF 0x40
+#define CANINTF_ERRIF 0x20
+#define CANINTF_MERRF 0x80
+
+MCP2515Model::MCP2515Model(uint8_t csPin, uint8_t intPin)
+{
+    _csPin = csPin;
+    _intPin = intPin;
+    _isSelected = false;
+    _isAutoTransmit = true;
+    _isInterruptAsserted = false;
+    _phase = Phase::Instruction;
+    _instruction = 0;
+    _address = 0;
+    _mask = 0;
+    _clearOnDeselect = 0;
+    _oscHz = 0;
+    _busBitrate = 0;
+
+    host::attachSpiDevice(csPin, this);
+    if (_intPin != 0xFF)
+    {
+        host::setPinInput(_intPin, HIGH);
+    }
+    reset();
+    resetCounters();
+}
+/*
+  Power on / RESET instruction state: configuration mode, everything cleared.
+*/
+void MCP2515Model::reset()
+{
+    memset(_registers, 0, sizeof(_registers));
+    memset(_filterHit, 0, sizeof(_filterHit));
+    _registers[MCP_CANCTRL] = 0x87;
+    _registers[MCP_CANSTAT] = MODE_CONFIG;
+    updateInterrupt();
+}
+
+void MCP2515Model::resetCounters()
+{
+    memset(&counters, 0, sizeof(counters));
+    receivedFrames = 0;
+    rejectedFrames = 0;
+    overflowedFrames = 0;
+    errorFrames = 0;
+}
+
+void MCP2515Model::select()
+{
+    counters.transactions++;
+    _isSelected = true;
+    _phase = Phase::Instruction;
+    _clearOnDeselect = 0;
+}
+
+void MCP2515Model::deselect()
+{
+    _isSelected = false;
+    if (_clearOnDeselect)
+    {
+        _registers[MCP_CANINTF] &= ~_clearOnDeselect;
+        _clearOnDeselect = 0;
+        updateInterrupt();
+    }
+}
+
+uint8_t MCP2515Model::transfer(uint8_t data)
+{
+    counters.bytes++;
+    if (!_isSelected)
+    {
+        return 0xFF;
+    }
+
+    switch (_phase)
+    {
+    case Phase::Instruction:
+        _instruction = data;
+        _phase = Phase::Data;
+
+        if (data == MCP_READ || data == MCP_WRITE || data == MCP_BITMOD)
+        {
+            _phase = Phase::Address;
+            if (data == MCP_READ)
+                counters.reads++;
+            else if (data == MCP_WRITE)
+                counters.writes++;
+            else
+                counters.bitModifies++;
+        }
+        else if (data == MCP_RESET)
+        {
+            counters.resets++;
+            reset();
+        }
+        else if (data == MCP_READ_STATUS || data == MCP_RX_STATUS)
+        {
+            counters.statusReads++;
+        }
+        else if ((data & 0xF9) == 0x90) // READ RX BUFFER 1001 0nm0
+        {
+            uint8_t n = (data >> 2) & 1;
+            _address = MCP_RXB0SIDH + 0x10 * n + ((data & 0x02) ? 5 : 0);
+            _clearOnDeselect = n ? MCP_RX1IF : MCP_RX0IF;
+            counters.reads++;
+        }
+        else if ((data & 0xF8) == 0x40 && (data & 0x07) <= 5) // LOAD TX BUFFER 0100 0abc
+        {
+            uint8_t abc = data & 0x07;
+            _address = MCP_TXB0CTRL + 1 + 0x10 * (abc >> 1) + ((abc & 1) ? 5 : 0);
+            counters.writes++;
+        }
+        else if ((data & 0xF8) == 0x80) // RTS 1000 0nnn
+        {
+            counters.requestsToSend++;
+            requestToSend(data & 0x07);
+        }
+        return 0xFF;
+
+    case Phase::Address:
+        _address = data & 0x7F;
+        _phase = _instruction == MCP_BITMOD ? Phase::Mask : Phase::Data;
+        return 0xFF;
+
+    case Phase::Mask:
+        _mask = data;
+        _phase = Phase::Data;
+        return 0xFF;
+
+    case Phase::Data:
+        break;
+    }
+
+    uint8_t value = 0xFF;
+
+    if (_instruction == MCP_READ || (_instruction & 0xF9) == 0x90)
+    {
+        value = readRegister(_address);
+        _address = (_address + 1) & 0x7F;
+    }
+    else if (_instruction == MCP_WRITE || (_instruction & 0xF8) == 0x40)
+    {
+        writeRegister(_address, data);
+        _address = (_address + 1) & 0x7F;
+    }
+    else if (_instruction == MCP_BITMOD)
+    {
+        uint8_t address = _address;
+        uint8_t low = address & 0x0F;
+        bool isBitModifiable = address == MCP_BFPCTRL || address == MCP_TXRTSCTRL || low == 0x0F ||
+                               (address >= MCP_CNF3 && address <= MCP_EFLG) ||
+                               ((address & 0x8F) == 0x00 && address >= MCP_TXB0CTRL);
+        // Other registers ignore the mask and take the whole data byte
+        writeRegister(address, data, isBitModifiable ? _mask : 0xFF);
+        _instruction = 0;
+    }
+    else if (_instruction == MCP_READ_STATUS)
+    {
+        value = readStatus();
+    }
+    else if (_instruction == MCP_RX_STATUS)
+    {
+        value = readRxStatus();
+    }
+
+    return value;
+}
+
+uint8_t MCP2515Model::getRegister(uint8_t address) const
+{
+    return readRegister(address);
+}
+
+uint8_t MCP2515Model::getMode() const
+{
+    return _registers[MCP_CANSTAT] & MODE_MASK;
+}
+
+bool MCP2515Model::isInterruptAsserted() const
+{
+    return _isInterruptAsserted;
+}
+
+uint8_t MCP2515Model::readRegister(uint8_t address) const
+{
+    address &= 0x7F;
+    // CANSTAT and CANCTRL are mapped at the end of every row
+    if ((address & 0x0F) == 0x0E)
+        return _registers[MCP_CANSTAT];
+    if ((address & 0x0F) == 0x0F)
+        return _registers[MCP_CANCTRL];
+    return _registers[address];
+}
+
+void MCP2515Model::writeRegister(uint8_t address, uint8_t value, uint8_t mask)
+{
+    address &= 0x7F;
+    uint8_t low = address & 0x0F;
+
+    if (low == 0x0E)
+        return;
+    if (low == 0x0F)
+        address = MCP_CANCTRL;
+
+    uint8_t writable = 0xFF;
+
+    if (address == MCP_TEC || address == MCP_REC)
+        writable = 0x00;
+    else if (address == MCP_EFLG)
+        writable = MCP_EFLG_RX1OVR | MCP_EFLG_RX0OVR;
+    else if (address >= MCP_TXB0CTRL && address < MCP_RXB0CTRL && low == 0x00)
+        writable = MCP_TXB_TXREQ_M | MCP_TXB_TXP10_M;
+    else if (address == MCP_RXB0CTRL)
+        writable = MCP_RXB_RX_MASK | MCP_RXB_BUKT_MASK;
+    else if (address == MCP_RXB1CTRL)
+        writable = MCP_RXB_RX_MASK;
+    else if (address > MCP_RXB0CTRL && low != 0x00)
+        writable = 0x00; // Receive buffers
+    else if (address <= MCP_CNF1 && address != MCP_BFPCTRL && address != MCP_TXRTSCTRL && address != MCP_CANCTRL &&
+             getMode() != MODE_CONFIG)
+        writable = 0x00; // Filters, masks and bit timing only change in configuration mode
+
+    mask &= writable;
+    uint8_t previous = _registers[address];
+    _registers[address] = (previous & ~mask) | (value & mask);
+
+    if (address == MCP_CANCTRL)
+    {
+        uint8_t current = _registers[MCP_CANCTRL];
+        if ((current ^ previous) & MODE_MASK)
+        {
+            setMode(current & MODE_MASK);
+        }
+        if (current & ABORT_TX)
+        {
+            requestToSend(0);
+        }
+    }
+    else if (address >= MCP_TXB0CTRL && address < MCP_RXB0CTRL && low == 0x00)
+    {
+        uint8_t n = (address - MCP_TXB0CTRL) >> 4;
+        if ((_registers[address] & MCP_TXB_TXREQ_M) && !(previous & MCP_TXB_TXREQ_M))
+        {
+            requestToSend(1 << n);
+        }
+    }
+
+    updateInterrupt();
+}
+
+void MCP2515Model::setMode(uint8_t mode)
+{
+    if (mode > MODE_CONFIG)
+        mode = MODE_CONFIG;
+    _registers[MCP_CANSTAT] = (_registers[MCP_CANSTAT] & ~MODE_MASK) | mode;
+    requestToSend(0);
+}
+/*
+  Set TXREQ on the given buffers, then abort or send whatever is pending.
+*/
+void MCP2515Model::requestToSend(uint8_t buffers)
+{
+    for (uint8_t n = 0; n < 3; n++)
+    {
+        if (buffers & (1 << n))
+        {
+            _registers[TXB_CTRL(n)] &= ~(MCP_TXB_ABTF_M | MCP_TXB_MLOA_M | MCP_TXB_TXERR_M);
+            _registers[TXB_CTRL(n)] |= MCP_TXB_TXREQ_M;
+        }
+    }
+
+    if (_registers[MCP_CANCTRL] & ABORT_TX)
+    {
+        for (uint8_t n = 0; n < 3; n++)
+        {
+            if (_registers[TXB_CTRL(n)] & MCP_TXB_TXREQ_M)
+            {
+                _registers[TXB_CTRL(n)] &= ~MCP_TXB_TXREQ_M;
+                _registers[TXB_CTRL(n)] |= MCP_TXB_ABTF_M;
+            }
+        }
+        return;
+    }
+
+    if (_isAutoTransmit)
+    {
+        while (transmitNext())
+            ;
+    }
+}
+/*
+  Put the highest priority pending buffer on the bus. Ties go to the
+  highest buffer number, like the controller does.
+*/
+bool MCP2515Model::transmitNext()
+{
+    uint8_t mode = getMode();
+    if (mode != MCP_NORMAL && mode != MCP_LOOPBACK)
+        return false;
+    if (_registers[MCP_EFLG] & MCP_EFLG_TXBO)
+        return false;
+
+    int8_t selected = -1;
+    for (int8_t n = 2; n >= 0; n--)
+    {
+        uint8_t ctrl = _registers[TXB_CTRL(n)];
+        if (!(ctrl & MCP_TXB_TXREQ_M))
+            continue;
+        if (selected < 0 || (ctrl & MCP_TXB_TXP10_M) > (_registers[TXB_CTRL(selected)] & MCP_TXB_TXP10_M))
+            selected = n;
+    }
+    if (selected < 0)
+        return false;
+
+    const uint8_t *buffer = &_registers[TXB_CTRL(selected) + 1];
+    Frame frame;
+    frame.isExtended = (buffer[1] & MCP_TXB_EXIDE_M) != 0;
+    frame.id = ((uint32_t)buffer[0] << 3) | (buffer[1] >> 5);
+    if (frame.isExtended)
+    {
+        frame.id = (frame.id << 18) | ((uint32_t)(buffer[1] & 0x03) << 16) | ((uint32_t)buffer[2] << 8) | buffer[3];
+    }
+    frame.isRemote = (buffer[4] & MCP_TXB_RTR_M) != 0;
+    frame.len = buffer[4] & MCP_DLC_MASK;
+    if (frame.len > 8)
+        frame.len = 8;
+    memcpy(frame.data, &buffer[5], 8);
+
+    _registers[TXB_CTRL(selected)] &= ~MCP_TXB_TXREQ_M;
+    _registers[MCP_CANINTF] |= MCP_TX0IF << selected;
+
+    if (mode == MCP_LOOPBACK)
+    {
+        receive(frame);
+    }
+    else
+    {
+        transmitted.push_back(frame);
+    }
+
+    updateInterrupt();
+    return true;
+}
+
+void MCP2515Model::setAutoTransmit(bool isEnabled)
+{
+    _isAutoTransmit = isEnabled;
+}
+/*
+  Counters over 255 mean bus-off, as the 8-bit TEC register can not show it.
+*/
+void MCP2515Model::setErrorCounters(uint16_t tec, uint8_t rec)
+{
+    uint8_t flags = 0;
+    if (tec >= 96)
+        flags |= MCP_EFLG_TXWAR | MCP_EFLG_EWARN;
+    if (rec >= 96)
+        flags |= MCP_EFLG_RXWAR | MCP_EFLG_EWARN;
+    if (tec >= 128)
+        flags |= MCP_EFLG_TXEP;
+    if (rec >= 128)
+        flags |= MCP_EFLG_RXEP;
+    if (tec > 255)
+        flags |= MCP_EFLG_TXBO;
+
+    uint8_t previous = _registers[MCP_EFLG];
+    _registers[MCP_EFLG] = (previous & (MCP_EFLG_RX1OVR | MCP_EFLG_RX0OVR)) | flags;
+    _registers[MCP_TEC] = tec > 255 ? 255 : tec;
+    _registers[MCP_REC] = rec;
+
+    if ((previous ^ flags) & (MCP_EFLG_TXBO | MCP_EFLG_TXEP | MCP_EFLG_RXEP))
+    {
+        _registers[MCP_CANINTF] |= CANINTF_ERRIF;
+    }
+    updateInterrupt();
+}
+void MCP2515Model::setBusBitrate(uint32_t oscHz, uint32_t bitrate)
+{
+    _oscHz = oscHz;
+    _busBitrate = bitrate;
+}
+/*
+  Bitrate set by CNF1-CNF3 for the crystal given to setBusBitrate().
+*/
+uint32_t MCP2515Model::getBitrate() const
+{
+    uint8_t brp = (_registers[MCP_CNF1] & 0x3F) + 1;
+    uint8_t prseg = (_registers[MCP_CNF2] & 0x07) + 1;
+    uint8_t phseg1 = (_registers[MCP_CNF2] >> 3 & 0x07) + 1;
+    uint8_t phseg2 = (_registers[MCP_CNF3] & 0x07) + 1;
+    return _oscHz / (2UL * brp * (1 + prseg + phseg1 + phseg2));
+}
+/*
+  Frame seen on the bus. Returns true if it was stored in a receive buffer.
+*/
+bool MCP2515Model::receive(const Frame &frame)
+{
+    uint8_t mode = getMode();
+
+    if (mode == MCP_SLEEP)
+    {
+        // Bus activity wakes the controller into listen-only, the frame is lost
+        _registers[MCP_CANINTF] |= CANINTF_WAKIF;
+        setMode(MCP_LISTENONLY);
+        _registers[MCP_CANCTRL] = (_registers[MCP_CANCTRL] & ~MODE_MASK) | MCP_LISTENONLY;
+        updateInterrupt();
+        return false;
+    }
+    if (mode == MODE_CONFIG)
+    {
+        return false;
+    }
+    if (_busBitrate)
+    {
+        uint32_t bitrate = getBitrate();
+        uint32_t error = bitrate > _busBitrate ? bitrate - _busBitrate : _busBitrate - bitrate;
+        if (error * 100 > _busBitrate)
+        {
+            // Stuff, form or CRC error, the frame is never seen
+            _registers[MCP_CANINTF] |= CANINTF_MERRF;
+            errorFrames++;
+            updateInterrupt();
+            return false;
+        }
+    }
+
+    int8_t hit = matchFilter(frame, 0, 2, MCP_RXM0SIDH);
+    uint8_t buffer = 0;
+
+    if (hit >= 0)
+    {
+        if (_registers[MCP_CANINTF] & MCP_RX0IF)
+        {
+            if (!(_registers[MCP_RXB0CTRL] & MCP_RXB_BUKT_MASK) || (_registers[MCP_CANINTF] & MCP_RX1IF))
+            {
+                _registers[MCP_EFLG] |= (_registers[MCP_RXB0CTRL] & MCP_RXB_BUKT_MASK) ? MCP_EFLG_RX1OVR : MCP_EFLG_RX0OVR;
+                overflowedFrames++;
+                updateInterrupt();
+                return false;
+            }
+            buffer = 1;
+            hit += 6; // RX STATUS reports a rollover from RXF0 as 6, RXF1 as 7
+        }
+    }
+    else
+    {
+        hit = matchFilter(frame, 2, 4, MCP_RXM1SIDH);
+        if (hit < 0)
+        {
+            rejectedFrames++;
+            return false;
+        }
+        if (_registers[MCP_CANINTF] & MCP_RX1IF)
+        {
+            _registers[MCP_EFLG] |= MCP_EFLG_RX1OVR;
+            overflowedFrames++;
+            updateInterrupt();
+            return false;
+        }
+        buffer = 1;
+    }
+
+    storeFrame(buffer, frame, hit);
+    receivedFrames++;
+    return true;
+}
+/*
+  Returns the matching filter number, or -1. Receive mode 11 turns filters off.
+*/
+int8_t MCP2515Model::matchFilter(const Frame &frame, uint8_t firstFilter, uint8_t filterCount, uint8_t maskAddress) const
+{
+    uint8_t rxm = _registers[RXB_CTRL(firstFilter ? 1 : 0)] & MCP_RXB_RX_MASK;
+
+    if (rxm == MCP_RXB_RX_ANY)
+        return firstFilter;
+    if ((rxm == MCP_RXB_RX_STD && frame.isExtended) || (rxm == MCP_RXB_RX_EXT && !frame.isExtended))
+        return -1;
+
+    for (uint8_t n = firstFilter; n < firstFilter + filterCount; n++)
+    {
+        uint8_t filterAddress = n < 3 ? MCP_RXF0SIDH + 4 * n : MCP_RXF3SIDH + 4 * (n - 3);
+        if (matchIdRegisters(frame, filterAddress, maskAddress))
+            return n;
+    }
+    return -1;
+}
+
+bool MCP2515Model::matchIdRegisters(const Frame &frame, uint8_t filterAddress, uint8_t maskAddress) const
+{
+    const uint8_t *filter = &_registers[filterAddress];
+    const uint8_t *mask = &_registers[maskAddress];
+
+    if (((filter[1] & MCP_TXB_EXIDE_M) != 0) != frame.isExtended)
+        return false;
+
+    uint32_t filterSid = ((uint32_t)filter[0] << 3) | (filter[1] >> 5);
+    uint32_t maskSid = ((uint32_t)mask[0] << 3) | (mask[1] >> 5);
+
+    if (!frame.isExtended)
+    {
+        // Standard frames compare the extended ID bytes against the first two data bytes
+        uint8_t data0 = frame.len > 0 && !frame.isRemote ? frame.data[0] : 0;
+        uint8_t data1 = frame.len > 1 && !frame.isRemote ? frame.data[1] : 0;
+        return ((frame.id ^ filterSid) & maskSid) == 0 &&
+               ((data0 ^ filter[2]) & mask[2]) == 0 &&
+               ((data1 ^ filter[3]) & mask[3]) == 0;
+    }
+
+    uint32_t filterId = (filterSid << 18) | ((uint32_t)(filter[1] & 0x03) << 16) | ((uint32_t)filter[2] << 8) | filter[3];
+    uint32_t maskId = (maskSid << 18) | ((uint32_t)(mask[1] & 0x03) << 16) | ((uint32_t)mask[2] << 8) | mask[3];
+    return ((frame.id ^ filterId) & maskId) == 0;
+}
+
+void MCP2515Model::storeFrame(uint8_t buffer, const Frame &frame, uint8_t filterHit)
+{
+    uint8_t *ctrl = &_registers[RXB_CTRL(buffer)];
+    uint8_t *data = ctrl + 1;
+    uint8_t len = frame.len > 8 ? 8 : frame.len;
+
+    if (frame.isExtended)
+    {
+        data[0] = frame.id >> 21;
+        data[1] = (((frame.id >> 18) & 0x07) << 5) | MCP_RXB_IDE_M | ((frame.id >> 16) & 0x03);
+        data[2] = frame.id >> 8;
+        data[3] = frame.id;
+        data[4] = len | (frame.isRemote ? MCP_RXB_RTR_M : 0);
+    }
+    else
+    {
+        data[0] = frame.id >> 3;
+        data[1] = ((frame.id & 0x07) << 5) | (frame.isRemote ? MCP_RXB_SRR_M : 0);
+        data[2] = 0;
+        data[3] = 0;
+        data[4] = len;
+    }
+    if (!frame.isRemote)
+    {
+        memcpy(&data[5], frame.data, len);
+    }
+
+    if (buffer == 0)
+        *ctrl = (*ctrl & (MCP_RXB_RX_MASK | MCP_RXB_BUKT_MASK)) | (frame.isRemote ? 0x08 : 0) | (filterHit & 0x01);
+    else
+        *ctrl = (*ctrl & MCP_RXB_RX_MASK) | (frame.isRemote ? 0x08 : 0) | (filterHit < 6 ? filterHit : filterHit - 6);
+
+    _filterHit[buffer] = filterHit;
+    _registers[MCP_CANINTF] |= buffer ? MCP_RX1IF : MCP_RX0IF;
+    updateInterrupt();
+}
+
+uint8_t MCP2515Model::readStatus() const
+{
+    uint8_t intf = _registers[MCP_CANINTF];
+    uint8_t status = intf & (MCP_RX0IF | MCP_RX1IF);
+
+    for (uint8_t n = 0; n < 3; n++)
+    {
+        if (_registers[TXB_CTRL(n)] & MCP_TXB_TXREQ_M)
+            status |= MCP_STAT_TX0REQ << (2 * n);
+        if (intf & (MCP_TX0IF << n))
+            status |= MCP_STAT_TX0IF << (2 * n);
+    }
+    return status;
+}
+
+uint8_t MCP2515Model::readRxStatus() const
+{
+    uint8_t intf = _registers[MCP_CANINTF];
+    uint8_t status = 0;
+    int8_t buffer = -1;
+
+    if (intf & MCP_RX0IF)
+    {
+        status |= MCP_RXSTAT_RXB0;
+        buffer = 0;
+    }
+    if (intf & MCP_RX1IF)
+    {
+        status |= MCP_RXSTAT_RXB1;
+        if (buffer < 0)
+            buffer = 1;
+    }
+    if (buffer < 0)
+        return status;
+
+    const uint8_t *data = &_registers[RXB_CTRL(buffer) + 1];
+    bool isExtended = (data[1] & MCP_RXB_IDE_M) != 0;
+    bool isRemote = isExtended ? (data[4] & MCP_RXB_RTR_M) != 0 : (data[1] & MCP_RXB_SRR_M) != 0;
+
+    status |= (isExtended ? 0x10 : 0) | (isRemote ? 0x08 : 0) | (_filterHit[buffer] & 0x07);
+    return status;
+}
+
+void MCP2515Model::updateInterrupt()
+{
+    bool isAsserted = (_registers[MCP_CANINTE] & _registers[MCP_CANINTF]) != 0;
+    if (isAsserted == _isInterruptAsserted)
+        return;
+
+    _isInterruptAsserted = isAsserted;
+    if (_intPin != 0xFF)
+    {
+        host::setPinInput(_intPin, isAsserted ? LOW : HIGH);
+    }
+}
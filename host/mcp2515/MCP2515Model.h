@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <vector>
+#include "mcp_can_dfs.h"
+
+/*
+  Register level model of an MCP2515 on the host SPI bus.
+
+  Decodes the SPI instruction set against a 128 byte register file with the
+  side effects the driver depends on: READ RX BUFFER clears RXnIF on /CS
+  rise, RTS and TXREQ transmit by TXP priority, acceptance filters pick the
+  receive buffer and INT follows CANINTE & CANINTF. Every transaction and
+  byte is counted so driver changes can be compared by SPI traffic.
+*/
+class MCP2515Model : public SpiDevice
+{
+public:
+    struct Frame
+    {
+        uint32_t id;
+        bool isExtended;
+        bool isRemote;
+        uint8_t len;
+        uint8_t data[8];
+    };
+
+    struct Counters
+    {
+        uint32_t transactions;
+        uint32_t bytes;
+        uint32_t reads;       // READ and READ RX BUFFER
+        uint32_t writes;      // WRITE and LOAD TX BUFFER
+        uint32_t bitModifies;
+        uint32_t statusReads; // READ STATUS and RX STATUS
+        uint32_t requestsToSend;
+        uint32_t resets;
+    };
+
+    MCP2515Model(uint8_t csPin, uint8_t intPin = 0xFF);
+
+    void select() override;
+    void deselect() override;
+    uint8_t transfer(uint8_t data) override;
+
+    // Bus side
+    bool receive(const Frame &frame);
+    bool transmitNext();
+    void setAutoTransmit(bool isEnabled);
+    void setErrorCounters(uint16_t tec, uint8_t rec);
+    // Frames only arrive while CNF1-CNF3 give this bitrate within 1 %,
+    // otherwise they are lost with MERRF set. 0 accepts any timing
+    void setBusBitrate(uint32_t oscHz, uint32_t bitrate);
+    uint32_t getBitrate() const;
+
+    uint8_t getRegister(uint8_t address) const;
+    uint8_t getMode() const;
+    bool isInterruptAsserted() const;
+    void reset();
+    void resetCounters();
+
+    Counters counters;
+    std::vector<Frame> transmitted;
+    uint32_t receivedFrames;
+    uint32_t rejectedFrames; // Not accepted by the filters
+    uint32_t overflowedFrames;
+    uint32_t errorFrames; // Seen at the wrong bitrate
+
+private:
+    enum class Phase
+    {
+        Instruction,
+        Address,
+        Mask,
+        Data
+    };
+
+    void writeRegister(uint8_t address, uint8_t value, uint8_t mask = 0xFF);
+    uint8_t readRegister(uint8_t address) const;
+    void setMode(uint8_t mode);
+    void requestToSend(uint8_t buffers);
+    int8_t matchFilter(const Frame &frame, uint8_t firstFilter, uint8_t filterCount, uint8_t maskAddress) const;
+    bool matchIdRegisters(const Frame &frame, uint8_t filterAddress, uint8_t maskAddress) const;
+    void storeFrame(uint8_t buffer, const Frame &frame, uint8_t filterHit);
+    uint8_t readStatus() const;
+    uint8_t readRxStatus() const;
+    void updateInterrupt();
+
+    uint8_t _registers[128];
+    uint8_t _filterHit[2]; // RX STATUS filter match code per buffer
+    uint8_t _csPin;
+    uint8_t _intPin;
+    bool _isSelected;
+    bool _isAutoTransmit;
+    bool _isInterruptAsserted;
+
+    Phase _phase;
+    uint8_t _instruction;
+    uint8_t _address;
+    uint8_t _mask;
+    uint8_t _clearOnDeselect; // CANINTF bits cleared when READ RX BUFFER ends
+    uint32_t _oscHz;
+    uint32_t _busBitrate;
+};
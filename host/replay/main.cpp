@@ -0,0 +1,368 @@
+/*
+  Replays a candump capture through the sketch on the virtual clock.
+
+  usage: program [-c baseline] [-i interface] [-p interface] trace.log
+
+  Frames of the I-BUS interface (-i, default can0) arrive at the register
+  model at their capture time relative to the first one, so setup(), the
+  receive interrupt, readCanBus() and every handler run exactly as on the
+  car, only without waiting for the bus. With CAN_PBUS the -p interface
+  (default can1) goes to the P-BUS controller. Other interfaces are skipped.
+
+  What the sketch does is written to stdout in candump log format, at the
+  virtual time it happened:
+
+    (0012.345678) tx 33F#0096020000000000   frame sent on the I-BUS
+    (0012.345678) gpio 5 0                  write to a Bluetooth or track pin
+
+  Throughput and lost frames go to stderr. With -c the events are compared
+  to the output of an earlier run, for example of another firmware revision,
+  and the differences are listed. Exits 1 if there are any.
+*/
+#include <Arduino.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "can_controller.h"
+#include "CanReceiver.h"
+#include "../mcp2515/MCP2515Model.h"
+#include "../../include/defines.h"
+
+#define LOOP_US        500     // Virtual time one loop() takes
+#define TAIL_US        3000000 // Run on after the last frame, for messages still showing
+#define DIFF_LOOKAHEAD 32      // Events searched to get back in step after a difference
+#define DIFF_MAX_SHOWN 20
+
+extern CanReceiver canReceiver;
+
+void setup();
+void loop();
+
+struct Trace
+{
+    FILE *file;
+    const char *ibus;
+    const char *pbus;
+    bool hasPending;
+    bool isPBus; // Pending frame is for the P-BUS controller
+    uint64_t pendingAt;
+    MCP2515Model::Frame pending;
+    bool hasStart;
+    uint64_t startAt; // Capture time of the first frame, in us
+    uint64_t frames;
+    uint64_t skipped; // Other interfaces and lines that did not parse
+    uint64_t now;     // Virtual time since the first frame, micros() wraps after 71 minutes
+    uint32_t nowMicros;
+};
+
+static MCP2515Model ibusModel(CAN_CS_PIN, CAN_INT_PIN);
+#if CAN_PBUS
+static MCP2515Model pbusModel(PBUS_CS_PIN, PBUS_INT_PIN);
+#endif
+static Trace trace;
+static std::vector<std::string> events;
+static size_t ibusTransmitted;
+
+static bool parseHex(const char **str, uint8_t maxDigits, uint32_t *value)
+{
+    const char *start = *str;
+    *value = 0;
+    while (*str - start < maxDigits && isxdigit((unsigned char)**str))
+    {
+        char c = *(*str)++;
+        *value = *value << 4 | (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+    return *str > start;
+}
+/*
+  (1436509052.249713) can0 044#2A366C2BBA, 8 ID digits for extended
+  frames and R after # for remote frames.
+*/
+static bool parseLine(const char *line, uint64_t *at, char *interface, MCP2515Model::Frame *frame)
+{
+    unsigned long long seconds;
+    char fraction[7];
+    char rest[64];
+    if (sscanf(line, " (%llu.%6[0-9]) %15s %63s", &seconds, fraction, interface, rest) != 4)
+    {
+        return false;
+    }
+    uint32_t us = atol(fraction);
+    for (size_t i = strlen(fraction); i < 6; i++)
+        us *= 10;
+    *at = seconds * 1000000ULL + us;
+
+    const char *p = rest;
+    const char *hash = strchr(rest, '#');
+    uint32_t value;
+    memset(frame, 0, sizeof(*frame));
+    if (!hash || !parseHex(&p, 8, &value) || p != hash)
+    {
+        return false;
+    }
+    frame->id = value;
+    frame->isExtended = hash - rest == 8;
+    p++;
+    if (*p == 'R')
+    {
+        frame->isRemote = true;
+        return true;
+    }
+    while (*p && frame->len < 8)
+    {
+        const char *digits = p;
+        if (!parseHex(&p, 2, &value) || p - digits != 2)
+        {
+            return false;
+        }
+        frame->data[frame->len++] = value;
+    }
+    return *p == 0;
+}
+/*
+  Read ahead to the next frame of an interface we replay.
+*/
+static bool readFrame()
+{
+    char line[256];
+    char interface[16];
+    while (fgets(line, sizeof(line), trace.file))
+    {
+        uint64_t at;
+        if (!parseLine(line, &at, interface, &trace.pending))
+        {
+            trace.skipped++;
+            continue;
+        }
+        trace.isPBus = !strcmp(interface, trace.pbus);
+        if (strcmp(interface, trace.ibus) && (!CAN_PBUS || !trace.isPBus))
+        {
+            trace.skipped++;
+            continue;
+        }
+        if (!trace.hasStart)
+        {
+            trace.startAt = at;
+            trace.hasStart = true;
+        }
+        // Out of order lines from merged captures arrive right away
+        trace.pendingAt = at > trace.startAt ? at - trace.startAt : 0;
+        return trace.hasPending = true;
+    }
+    return trace.hasPending = false;
+}
+/*
+  Clock listener, puts every frame that is due on its bus. Runs during
+  delay() too, so frames keep arriving while the sketch blocks.
+*/
+static void deliverFrames()
+{
+    trace.now += (uint32_t)(micros() - trace.nowMicros);
+    trace.nowMicros = micros();
+    while (trace.hasPending && trace.pendingAt <= trace.now)
+    {
+#if CAN_PBUS
+        (trace.isPBus ? pbusModel : ibusModel).receive(trace.pending);
+#else
+        ibusModel.receive(trace.pending);
+#endif
+        trace.frames++;
+        readFrame();
+    }
+}
+
+static void addEvent(const char *event)
+{
+    char line[64];
+    snprintf(line, sizeof(line), "(%04llu.%06llu) %s", (unsigned long long)(trace.now / 1000000),
+             (unsigned long long)(trace.now % 1000000), event);
+    events.push_back(line);
+    puts(line);
+}
+
+static void onPinWrite(uint8_t pin, uint8_t val)
+{
+    switch (pin)
+    {
+    case BLUETOOTH_PIN0:
+    case BLUETOOTH_PIN1:
+    case TRANSISTOR_PIN:
+    case BT_NEXT:
+    case BT_PREVIOUS:
+        char event[16];
+        snprintf(event, sizeof(event), "gpio %u %u", pin, val);
+        addEvent(event);
+        break;
+    }
+}
+
+static void logTransmitted()
+{
+    for (; ibusTransmitted < ibusModel.transmitted.size(); ibusTransmitted++)
+    {
+        const MCP2515Model::Frame &frame = ibusModel.transmitted[ibusTransmitted];
+        char event[48];
+        int n = snprintf(event, sizeof(event), frame.isExtended ? "tx %08X#" : "tx %03X#", frame.id);
+        if (frame.isRemote)
+            n += snprintf(event + n, sizeof(event) - n, "R");
+        for (uint8_t i = 0; i < frame.len && !frame.isRemote; i++)
+            n += snprintf(event + n, sizeof(event) - n, "%02X", frame.data[i]);
+        addEvent(event);
+    }
+}
+
+static bool readBaseline(const char *path, std::vector<std::string> *lines)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\n")] = 0;
+        lines->push_back(line);
+    }
+    fclose(file);
+    return true;
+}
+/*
+  Line diff that gets back in step within DIFF_LOOKAHEAD events, enough for
+  a frame that moved or an extra message. Lines only in the baseline are
+  shown with -, lines only in this run with +.
+*/
+static uint32_t compareEvents(const std::vector<std::string> &baseline)
+{
+    size_t a = 0;
+    size_t b = 0;
+    uint32_t differences = 0;
+
+    auto show = [&](char sign, const std::string &line) {
+        if (differences++ < DIFF_MAX_SHOWN)
+            fprintf(stderr, "%c %s\n", sign, line.c_str());
+    };
+
+    while (a < baseline.size() || b < events.size())
+    {
+        if (a < baseline.size() && b < events.size() && baseline[a] == events[b])
+        {
+            a++;
+            b++;
+            continue;
+        }
+        // Nearest resync point, counting skipped lines on both sides
+        size_t bestA = baseline.size();
+        size_t bestB = events.size();
+        for (size_t i = a; i < baseline.size() && i - a < DIFF_LOOKAHEAD; i++)
+        {
+            for (size_t j = b; j < events.size() && j - b < DIFF_LOOKAHEAD; j++)
+            {
+                if (baseline[i] == events[j] && (i - a) + (j - b) < (bestA - a) + (bestB - b))
+                {
+                    bestA = i;
+                    bestB = j;
+                }
+            }
+        }
+        while (a < bestA)
+            show('-', baseline[a++]);
+        while (b < bestB)
+            show('+', events[b++]);
+    }
+    if (differences > DIFF_MAX_SHOWN)
+    {
+        fprintf(stderr, "... %u more\n", differences - DIFF_MAX_SHOWN);
+    }
+    return differences;
+}
+
+int main(int argc, char **argv)
+{
+    const char *baselinePath = nullptr;
+    trace.ibus = "can0";
+    trace.pbus = "can1";
+    int opt;
+    while ((opt = getopt(argc, argv, "c:i:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            baselinePath = optarg;
+            break;
+        case 'i':
+            trace.ibus = optarg;
+            break;
+        case 'p':
+            trace.pbus = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c baseline] [-i interface] [-p interface] trace.log\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-c baseline] [-i interface] [-p interface] trace.log\n", argv[0]);
+        return 2;
+    }
+    trace.file = fopen(argv[optind], "r");
+    if (!trace.file)
+    {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 2;
+    }
+    std::vector<std::string> baseline;
+    if (baselinePath && !readBaseline(baselinePath, &baseline))
+    {
+        return 2;
+    }
+
+    host::useVirtualClock(true);
+    host::attachSpiDevice(CAN_CS_PIN, &ibusModel);
+    ibusModel.setAutoTransmit(true);
+    // Bitrate checked by the model, so auto-baud settles on the I-BUS like in the car
+    ibusModel.setBusBitrate(MCP_OSC_HZ, 47619);
+#if CAN_PBUS
+    host::attachSpiDevice(PBUS_CS_PIN, &pbusModel);
+    pbusModel.setBusBitrate(MCP_OSC_HZ, 500000);
+#endif
+    host::setPinWriteListener(onPinWrite);
+    readFrame();
+    trace.nowMicros = micros();
+    host::setClockListener(deliverFrames);
+
+    auto start = std::chrono::steady_clock::now();
+    setup();
+    uint64_t lastFrameAt = 0;
+    while (trace.hasPending || trace.now - lastFrameAt < TAIL_US)
+    {
+        if (trace.hasPending)
+            lastFrameAt = trace.now;
+        loop();
+        logTransmitted();
+        host::advanceMicros(LOOP_US);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fflush(stdout);
+
+    CanReceiver::Stats rxStats;
+    canReceiver.getStats(&rxStats);
+    fprintf(stderr, "%llu frames in %.2f s, %.0f frames/s, %.0fx real time\n", (unsigned long long)trace.frames,
+            seconds, trace.frames / seconds, trace.now / 1e6 / seconds);
+    fprintf(stderr, "%llu lines skipped, %u frames lost in the controller, %u in the receive queue\n",
+            (unsigned long long)trace.skipped, ibusModel.overflowedFrames, rxStats.dropped);
+    fprintf(stderr, "%zu events, %zu frames sent\n", events.size(), ibusModel.transmitted.size());
+
+    if (baselinePath)
+    {
+        uint32_t differences = compareEvents(baseline);
+        fprintf(stderr, "%u differences to %s\n", differences, baselinePath);
+        return differences ? 1 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,317 @@
+/*
+  Sustained SLCAN throughput through a pseudo terminal.
+
+  The gateway runs against the register model on the virtual clock, with
+  the serial port draining at SLCAN_BAUD. Its output is written to the
+  master side of a pty and read back from the slave side like slcand would,
+  and commands take the opposite way. Each run offers back to back 8 byte
+  frames for one virtual second, then reports the frame rate that reached
+  the tool and where the rest were lost.
+
+  Exits non-zero if the gateway itself loses or reorders a frame, a transmit
+  command does not reach the bus, or the I-BUS run loses anything.
+*/
+#include <Arduino.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "mcp_can.h"
+#include "CanReceiver.h"
+#include "CanTxQueue.h"
+#include "SlcanGateway.h"
+#include "../mcp2515/MCP2515Model.h"
+#include "../../include/defines.h"
+
+#define LOOP_US        100 // Virtual time one loop() takes
+#define TX_INTERVAL_US 10000
+
+static MCP2515Model model(CAN_CS_PIN, CAN_INT_PIN);
+static MCP_CAN CAN(CAN_CS_PIN);
+static CanReceiver canReceiver(&CAN, CAN_INT_PIN);
+static CanTxQueue canTxQueue(&CAN);
+static SlcanGateway slcanGateway(&CAN, &canReceiver, &canTxQueue, &Serial);
+static int master = -1;
+static int slave = -1;
+static int failures = 0;
+
+struct Tool
+{
+    char line[40];
+    uint8_t length;
+    uint32_t frames;
+    uint32_t nextSeq;
+    uint32_t outOfOrder;
+    uint32_t acks;  // z and Z
+    uint32_t bells;
+    uint32_t bytes;
+};
+
+static Tool tool;
+
+static void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void onCanInterrupt()
+{
+    canReceiver.onInterrupt();
+}
+
+static uint8_t hexValue(char c)
+{
+    return c <= '9' ? c - '0' : c - 'A' + 10;
+}
+
+static void onToolLine()
+{
+    tool.line[tool.length] = 0;
+    if (tool.line[0] == 't' && tool.length >= 13)
+    {
+        // Data bytes 0-3 carry the sequence number of the offered frame
+        uint32_t seq = 0;
+        for (uint8_t i = 0; i < 8; i++)
+            seq = seq << 4 | hexValue(tool.line[5 + i]);
+        if (seq < tool.nextSeq)
+            tool.outOfOrder++;
+        tool.nextSeq = seq + 1;
+        tool.frames++;
+    }
+    else if (tool.line[0] == 'z' || tool.line[0] == 'Z')
+    {
+        tool.acks++;
+    }
+}
+
+static void onToolByte(uint8_t c)
+{
+    tool.bytes++;
+    if (c == '\a')
+    {
+        tool.bells++;
+        tool.length = 0;
+        return;
+    }
+    if (c != '\r')
+    {
+        if (tool.length < sizeof(tool.line) - 1)
+            tool.line[tool.length++] = c;
+        return;
+    }
+    onToolLine();
+    tool.length = 0;
+}
+/*
+  Read exactly size bytes from fd, waiting for the pty to pass them on.
+*/
+static bool receive(int fd, uint8_t *buffer, size_t size)
+{
+    size_t got = 0;
+    while (got < size)
+    {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) <= 0)
+            return false;
+        ssize_t n = read(fd, buffer + got, size - got);
+        if (n < 0 && errno != EAGAIN)
+            return false;
+        if (n > 0)
+            got += n;
+    }
+    return true;
+}
+/*
+  Gateway output, through the pty to the tool.
+*/
+static void onSerialOutput(const uint8_t *buffer, size_t size)
+{
+    uint8_t echo[256];
+    while (size)
+    {
+        size_t chunk = size < sizeof(echo) ? size : sizeof(echo);
+        if (write(master, buffer, chunk) != (ssize_t)chunk || !receive(slave, echo, chunk))
+        {
+            check(false, "pty to tool");
+            return;
+        }
+        for (size_t i = 0; i < chunk; i++)
+            onToolByte(echo[i]);
+        buffer += chunk;
+        size -= chunk;
+    }
+}
+/*
+  Tool command, through the pty to the gateway.
+*/
+static void sendCommand(const char *command)
+{
+    uint8_t buffer[64];
+    size_t size = strlen(command);
+    if (write(slave, command, size) != (ssize_t)size || !receive(master, buffer, size))
+    {
+        check(false, "pty to gateway");
+        return;
+    }
+    host::feedSerial(buffer, size);
+}
+
+static bool openPty()
+{
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+        return false;
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0)
+        return false;
+
+    struct termios tty;
+    tcgetattr(slave, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(slave, TCSANOW, &tty);
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    fcntl(slave, F_SETFL, O_NONBLOCK);
+    return true;
+}
+
+static void loopOnce()
+{
+    slcanGateway.update();
+    canTxQueue.update();
+    host::advanceMicros(LOOP_US);
+}
+
+static MCP2515Model::Frame makeFrame(uint32_t seq)
+{
+    MCP2515Model::Frame frame = {};
+    frame.id = 0x290;
+    frame.len = 8;
+    frame.data[0] = seq >> 24;
+    frame.data[1] = seq >> 16;
+    frame.data[2] = seq >> 8;
+    frame.data[3] = seq;
+    return frame;
+}
+/*
+  Offer frames back to back at bitrate for one second while the tool sends
+  a frame every TX_INTERVAL_US, then let everything drain.
+*/
+static void run(const char *name, const char *bitrateCommand, uint32_t bitrate, bool isTimestamped, bool isLossless)
+{
+    memset(&tool, 0, sizeof(tool));
+    model.transmitted.clear();
+    canReceiver.resetStats();
+    slcanGateway.stats = {};
+
+    sendCommand("C\r");
+    sendCommand(bitrateCommand);
+    sendCommand(isTimestamped ? "Z1\r" : "Z0\r");
+    sendCommand("O\r");
+    loopOnce();
+    check(slcanGateway.isOpen() && model.getMode() == MCP_NORMAL, "open");
+    uint32_t setupAcks = tool.acks;
+    uint32_t overflowed = model.overflowedFrames; // begin() resets the model
+    tool.bytes = 0;
+
+    // 8 byte standard frame without stuff bits, and 3 bits interframe space
+    uint32_t frameUs = 111 * 1000000UL / bitrate;
+    uint32_t start = micros();
+    uint32_t nextFrameAt = start;
+    uint32_t nextTxAt = start;
+    uint32_t offered = 0;
+    uint32_t commands = 0;
+
+    while (micros() - start < 1000000)
+    {
+        while ((int32_t)(micros() - nextFrameAt) >= 0)
+        {
+            model.receive(makeFrame(offered++));
+            nextFrameAt += frameUs;
+        }
+        if ((int32_t)(micros() - nextTxAt) >= 0)
+        {
+            sendCommand("t32881122334455667788\r");
+            commands++;
+            nextTxAt += TX_INTERVAL_US;
+        }
+        loopOnce();
+    }
+    uint32_t offerEnd = micros();
+
+    // Drain what is still queued, in the controller, ring or gateway buffers
+    uint32_t idle = 0;
+    while (idle < 100)
+    {
+        uint32_t before = tool.bytes;
+        loopOnce();
+        idle = tool.bytes == before ? idle + 1 : 0;
+    }
+    // Until the UART has sent the last byte
+    uint32_t unsent = 63 - Serial.availableForWrite();
+    uint32_t duration = micros() - start - idle * LOOP_US + unsent * 10000000UL / SLCAN_BAUD;
+
+    CanReceiver::Stats rxStats;
+    canReceiver.getStats(&rxStats);
+    uint32_t controllerLost = model.overflowedFrames - overflowed;
+    uint32_t tail = micros() - offerEnd - idle * LOOP_US;
+
+    printf("%-8s %7u %7u %7.0f %7.0f %6u %6u %6u %6u %5u\n", name, offered, tool.frames,
+           tool.frames * 1e6 / duration, tool.bytes * 1e6 / duration, controllerLost, rxStats.dropped,
+           commands, (unsigned)model.transmitted.size(), tail / 1000);
+
+    check(tool.frames == slcanGateway.stats.received, "gateway lost frames on the serial port");
+    check(tool.outOfOrder == 0, "frames out of order");
+    check(tool.frames + controllerLost + rxStats.dropped == offered, "frames unaccounted for");
+    check(tool.acks - setupAcks == commands && model.transmitted.size() == commands, "transmit commands");
+    check(tool.bells == 0, "refused commands");
+    if (isLossless)
+    {
+        check(tool.frames == offered, "frames lost");
+    }
+}
+
+int main()
+{
+    if (!openPty())
+    {
+        printf("FAIL: pty: %s\n", strerror(errno));
+        return 1;
+    }
+    host::useVirtualClock(true);
+    host::attachSpiDevice(CAN_CS_PIN, &model);
+    host::setSerialOutput(onSerialOutput);
+    model.setAutoTransmit(true);
+
+    Serial.begin(SLCAN_BAUD);
+    host::setSerialTxModel(true);
+    check(slcanGateway.restart(), "restart closed");
+    canReceiver.init(onCanInterrupt);
+
+    sendCommand("V\r");
+    loopOnce();
+    check(tool.line[0] == 'V', "version");
+    sendCommand("S9\r");
+    loopOnce();
+    check(tool.bells == 1, "S9 refused");
+
+    printf("SLCAN over a pty at %u baud, %u us per loop\n", SLCAN_BAUD, LOOP_US);
+    printf("%-8s %7s %7s %7s %7s %6s %6s %6s %6s %5s\n", "bus", "offered", "frames", "fps", "B/s", "ctrl", "ring",
+           "tx cmd", "tx bus", "tail");
+    // 47.619 kbps from SJA1000 BTR0/BTR1: BRP 8, 21 TQ, SJW 3
+    run("I-BUS", "s874E\r", 47619, true, true);
+    run("125k", "S4\r", 125000, false, false);
+    run("P-BUS", "S6\r", 500000, false, false);
+    printf("tail is ms spent draining after the bus stopped, ctrl and ring are frames lost before the gateway\n");
+
+    if (failures)
+    {
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
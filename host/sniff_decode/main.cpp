@@ -0,0 +1,246 @@
+/*
+  Decodes the CAN_SNIFFER serial stream into candump log lines.
+
+  usage: program [input]    serial device or capture file, default stdin
+
+  A serial device is switched to raw mode at CAN_SNIFFER_BAUD. Lines go to
+  stdout in `candump -l` format, bus 0 as can0 and the P-BUS as can1, so the
+  output can be fed to canplayer. Dropped frames are reported on stderr.
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "../../lib/CanSniffer/SnifferFormat.h"
+
+#define SNIFFER_BAUD B115200 // CAN_SNIFFER_BAUD in defines.h
+
+struct Decoder
+{
+    bool hasTimeBase;
+    bool hasSeq;
+    uint8_t nextSeq;
+    uint64_t time; // micros since the first status record, does not wrap
+    uint32_t lastTimestamp;
+    uint64_t frames;
+    uint64_t dropped;     // Sequence gaps
+    uint64_t badRecords;  // Failed COBS or length checks, stream resynced at the next zero
+    uint16_t serialDrops; // As last reported by the sniffer
+    uint16_t rxDrops;
+};
+
+static bool openInput(const char *path, int *fd)
+{
+    *fd = open(path, O_RDONLY | O_NOCTTY);
+    if (*fd < 0)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct termios tty;
+    if (tcgetattr(*fd, &tty) == 0)
+    {
+        cfmakeraw(&tty);
+        cfsetispeed(&tty, SNIFFER_BAUD);
+        cfsetospeed(&tty, SNIFFER_BAUD);
+        tty.c_cc[VMIN] = 1;
+        tty.c_cc[VTIME] = 0;
+        tcsetattr(*fd, TCSANOW, &tty);
+    }
+    return true;
+}
+
+static int cobsDecode(const uint8_t *in, int length, uint8_t *out)
+{
+    int o = 0;
+    int i = 0;
+    while (i < length)
+    {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > length)
+        {
+            return -1;
+        }
+        for (uint8_t j = 1; j < code; j++)
+        {
+            out[o++] = in[i++];
+        }
+        if (code != 0xFF && i < length)
+        {
+            out[o++] = 0;
+        }
+    }
+    return o;
+}
+
+static void checkSeq(Decoder *decoder, uint8_t seq)
+{
+    if (decoder->hasSeq && seq != decoder->nextSeq)
+    {
+        uint8_t gap = seq - decoder->nextSeq;
+        decoder->dropped += gap;
+        fprintf(stderr, "dropped %u frame(s) before seq %u\n", gap, seq);
+    }
+    decoder->hasSeq = true;
+}
+
+static bool decodeStatus(Decoder *decoder, const uint8_t *record, int length)
+{
+    if (length != 10)
+    {
+        return false;
+    }
+
+    checkSeq(decoder, record[0]);
+    decoder->nextSeq = record[0];
+
+    uint32_t timestamp = record[2] | record[3] << 8 | record[4] << 16 | (uint32_t)record[5] << 24;
+    if (decoder->hasTimeBase)
+    {
+        decoder->time += (uint32_t)(timestamp - decoder->lastTimestamp);
+    }
+    decoder->hasTimeBase = true;
+    decoder->lastTimestamp = timestamp;
+
+    uint16_t serialDrops = record[6] | record[7] << 8;
+    uint16_t rxDrops = record[8] | record[9] << 8;
+    if (rxDrops != decoder->rxDrops)
+    {
+        fprintf(stderr, "sniffer lost %u frame(s) before reading them\n", (uint16_t)(rxDrops - decoder->rxDrops));
+    }
+    decoder->serialDrops = serialDrops;
+    decoder->rxDrops = rxDrops;
+    return true;
+}
+
+static bool decodeFrame(Decoder *decoder, const uint8_t *record, int length)
+{
+    int i = 0;
+    uint8_t seq = record[i++];
+    uint8_t header = record[i++];
+    uint8_t len = header & SNIFFER_HEADER_LEN_MASK;
+    bool isExtended = header & SNIFFER_HEADER_EXT;
+    bool isRemote = header & SNIFFER_HEADER_RTR;
+
+    uint32_t delta = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7)
+    {
+        if (i >= length)
+        {
+            return false;
+        }
+        uint8_t b = record[i++];
+        delta |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            break;
+        }
+    }
+
+    uint8_t idBytes = isExtended ? 4 : 2;
+    uint8_t dataBytes = isRemote ? 0 : len;
+    if (len > 8 || i + idBytes + dataBytes != length)
+    {
+        return false;
+    }
+
+    uint32_t id = 0;
+    for (uint8_t b = 0; b < idBytes; b++)
+    {
+        id |= (uint32_t)record[i++] << (8 * b);
+    }
+
+    checkSeq(decoder, seq);
+    decoder->nextSeq = seq + 1;
+    decoder->frames++;
+
+    // Frames before the first status record have no time base
+    if (!decoder->hasTimeBase)
+    {
+        return true;
+    }
+    decoder->time += sniffer::unzigzag(delta);
+    decoder->lastTimestamp += sniffer::unzigzag(delta);
+
+    printf("(%llu.%06llu) can%u ", (unsigned long long)(decoder->time / 1000000),
+           (unsigned long long)(decoder->time % 1000000), (header & SNIFFER_HEADER_BUS) ? 1 : 0);
+    if (isExtended)
+        printf("%08X#", id & 0x1FFFFFFF);
+    else
+        printf("%03X#", id & 0x7FF);
+    if (isRemote)
+    {
+        printf("R");
+    }
+    for (uint8_t b = 0; b < dataBytes; b++)
+    {
+        printf("%02X", record[i++]);
+    }
+    printf("\n");
+    return true;
+}
+
+static void decodeRecord(Decoder *decoder, const uint8_t *encoded, int length)
+{
+    uint8_t record[SNIFFER_MAX_ENCODED];
+    int recordLength = length <= SNIFFER_MAX_ENCODED ? cobsDecode(encoded, length, record) : -1;
+
+    bool isValid = recordLength >= 2;
+    if (isValid)
+    {
+        isValid = record[1] == SNIFFER_RECORD_STATUS ? decodeStatus(decoder, record, recordLength)
+                                                     : decodeFrame(decoder, record, recordLength);
+    }
+    if (!isValid)
+    {
+        decoder->badRecords++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int fd = STDIN_FILENO;
+    if (argc > 1 && !openInput(argv[1], &fd))
+    {
+        return 1;
+    }
+
+    Decoder decoder = {};
+    uint8_t encoded[SNIFFER_MAX_ENCODED];
+    int length = 0;
+    bool isOverlong = false;
+    uint8_t buffer[256];
+    ssize_t n;
+
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if (buffer[i] != 0)
+            {
+                if (length < SNIFFER_MAX_ENCODED)
+                    encoded[length++] = buffer[i];
+                else
+                    isOverlong = true;
+                continue;
+            }
+
+            if (isOverlong)
+                decoder.badRecords++;
+            else if (length > 0)
+                decodeRecord(&decoder, encoded, length);
+            length = 0;
+            isOverlong = false;
+        }
+        fflush(stdout);
+    }
+
+    fprintf(stderr, "%llu frames, %llu dropped (sniffer reports %u at the serial port, %u before reading), %llu bad records\n",
+            (unsigned long long)decoder.frames, (unsigned long long)decoder.dropped, decoder.serialDrops,
+            decoder.rxDrops, (unsigned long long)decoder.badRecords);
+    return 0;
+}
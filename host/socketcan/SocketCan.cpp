@@ -0,0 +1,695 @@
+#include "SocketCan.h"
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/can/error.h>
+#include <linux/can/raw.h>
+
+SocketCan::SocketCan(const char *interfaceName)
+{
+    _interfaceName = interfaceName;
+    _fd = -1;
+    _mode = MODE_CONFIG;
+    _clockOffsetUs = 0;
+    _filterCount = 0;
+    _isFilterExact = false;
+    _rxCount = 0;
+    _rxIndex = 0;
+    _kernelDropCount = 0;
+    _txCount = 0;
+    _isTxDone = false;
+    _eflg = 0;
+    _isMessageError = false;
+    _tec = 0;
+    _rec = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+SocketCan::~SocketCan()
+{
+    close();
+}
+
+void SocketCan::setInterface(const char *interfaceName)
+{
+    _interfaceName = interfaceName;
+}
+
+void SocketCan::close()
+{
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _mode = MODE_CONFIG;
+    _rxCount = 0;
+    _rxIndex = 0;
+    _txCount = 0;
+}
+/*
+  Open and bind the raw socket. Like MCP_CAN the controller stays in
+  configuration mode, nothing is received until setMode().
+*/
+INT8U SocketCan::begin(INT8U idmodeset, const MCP_BitTiming &timing)
+{
+    close();
+
+    _fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (_fd < 0)
+    {
+        return CAN_FAILINIT;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, _interfaceName, IFNAMSIZ - 1);
+    if (ioctl(_fd, SIOCGIFINDEX, &ifr) < 0)
+    {
+        close();
+        return CAN_FAILINIT;
+    }
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    int on = 1;
+    can_err_mask_t errorMask = CAN_ERR_CRTL | CAN_ERR_BUSOFF | CAN_ERR_RESTARTED;
+
+    if (setsockopt(_fd, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0) < 0 ||
+        setsockopt(_fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &errorMask, sizeof(errorMask)) < 0 ||
+        setsockopt(_fd, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) < 0 ||
+        setsockopt(_fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0 ||
+        bind(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close();
+        return CAN_FAILINIT;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    _clockOffsetUs = (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000 - (int64_t)micros();
+
+    // Same defaults as mcp2515_initCANBuffers(): masks open, std and ext filters
+    memset(_masks, 0, sizeof(_masks));
+    memset(_filterIds, 0, sizeof(_filterIds));
+    _filterExt = 0x15;
+    _isFilterExact = false;
+
+    if (idmodeset == MCP_ANY)
+    {
+        _filters[0].can_id = 0;
+        _filters[0].can_mask = 0;
+        _filterCount = 1;
+        _isFilterExact = true;
+    }
+
+    _kernelDropCount = 0;
+    _isTxDone = false;
+    _eflg = 0;
+    _isMessageError = false;
+    _tec = 0;
+    _rec = 0;
+    return CAN_OK;
+}
+/*
+  Masks and filters take the same values as MCP_CAN and are turned into
+  kernel filters, so false accepts match the MCP2515.
+*/
+INT8U SocketCan::init_Mask(INT8U num, INT8U ext, INT32U ulData)
+{
+    if (num > 1)
+    {
+        return MCP2515_FAIL;
+    }
+    _masks[num] = ulData;
+    _isFilterExact = false;
+    return applyFilters();
+}
+
+INT8U SocketCan::init_Filt(INT8U num, INT8U ext, INT32U ulData)
+{
+    if (num > 5)
+    {
+        return MCP2515_FAIL;
+    }
+    _filterIds[num] = ulData;
+    _filterExt = ext ? _filterExt | (1 << num) : _filterExt & ~(1 << num);
+    _isFilterExact = false;
+    return applyFilters();
+}
+/*
+  One exact kernel filter per standard ID, no mask sharing.
+*/
+INT8U SocketCan::setFilters(const uint16_t *ids, uint8_t count)
+{
+    if (count > CAN_SOCKET_MAX_FILTERS)
+    {
+        return MCP2515_FAIL;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        _filters[i].can_id = ids[i] & CAN_SFF_MASK;
+        _filters[i].can_mask = CAN_SFF_MASK | CAN_EFF_FLAG;
+    }
+    _filterCount = count;
+    _isFilterExact = true;
+    return applyFilters();
+}
+
+INT8U SocketCan::applyFilters()
+{
+    if (_fd < 0)
+    {
+        return MCP2515_FAIL;
+    }
+    if (_mode == MODE_CONFIG)
+    {
+        return setsockopt(_fd, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0) < 0 ? MCP2515_FAIL : MCP2515_OK;
+    }
+
+    if (!_isFilterExact)
+    {
+        // RXF0-1 use RXM0, RXF2-5 use RXM1
+        for (uint8_t i = 0; i < 6; i++)
+        {
+            INT32U mask = _masks[i < 2 ? 0 : 1];
+            if (_filterExt & (1 << i))
+            {
+                _filters[i].can_id = (_filterIds[i] & CAN_EFF_MASK) | CAN_EFF_FLAG;
+                _filters[i].can_mask = (mask & CAN_EFF_MASK) | CAN_EFF_FLAG;
+            }
+            else
+            {
+                _filters[i].can_id = (_filterIds[i] >> 16) & CAN_SFF_MASK;
+                _filters[i].can_mask = ((mask >> 16) & CAN_SFF_MASK) | CAN_EFF_FLAG;
+            }
+        }
+        _filterCount = 6;
+    }
+
+    int res = setsockopt(_fd, SOL_CAN_RAW, CAN_RAW_FILTER, _filters, _filterCount * sizeof(struct can_filter));
+    return res < 0 ? MCP2515_FAIL : MCP2515_OK;
+}
+/*
+  Normal, listen-only and loopback are supported. Listen-only refuses to
+  send, the interface itself still acknowledges frames.
+*/
+INT8U SocketCan::setMode(INT8U opMode)
+{
+    if (_fd < 0)
+    {
+        return MCP2515_FAIL;
+    }
+    if (opMode != MCP_NORMAL && opMode != MCP_LISTENONLY && opMode != MCP_LOOPBACK && opMode != MODE_CONFIG)
+    {
+        return MCP2515_FAIL;
+    }
+
+    int loopback = opMode == MCP_LOOPBACK;
+    if (setsockopt(_fd, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &loopback, sizeof(loopback)) < 0)
+    {
+        return MCP2515_FAIL;
+    }
+
+    _mode = opMode;
+    return applyFilters();
+}
+
+INT8U SocketCan::queueFrame(INT32U id, INT8U ext, INT8U rtr, INT8U len, const INT8U *buf)
+{
+    if (_fd < 0 || _mode == MODE_CONFIG || _mode == MCP_LISTENONLY)
+    {
+        return CAN_FAILTX;
+    }
+    if (_txCount == CAN_SOCKET_BATCH && !flushTx() && _txCount == CAN_SOCKET_BATCH)
+    {
+        return CAN_TXBUSY;
+    }
+
+    struct can_frame *frame = &_tx[_txCount++];
+    memset(frame, 0, sizeof(*frame));
+    frame->can_id = ext ? (id & CAN_EFF_MASK) | CAN_EFF_FLAG : id & CAN_SFF_MASK;
+    if (rtr)
+    {
+        frame->can_id |= CAN_RTR_FLAG;
+    }
+    frame->can_dlc = len > CAN_MAX_DLEN ? CAN_MAX_DLEN : len;
+    if (!rtr && buf)
+    {
+        memcpy(frame->data, buf, frame->can_dlc);
+    }
+    return CAN_OK;
+}
+/*
+  Send the queued frames with one sendmmsg. Returns true when nothing is left.
+*/
+bool SocketCan::flushTx()
+{
+    if (_txCount == 0)
+    {
+        return true;
+    }
+
+    struct mmsghdr msgs[CAN_SOCKET_BATCH];
+    struct iovec iov[CAN_SOCKET_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+
+    for (uint8_t i = 0; i < _txCount; i++)
+    {
+        iov[i].iov_base = &_tx[i];
+        iov[i].iov_len = sizeof(struct can_frame);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int sent = sendmmsg(_fd, msgs, _txCount, MSG_DONTWAIT);
+    if (sent < 0)
+    {
+        if (errno == EAGAIN || errno == ENOBUFS)
+        {
+            return false; // Kernel TX queue is full, retry later
+        }
+        // Interface went down, usually bus-off without automatic restart
+        _eflg |= MCP_EFLG_TXBO;
+        _txCount = 0;
+        return true;
+    }
+
+    stats.txBatches++;
+    stats.txFrames += sent;
+    _isTxDone = true;
+    _txCount -= sent;
+    memmove(_tx, &_tx[sent], _txCount * sizeof(struct can_frame));
+    return _txCount == 0;
+}
+
+/*
+  Like MCP_CAN, wait up to 50 ms for the frame to be accepted.
+*/
+INT8U SocketCan::flushTxBlocking()
+{
+    uint32_t start = millis();
+    while (!flushTx())
+    {
+        struct pollfd pfd = {_fd, POLLOUT, 0};
+        if (millis() - start > 50 || ::poll(&pfd, 1, 10) < 0)
+        {
+            return CAN_SENDMSGTIMEOUT;
+        }
+    }
+    return CAN_OK;
+}
+
+INT8U SocketCan::sendMsgBuf(INT32U id, INT8U ext, INT8U len, INT8U *buf)
+{
+    INT8U res = queueFrame(id, ext, 0, len, buf);
+    return res == CAN_OK ? flushTxBlocking() : res;
+}
+
+INT8U SocketCan::sendMsgBuf(INT32U id, INT8U len, INT8U *buf)
+{
+    INT8U ext = (id & 0x80000000) == 0x80000000;
+    INT8U rtr = (id & 0x40000000) == 0x40000000;
+    INT8U res = queueFrame(id, ext, rtr, len, buf);
+    return res == CAN_OK ? flushTxBlocking() : res;
+}
+/*
+  Frames are queued and leave in one sendmmsg on the next flush: when the
+  batch is full, on receive and on checkTXComplete().
+*/
+INT8U SocketCan::sendMsgBufNB(INT32U id, INT8U ext, INT8U len, INT8U *buf)
+{
+    return queueFrame(id, ext, 0, len, buf);
+}
+
+INT8U SocketCan::sendMsgBufNB(INT32U id, INT8U len, INT8U *buf)
+{
+    INT8U ext = (id & 0x80000000) == 0x80000000;
+    INT8U rtr = (id & 0x40000000) == 0x40000000;
+    return queueFrame(id, ext, rtr, len, buf);
+}
+
+INT8U SocketCan::sendFrame(const CanFrame *frame)
+{
+    INT8U res = sendFrameNB(frame);
+    return res == CAN_OK ? flushTxBlocking() : res;
+}
+
+INT8U SocketCan::sendFrameNB(const CanFrame *frame)
+{
+    return queueFrame(frame->id, (frame->flags & CAN_FRAME_EXT) ? 1 : 0,
+                      (frame->flags & CAN_FRAME_RTR) ? 1 : 0, frame->len, frame->data);
+}
+/*
+  The kernel queue keeps submission order, so buffer and priority are only
+  there for the MCP_CAN interface.
+*/
+INT8U SocketCan::sendFrameNB(const CanFrame *frame, INT8U txbuf, INT8U txPriority)
+{
+    return sendFrameNB(frame);
+}
+/*
+  Busy only while the batch waiting for sendmmsg is full.
+*/
+INT8U SocketCan::getTXBusy(void)
+{
+    if (_txCount == CAN_SOCKET_BATCH)
+    {
+        flushTx();
+    }
+    return _txCount == CAN_SOCKET_BATCH ? 0x07 : 0;
+}
+/*
+  Returns MCP_TX0IF once everything queued so far has been handed to the kernel.
+*/
+INT8U SocketCan::checkTXComplete(void)
+{
+    if (flushTx() && _isTxDone)
+    {
+        _isTxDone = false;
+        return MCP_TX0IF;
+    }
+    return 0;
+}
+
+bool SocketCan::isTXPending(void)
+{
+    return _txCount != 0 || _isTxDone;
+}
+/*
+  Receive up to CAN_SOCKET_BATCH frames with one recvmmsg.
+*/
+bool SocketCan::fillRx()
+{
+    if (_fd < 0)
+    {
+        return false;
+    }
+    flushTx();
+
+    struct mmsghdr msgs[CAN_SOCKET_BATCH];
+    struct iovec iov[CAN_SOCKET_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+
+    for (uint8_t i = 0; i < CAN_SOCKET_BATCH; i++)
+    {
+        iov[i].iov_base = &_rx[i].frame;
+        iov[i].iov_len = sizeof(struct can_frame);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = _rx[i].control;
+        msgs[i].msg_hdr.msg_controllen = sizeof(_rx[i].control);
+    }
+
+    int received = recvmmsg(_fd, msgs, CAN_SOCKET_BATCH, MSG_DONTWAIT, NULL);
+    if (received <= 0)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < received; i++)
+    {
+        uint32_t timestamp = micros();
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET)
+            {
+                continue;
+            }
+            if (cmsg->cmsg_type == SO_TIMESTAMP)
+            {
+                struct timeval tv;
+                memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+                timestamp = (uint32_t)((int64_t)tv.tv_sec * 1000000 + tv.tv_usec - _clockOffsetUs);
+            }
+            else if (cmsg->cmsg_type == SO_RXQ_OVFL)
+            {
+                // Running count of frames the kernel dropped for this socket
+                uint32_t drops;
+                memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+                if (drops != _kernelDropCount)
+                {
+                    stats.kernelDrops += drops - _kernelDropCount;
+                    _kernelDropCount = drops;
+                    _eflg |= MCP_EFLG_RX0OVR;
+                }
+            }
+        }
+        _rx[i].timestamp = timestamp;
+    }
+
+    stats.rxBatches++;
+    _rxCount = received;
+    _rxIndex = 0;
+    return true;
+}
+
+const struct can_frame *SocketCan::nextFrame(uint32_t *timestamp)
+{
+    while (true)
+    {
+        if (_rxIndex >= _rxCount && !fillRx())
+        {
+            return NULL;
+        }
+
+        RxSlot *slot = &_rx[_rxIndex++];
+        if (slot->frame.can_id & CAN_ERR_FLAG)
+        {
+            onErrorFrame(slot->frame);
+            continue;
+        }
+
+        stats.rxFrames++;
+        *timestamp = slot->timestamp;
+        return &slot->frame;
+    }
+}
+/*
+  Kernel error frames stand in for EFLG, TEC and REC of the MCP2515.
+*/
+void SocketCan::onErrorFrame(const struct can_frame &frame)
+{
+    stats.errorFrames++;
+
+    if (frame.can_id & (CAN_ERR_PROT | CAN_ERR_ACK))
+    {
+        _isMessageError = true;
+    }
+    if (frame.can_id & CAN_ERR_BUSOFF)
+    {
+        _eflg |= MCP_EFLG_TXBO;
+    }
+    if (frame.can_id & CAN_ERR_RESTARTED)
+    {
+        _eflg &= MCP_EFLG_RX1OVR | MCP_EFLG_RX0OVR;
+        _tec = 0;
+        _rec = 0;
+    }
+    if (frame.can_id & CAN_ERR_CRTL)
+    {
+        uint8_t crtl = frame.data[1];
+        if (crtl & CAN_ERR_CRTL_RX_OVERFLOW)
+            _eflg |= MCP_EFLG_RX0OVR;
+        if (crtl & CAN_ERR_CRTL_RX_WARNING)
+            _eflg |= MCP_EFLG_RXWAR | MCP_EFLG_EWARN;
+        if (crtl & CAN_ERR_CRTL_TX_WARNING)
+            _eflg |= MCP_EFLG_TXWAR | MCP_EFLG_EWARN;
+        if (crtl & CAN_ERR_CRTL_RX_PASSIVE)
+            _eflg |= MCP_EFLG_RXEP;
+        if (crtl & CAN_ERR_CRTL_TX_PASSIVE)
+            _eflg |= MCP_EFLG_TXEP;
+#ifdef CAN_ERR_CRTL_ACTIVE
+        if (crtl & CAN_ERR_CRTL_ACTIVE)
+            _eflg &= MCP_EFLG_RX1OVR | MCP_EFLG_RX0OVR;
+#endif
+    }
+#ifdef CAN_ERR_CNT
+    if (frame.can_id & CAN_ERR_CNT)
+    {
+        _tec = frame.data[6];
+        _rec = frame.data[7];
+    }
+#endif
+}
+
+/*
+  The kernel does not report which filter matched, filterHit is the first
+  installed filter the frame passes.
+*/
+uint8_t SocketCan::matchFilter(canid_t canId) const
+{
+    for (uint8_t i = 0; i < _filterCount; i++)
+    {
+        if (((canId ^ _filters[i].can_id) & _filters[i].can_mask) == 0)
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+INT8U SocketCan::readFrame(CanFrame *frame)
+{
+    uint32_t timestamp;
+    const struct can_frame *received = nextFrame(&timestamp);
+    if (!received)
+    {
+        return CAN_NOMSG;
+    }
+
+    frame->flags = 0;
+    if (received->can_id & CAN_EFF_FLAG)
+    {
+        frame->id = received->can_id & CAN_EFF_MASK;
+        frame->flags |= CAN_FRAME_EXT;
+    }
+    else
+    {
+        frame->id = received->can_id & CAN_SFF_MASK;
+    }
+    if (received->can_id & CAN_RTR_FLAG)
+    {
+        frame->flags |= CAN_FRAME_RTR;
+    }
+
+    frame->len = received->can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : received->can_dlc;
+    memcpy(frame->data, received->data, frame->len);
+    frame->filterHit = matchFilter(received->can_id);
+    frame->timestamp = timestamp;
+    return CAN_OK;
+}
+
+INT8U SocketCan::readMsgBuf(INT32U *id, INT8U *ext, INT8U *len, INT8U *buf)
+{
+    CanFrame frame;
+    if (readFrame(&frame) != CAN_OK)
+    {
+        return CAN_NOMSG;
+    }
+    *id = frame.id;
+    *ext = (frame.flags & CAN_FRAME_EXT) ? 1 : 0;
+    *len = frame.len;
+    memcpy(buf, frame.data, frame.len);
+    return CAN_OK;
+}
+
+INT8U SocketCan::readMsgBuf(INT32U *id, INT8U *len, INT8U *buf)
+{
+    CanFrame frame;
+    if (readFrame(&frame) != CAN_OK)
+    {
+        return CAN_NOMSG;
+    }
+    *id = frame.id;
+    if (frame.flags & CAN_FRAME_EXT)
+        *id |= 0x80000000;
+    if (frame.flags & CAN_FRAME_RTR)
+        *id |= 0x40000000;
+    *len = frame.len;
+    memcpy(buf, frame.data, frame.len);
+    return CAN_OK;
+}
+/*
+  Same contract as MCP_CAN::poll(), frames are handed over from one stack frame.
+*/
+INT8U SocketCan::poll(void (*handler)(CanFrame &frame), INT8U maxFrames)
+{
+    CanFrame frame;
+    INT8U handled = 0;
+
+    while (handled < maxFrames && readFrame(&frame) == CAN_OK)
+    {
+        handler(frame);
+        handled++;
+    }
+    return handled;
+}
+
+INT8U SocketCan::checkReceive(void)
+{
+    if (_rxIndex < _rxCount || fillRx())
+    {
+        return CAN_MSGAVAIL;
+    }
+    return CAN_NOMSG;
+}
+/*
+  Block until a frame arrives or timeoutMs passes, so loop() does not spin.
+*/
+bool SocketCan::waitForFrames(uint16_t timeoutMs)
+{
+    if (_rxIndex < _rxCount)
+    {
+        return true;
+    }
+    if (_fd < 0)
+    {
+        delay(timeoutMs);
+        return false;
+    }
+    struct pollfd pfd = {_fd, POLLIN, 0};
+    return ::poll(&pfd, 1, timeoutMs) > 0;
+}
+
+INT8U SocketCan::checkError(void)
+{
+    return (_eflg & MCP_EFLG_ERRORMASK) ? CAN_CTRLERROR : CAN_OK;
+}
+
+INT8U SocketCan::getError(void)
+{
+    return _eflg;
+}
+
+/*
+  Error frames are only seen when frames are read, like MERRF it latches.
+*/
+INT8U SocketCan::checkMessageError(void)
+{
+    bool isError = _isMessageError;
+    _isMessageError = false;
+    return isError ? CAN_CTRLERROR : CAN_OK;
+}
+
+INT8U SocketCan::errorCountRX(void)
+{
+    return _rec;
+}
+
+INT8U SocketCan::errorCountTX(void)
+{
+    return _tec;
+}
+
+INT8U SocketCan::clearRxOverflow(void)
+{
+    _eflg &= ~(MCP_EFLG_RX0OVR | MCP_EFLG_RX1OVR);
+    return CAN_OK;
+}
+/*
+  A closed socket reports MODE_CONFIG, which makes CanHealthMonitor reinit.
+*/
+INT8U SocketCan::getMode(void)
+{
+    return _fd < 0 ? MODE_CONFIG : _mode;
+}
+/*
+  The interface belongs to the kernel, it can not be put to sleep from here.
+*/
+INT8U SocketCan::sleep(void)
+{
+    return MCP2515_FAIL;
+}
+
+INT8U SocketCan::wake(void)
+{
+    return _fd < 0 ? MCP2515_FAIL : MCP2515_OK;
+}
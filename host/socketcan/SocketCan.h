@@ -0,0 +1,116 @@
+#pragma once
+
+#include <Arduino.h>
+#include <linux/can.h>
+#include <sys/socket.h>
+#include "mcp_can.h"
+#include "../../include/defines.h"
+
+/*
+  SocketCAN controller with the public API of MCP_CAN, so the Trionic logic
+  can run on a Linux board. Selected with CAN_SOCKETCAN, see can_controller.h.
+
+  Frames are moved in batches of CAN_SOCKET_BATCH with recvmmsg and sendmmsg.
+  Received frames carry the kernel receive timestamp, converted to the
+  micros() time base. Bit rate is set on the interface (ip link), the timing
+  passed to begin() is ignored.
+*/
+class SocketCan
+{
+public:
+    struct Stats
+    {
+        uint32_t rxBatches;
+        uint32_t rxFrames;
+        uint32_t txBatches;
+        uint32_t txFrames;
+        uint32_t kernelDrops; // Socket receive queue overflows
+        uint32_t errorFrames;
+    };
+
+    SocketCan(const char *interfaceName);
+    ~SocketCan();
+    void setInterface(const char *interfaceName);
+
+    INT8U begin(INT8U idmodeset, const MCP_BitTiming &timing);
+    INT8U init_Mask(INT8U num, INT8U ext, INT32U ulData);
+    INT8U init_Filt(INT8U num, INT8U ext, INT32U ulData);
+    INT8U setFilters(const uint16_t *ids, uint8_t count);
+    template <uint8_t N>
+    INT8U setFilters(const uint16_t (&ids)[N]) { return setFilters(ids, N); }
+    INT8U setMode(INT8U opMode);
+
+    INT8U sendMsgBuf(INT32U id, INT8U ext, INT8U len, INT8U *buf);
+    INT8U sendMsgBuf(INT32U id, INT8U len, INT8U *buf);
+    INT8U sendMsgBufNB(INT32U id, INT8U ext, INT8U len, INT8U *buf);
+    INT8U sendMsgBufNB(INT32U id, INT8U len, INT8U *buf);
+    INT8U sendFrame(const CanFrame *frame);
+    INT8U sendFrameNB(const CanFrame *frame);
+    INT8U sendFrameNB(const CanFrame *frame, INT8U txbuf, INT8U txPriority);
+    INT8U getTXBusy(void);
+    INT8U checkTXComplete(void);
+    bool isTXPending(void);
+
+    INT8U readMsgBuf(INT32U *id, INT8U *ext, INT8U *len, INT8U *buf);
+    INT8U readMsgBuf(INT32U *id, INT8U *len, INT8U *buf);
+    INT8U readFrame(CanFrame *frame);
+    INT8U poll(void (*handler)(CanFrame &frame), INT8U maxFrames = MCP_POLL_MAX_FRAMES);
+    INT8U checkReceive(void);
+    bool waitForFrames(uint16_t timeoutMs);
+
+    INT8U checkError(void);
+    INT8U getError(void);
+    INT8U checkMessageError(void);
+    INT8U errorCountRX(void);
+    INT8U errorCountTX(void);
+    INT8U clearRxOverflow(void);
+    INT8U getMode(void);
+    INT8U sleep(void);
+    INT8U wake(void);
+
+    Stats stats;
+
+private:
+    struct RxSlot
+    {
+        struct can_frame frame;
+        char control[CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(uint32_t))];
+        uint32_t timestamp;
+    };
+
+    void close();
+    INT8U applyFilters();
+    INT8U queueFrame(INT32U id, INT8U ext, INT8U rtr, INT8U len, const INT8U *buf);
+    bool flushTx();
+    INT8U flushTxBlocking();
+    bool fillRx();
+    const struct can_frame *nextFrame(uint32_t *timestamp);
+    void onErrorFrame(const struct can_frame &frame);
+    uint8_t matchFilter(canid_t canId) const;
+
+    const char *_interfaceName;
+    int _fd;
+    INT8U _mode;
+    int64_t _clockOffsetUs; // Kernel realtime minus micros()
+
+    struct can_filter _filters[CAN_SOCKET_MAX_FILTERS];
+    uint8_t _filterCount;
+    bool _isFilterExact; // Set by setFilters(), otherwise built from masks and filters
+    INT32U _masks[2];
+    INT32U _filterIds[6];
+    uint8_t _filterExt; // Bit per filter, set for extended IDs
+
+    RxSlot _rx[CAN_SOCKET_BATCH];
+    uint8_t _rxCount;
+    uint8_t _rxIndex;
+    uint32_t _kernelDropCount;
+
+    struct can_frame _tx[CAN_SOCKET_BATCH];
+    uint8_t _txCount;
+    bool _isTxDone;
+
+    INT8U _eflg;
+    bool _isMessageError; // Protocol error frame since the last checkMessageError()
+    INT8U _tec;
+    INT8U _rec;
+};
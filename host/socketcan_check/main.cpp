@@ -0,0 +1,117 @@
+/*
+  Checks SocketCan against a virtual CAN interface:
+
+    sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+    program [interface]
+
+  Exits non-zero if batching, kernel filters, timestamps or modes misbehave.
+*/
+#include <Arduino.h>
+#include "SocketCan.h"
+#include "../../include/communication.h"
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+    printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+    if (!condition)
+    {
+        failures++;
+    }
+}
+
+static bool isHandled(uint32_t id)
+{
+    for (uint16_t handled : HANDLED_CAN_IDS)
+    {
+        if (handled == id)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    const char *interfaceName = argc > 1 ? argv[1] : "vcan0";
+    SocketCan receiver(interfaceName);
+    SocketCan sender(interfaceName);
+
+    if (receiver.begin(MCP_STDEXT, P_BUS) != CAN_OK || sender.begin(MCP_ANY, P_BUS) != CAN_OK)
+    {
+        printf("Can not open %s, create it with:\n"
+               "  sudo ip link add dev %s type vcan && sudo ip link set up %s\n",
+               interfaceName, interfaceName, interfaceName);
+        return 2;
+    }
+
+    check(receiver.setFilters(HANDLED_CAN_IDS) == MCP2515_OK, "kernel filters from HANDLED_CAN_IDS");
+    check(receiver.setMode(MCP_NORMAL) == MCP2515_OK && sender.setMode(MCP_NORMAL) == MCP2515_OK, "normal mode");
+
+    // Every other frame is one the sketch does not handle
+    const uint32_t unhandled[] = {0x123, 0x7FF, 0x291, 0x18DAF110 | 0x80000000};
+    uint8_t data[8] = {0};
+    uint16_t handledSent = 0;
+    uint16_t total = 4 * CAN_SOCKET_BATCH;
+    uint32_t sentAt = micros();
+
+    for (uint16_t i = 0; i < total; i++)
+    {
+        uint32_t id = (i & 1) ? unhandled[(i >> 1) % 4] : HANDLED_CAN_IDS[(i >> 1) % (sizeof(HANDLED_CAN_IDS) / 2)];
+        data[0] = i;
+        data[1] = i >> 8;
+        if (sender.sendMsgBufNB(id, 8, data) != CAN_OK)
+        {
+            check(false, "sendMsgBufNB");
+            break;
+        }
+        if (isHandled(id))
+            handledSent++;
+    }
+    for (uint8_t i = 0; i < 100 && sender.isTXPending(); i++)
+    {
+        sender.checkTXComplete();
+    }
+    check(sender.stats.txFrames == total, "all frames sent");
+    check(sender.stats.txBatches <= (uint32_t)(total / CAN_SOCKET_BATCH + 1), "sendmmsg batches");
+
+    CanFrame frame;
+    uint16_t received = 0;
+    uint16_t lastIndex = 0;
+    bool isOnlyHandled = true;
+    bool isInOrder = true;
+    bool isTimestampValid = true;
+    uint32_t lastTimestamp = sentAt;
+
+    while (received < handledSent && receiver.waitForFrames(200))
+    {
+        while (receiver.readFrame(&frame) == CAN_OK)
+        {
+            uint16_t index = frame.data[0] | (frame.data[1] << 8);
+            isOnlyHandled &= isHandled(frame.id);
+            isInOrder &= received == 0 || index > lastIndex;
+            // Kernel stamps are in the micros() time base and never go backwards
+            isTimestampValid &= (int32_t)(frame.timestamp - lastTimestamp) >= 0 &&
+                                (int32_t)(micros() - frame.timestamp) >= 0;
+            lastIndex = index;
+            lastTimestamp = frame.timestamp;
+            received++;
+        }
+    }
+
+    check(received == handledSent, "every handled frame received");
+    check(isOnlyHandled, "unhandled IDs dropped by the kernel");
+    check(isInOrder, "frames in order");
+    check(isTimestampValid, "kernel timestamps");
+    check(receiver.stats.rxBatches < receiver.stats.rxFrames, "recvmmsg batches");
+
+    check(receiver.setMode(MCP_LISTENONLY) == MCP2515_OK, "listen-only mode");
+    check(receiver.sendMsgBufNB(0x290, 8, data) == CAN_FAILTX, "listen-only refuses to send");
+
+    check(sender.setMode(MCP_LOOPBACK) == MCP2515_OK, "loopback mode");
+    sender.sendMsgBuf(0x290, 8, data);
+    check(sender.waitForFrames(200) && sender.readFrame(&frame) == CAN_OK && frame.id == 0x290, "loopback receives own frame");
+
+    printf("\n%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+/*
+  SPI cost of the MCP_CAN public API, measured against the register model.
+
+  Prints transactions and bytes per call so a driver change can be judged
+  by the SPI traffic it saves. Whether the calls do the right thing is
+  checked by the unit tests in test/.
+*/
+#include <Arduino.h>
+#include "mcp_can.h"
+#include "CanReceiver.h"
+#include "CanTxQueue.h"
+#include "CanAutoBaud.h"
+#include "PowerManager.h"
+#include "../mcp2515/MCP2515Model.h"
+#include "../../include/defines.h"
+
+static MCP2515Model model(CAN_CS_PIN, CAN_INT_PIN);
+static MCP_CAN CAN(CAN_CS_PIN);
+
+static void report(const char *name)
+{
+    const MCP2515Model::Counters &c = model.counters;
+    printf("%-32s %5u %6u %5u %6u %6u %6u %4u\n", name, c.transactions, c.bytes, c.reads, c.writes,
+           c.bitModifies, c.statusReads, c.requestsToSend);
+}
+
+#define MEASURE(name, call) \
+    do                      \
+    {                       \
+        model.resetCounters(); \
+        call;               \
+        report(name);       \
+    } while (0)
+
+static MCP2515Model::Frame makeFrame(uint32_t id, uint8_t len)
+{
+    MCP2515Model::Frame frame = {};
+    frame.id = id;
+    frame.len = len;
+    for (uint8_t i = 0; i < len; i++)
+        frame.data[i] = i + 1;
+    return frame;
+}
+
+static uint32_t busFrameAt;
+static uint32_t busFrameInterval = 10000;
+static uint32_t busFrames;
+// P-BUS engine frame every 10 ms of virtual time
+static void busTraffic()
+{
+    if ((int32_t)(micros() - busFrameAt) >= (int32_t)busFrameInterval)
+    {
+        busFrameAt = micros();
+        busFrames++;
+        model.receive(makeFrame(0x1A0, 8));
+    }
+}
+
+static void onPowerChange()
+{
+}
+
+int main()
+{
+    uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    INT32U id;
+    INT8U len;
+    INT8U buf[8];
+
+    printf("%-32s %5s %6s %5s %6s %6s %6s %4s\n", "call", "trans", "bytes", "read", "write", "bitmod", "status", "rts");
+
+    MEASURE("begin(MCP_STDEXT, I_BUS)", CAN.begin(MCP_STDEXT, I_BUS));
+
+    MEASURE("init_Mask(0, 0, 0x7FF0000)", CAN.init_Mask(0, 0, 0x7FF0000));
+    MEASURE("init_Filt(0, 0, 0x2900000)", CAN.init_Filt(0, 0, 0x2900000));
+    MEASURE("setMode(MCP_NORMAL)", CAN.setMode(MCP_NORMAL));
+
+    MEASURE("checkReceive() empty", CAN.checkReceive());
+    MEASURE("readMsgBuf() empty", CAN.readMsgBuf(&id, &len, buf));
+
+    model.receive(makeFrame(0x290, 8));
+    MEASURE("checkReceive() one frame", CAN.checkReceive());
+    MEASURE("readMsgBuf() 8 bytes", CAN.readMsgBuf(&id, &len, buf));
+
+    model.receive(makeFrame(0x290, 2));
+    MEASURE("readMsgBuf() 2 bytes", CAN.readMsgBuf(&id, &len, buf));
+
+    model.receive(makeFrame(0x290, 8));
+    model.receive(makeFrame(0x290, 8));
+    MEASURE("checkReceiveBuffers() both", CAN.checkReceiveBuffers());
+    CAN.readMsgBuf(&id, &len, buf);
+    CAN.readMsgBuf(&id, &len, buf);
+
+    CanFrame frame;
+    model.receive(makeFrame(0x290, 8));
+    MEASURE("readFrame() 8 bytes", CAN.readFrame(&frame));
+
+    model.receive(makeFrame(0x290, 8));
+    model.receive(makeFrame(0x290, 8));
+    MEASURE("poll() 2 frames", CAN.poll([](CanFrame &frame) {}));
+
+    model.transmitted.clear();
+    MEASURE("sendMsgBuf() 8 bytes", CAN.sendMsgBuf(0x328, 0, 8, data));
+
+    MEASURE("sendMsgBufNB() 8 bytes", CAN.sendMsgBufNB(0x328, 0, 8, data));
+    frame.id = 0x328;
+    frame.flags = 0;
+    frame.len = 8;
+    memcpy(frame.data, data, 8);
+    MEASURE("sendFrameNB() 8 bytes", CAN.sendFrameNB(&frame));
+    MEASURE("checkTXComplete()", CAN.checkTXComplete());
+    MEASURE("isTXPending()", CAN.isTXPending());
+
+    model.setAutoTransmit(false);
+    CAN.sendMsgBufNB(0x328, 0, 8, data);
+    CAN.sendMsgBufNB(0x328, 0, 8, data);
+    CAN.sendMsgBufNB(0x328, 0, 8, data);
+    MEASURE("sendMsgBufNB() all busy", CAN.sendMsgBufNB(0x328, 0, 8, data));
+    while (model.transmitNext())
+        ;
+    CAN.checkTXComplete();
+    model.setAutoTransmit(true);
+
+    static CanTxQueue txQueue(&CAN);
+    model.setAutoTransmit(false);
+    model.transmitted.clear();
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        frame.data[0] = i;
+        MEASURE("CanTxQueue::push()", txQueue.push(frame));
+    }
+    frame.id = 0x348;
+    MEASURE("CanTxQueue::push() high", txQueue.push(frame, CanTxPriority::High));
+    MEASURE("CanTxQueue::update() all busy", txQueue.update());
+    while (model.transmitNext())
+    {
+        txQueue.update();
+    }
+    CAN.checkTXComplete();
+    model.setAutoTransmit(true);
+
+    MEASURE("checkError()", CAN.checkError());
+    MEASURE("errorCountTX()", CAN.errorCountTX());
+    MEASURE("clearRxOverflow()", CAN.clearRxOverflow());
+    MEASURE("getMode()", CAN.getMode());
+
+    static CanReceiver receiver(&CAN, CAN_INT_PIN);
+    receiver.init([]() { receiver.onInterrupt(); });
+    MEASURE("INT drain, 1 frame", model.receive(makeFrame(0x460, 8)));
+    receiver.read(&frame);
+    detachInterrupt(digitalPinToInterrupt(CAN_INT_PIN));
+
+    // Auto-baud on a 500 kbps bus, I-BUS tried first on an erased EEPROM
+    const MCP_BitTiming candidates[] = {I_BUS, P_BUS};
+    canAutoBaud::Result result;
+    host::useVirtualClock(true);
+    host::setClockListener(busTraffic);
+    model.setBusBitrate(MCP_OSC_HZ, 500000);
+    MEASURE("checkMessageError()", CAN.checkMessageError());
+    result = canAutoBaud::detect(&CAN, candidates, 2);
+    printf("auto-baud: locked in %u ms after %u tries, %u error frames\n", result.elapsedMs, result.tries,
+           model.errorFrames);
+    result = canAutoBaud::detect(&CAN, candidates, 2);
+    printf("auto-baud: cached rate locked in %u ms\n", result.elapsedMs);
+    host::setClockListener(nullptr);
+    result = canAutoBaud::detect(&CAN, candidates, 2);
+    printf("auto-baud: silent bus gave up after %u ms\n", result.elapsedMs);
+    model.setBusBitrate(0, 0);
+
+    // Sleep after the idle time, wake on traffic at I-BUS frame spacing
+    static PowerManager powerManager(&CAN, &receiver, CAN_INT_PIN, onPowerChange, onPowerChange);
+    CAN.begin(MCP_STDEXT, I_BUS);
+    CAN.setMode(MCP_NORMAL);
+    receiver.init([]() { receiver.onInterrupt(); });
+    host::setMicros(CAN_SLEEP_IDLE_MS * 1000UL);
+    busFrameInterval = 111 * 1000000UL / 47619;
+    busFrameAt = micros() + 500000; // Car unlocked half a second after we sleep
+    busFrames = 0;
+    host::setClockListener(busTraffic);
+    MEASURE("PowerManager sleep, wake", powerManager.update());
+    uint8_t received = 0;
+    while (busFrames < 6 && millis() < CAN_SLEEP_IDLE_MS + 1000)
+    {
+        delay(1);
+        while (receiver.read(&frame))
+        {
+            if (!received++)
+                powerManager.onFrame(frame);
+        }
+    }
+    printf("wake: restore %u us, first frame after %u us, %u of %u frames lost\n", powerManager.stats.restoreUs,
+           powerManager.stats.firstFrameUs, busFrames - received, busFrames);
+    host::setClockListener(nullptr);
+    host::useVirtualClock(false);
+
+    return 0;
+}
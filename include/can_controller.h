@@ -0,0 +1,13 @@
+#pragma once
+
+/*
+  CAN controller used by the sketch and the libraries. The MCP2515 on the
+  Nano, or SocketCAN when built for a Linux board with CAN_SOCKETCAN.
+*/
+#ifdef CAN_SOCKETCAN
+#include "SocketCan.h"
+typedef SocketCan CanController;
+#else
+#include "mcp_can.h"
+typedef MCP_CAN CanController;
+#endif
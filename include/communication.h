@@ -12,6 +12,15 @@ enum SID_MESSAGE
     LETTER4
 };
 
+// Row request on RADIO_PRIORITY or O_SID_PRIORITY, answered on TEXT_PRIORITY
+enum SID_REQUEST
+{
+    REQUEST_IDK,
+    REQUEST_ROW,
+    REQUEST_LEVEL,
+    REQUEST_ID
+};
+
 enum class CAN_ID : unsigned long
 {
     IBUS_BUTTONS = 0x290,
@@ -24,6 +33,25 @@ enum class CAN_ID : unsigned long
     SPEED_RPM = 0x460
 };
 
+// IDs dispatched by handleCanFrame(), everything else is rejected by the MCP2515 filters
+constexpr uint16_t HANDLED_CAN_IDS[] = {
+    static_cast<uint16_t>(CAN_ID::IBUS_BUTTONS),
+    static_cast<uint16_t>(CAN_ID::RADIO_MSG),
+    static_cast<uint16_t>(CAN_ID::TEXT_PRIORITY),
+    static_cast<uint16_t>(CAN_ID::LIGHTING),
+    static_cast<uint16_t>(CAN_ID::SPEED_RPM)
+};
+
+// P-BUS, its traffic keeps the node awake, nothing is decoded
+enum class PBUS_ID : unsigned long
+{
+    ENGINE = 0x1A0
+};
+
+constexpr uint16_t PBUS_HANDLED_CAN_IDS[] = {
+    static_cast<uint16_t>(PBUS_ID::ENGINE)
+};
+
 enum class STEERING_WHEEL : unsigned char
 {
     NXT = 2,
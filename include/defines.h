@@ -4,9 +4,30 @@
 
 /*** ENABLE FUNCTIONALITIES ***/
 #define DEBUG           0
+#define CAN_TIMING_STATS DEBUG // Per ID inter-arrival and latency, costs about 120 bytes of SRAM
+#define CAN_PBUS        0 // Second MCP2515 listening to the 500 kbps P-BUS
+#define CAN_SNIFFER     0 // Listen-only, stream every frame over Serial, see host/sniff_decode
+#define CAN_SLCAN       0 // SLCAN adapter for slcand and SavvyCAN on Serial, nothing else runs
+#define LOOP_PROFILER   0 // Time loop() stages with Timer1, send p over Serial for the histograms
+#ifdef CAN_SOCKETCAN
+#define CAN_RX_INTERRUPT 0 // Linux build, frames come from a SocketCAN interface
+#else
+#define CAN_RX_INTERRUPT 1 // Drain MCP2515 from its INT pin instead of polling
+#endif
+#if defined(CAN_SOCKETCAN) || CAN_PBUS || CAN_SLCAN
+#define CAN_AUTOBAUD    0 // Rate is set on the interface, fixed per controller or picked by the SLCAN host
+#else
+#define CAN_AUTOBAUD    1 // Find out at boot whether we are on the I-BUS or the P-BUS
+#endif
+#if defined(CAN_SOCKETCAN) || CAN_SNIFFER || CAN_SLCAN
+#define CAN_SLEEP       0 // Stays up, something is listening on the other end
+#else
+#define CAN_SLEEP       1 // Power down when the bus goes quiet, see PowerManager
+#endif
 
 /*** DATA PINS ***/
-#define BUTTON_PIN      2
+#define BUTTON_PIN      A0
+#define CAN_INT_PIN     2 // MCP2515 INT, must be an external interrupt pin
 #define LED_RING_PIN    3
 #define BT_PREVIOUS     4
 #define BT_NEXT         5
@@ -15,6 +36,8 @@
 #define BLUETOOTH_PIN0  8 // Turns on bluetooth module
 #define BLUETOOTH_PIN1  9 // Bluetooth shares power from 2 pins
 #define CAN_CS_PIN      10
+#define PBUS_CS_PIN     A1 // P-BUS MCP2515, shares SPI with the I-BUS one
+#define PBUS_INT_PIN    A2 // Polled, both external interrupt pins are taken
 
 /*** CAN addresses ***/
 // #define IBUS_BUTTONS    0x290
@@ -68,8 +91,10 @@
 #define SPD0            4
 
 /*** CAN speeds for Trionic 7 ***/
-#define I_BUS CAN_47KBPS
-#define P_BUS CAN_500KBPS
+#define MCP_OSC_HZ 8000000UL // MCP2515 crystal
+// 47.619 kbps, 21 TQ with sample point at 76.2% and SJW 3 like the old MCP_8MHz_47kBPS table
+#define I_BUS mcpBitTiming<MCP_OSC_HZ, 47619, 762, 3>()
+#define P_BUS mcpBitTiming<MCP_OSC_HZ, 500000>()
 
 /*
    Range for light level sensor depends on SID version.
@@ -82,6 +107,22 @@
 
 /*** SID message ***/
 #define SID_MAX_CHAR 12
+#define SID_MESSAGE_PARTS 3 // RADIO_MSG frames per message
+#define SID_PART_GAP_MS   10 // Between the frames of one message
+#define SID_QUEUE_SIZE    4  // User messages waiting for the display
+#define SID_MESSAGE_TIMEOUT_MS 1500 // Default, a message not shown by then is dropped
+#define SID_SCROLL_STEP_MS    500   // Per step of text longer than SID_MAX_CHAR
+#define SID_SCROLL_STEP_CHARS 2     // Characters moved per step, each step costs all three frames
+#define SID_SCROLL_PAUSE_MS   500   // Text stands still this long at both ends
+#define SID_SCROLL_LOOP       false // Scroll again from the start while the message is up
+
+/*** SID row arbitration ***/
+#define SID_ROW_REQUEST          0x05 // Request levels, REQUEST_LEVEL byte
+#define SID_ROW_RELEASE          0xFF
+#define SID_ROW_REQUEST_MS       100  // Request is repeated this often until granted
+#define SID_ROW_GRANT_TIMEOUT_MS 500  // Then messages wait for their own timeout
+#define SID_ROW_RETRY_MS         1000 // Asked for again this long after a timeout, or for the next new message
+#define SID_ROW_REFRESH_MS       1000 // A row we asked for is asked for again while in use
 
 /*** LED ***/
 #define NUM_LEDS_RING    12
@@ -90,6 +131,57 @@
 
 #define MESSAGE_MAX_LENGTH 32
 
+/*** CAN receive ***/
+#define CAN_RX_QUEUE_SIZE 16 // Must be a power of two
+#define CAN_RX_BUDGET_US  2000 // Max time spent handling frames per loop
+#define CAN_FILTER_MAX_FALSE_ACCEPTS 64 // Unhandled IDs allowed through the MCP2515 filters
+#define CAN_TIMING_REPORT_MS 5000 // How often DEBUG builds print CAN timing
+#define CAN_MAX_BUSES      2
+#define PBUS_RX_BUDGET_US  1000
+#define CAN_RX_MAX_WAIT_US 20000 // Bus is serviced first once its oldest frame is this old
+
+/*** CAN transmit ***/
+#define CAN_TX_QUEUE_SIZE  6   // Frames waiting for a free MCP2515 TX buffer
+#define CAN_TX_TIMEOUT_MS  100 // Default deadline, later frames are dropped instead of sent late
+
+/*** CAN auto-baud ***/
+#define CAN_AUTOBAUD_LISTEN_MS  100  // Per candidate, longer than the slowest periodic frame
+#define CAN_AUTOBAUD_TIMEOUT_MS 2000 // Then the rate found last time is used
+#define CAN_AUTOBAUD_MAX_ERRORS 2    // Reception errors that rule a candidate out
+
+/*** Power ***/
+#define CAN_SLEEP_IDLE_MS 30000 // Bus silence before powering down, the car has been locked for a while
+
+/*** EEPROM ***/
+#define EEPROM_CAN_BUS 0 // Auto-baud candidate that locked last
+
+/*** CAN health ***/
+#define CAN_HEALTH_INTERVAL_MS    250   // How often EFLG, TEC and REC are sampled
+#define CAN_REINIT_BACKOFF_MIN_MS 500   // Wait in bus-off before first restart
+#define CAN_REINIT_BACKOFF_MAX_MS 10000 // Restart backoff doubles up to this
+
+/*** CAN sniffer ***/
+#define CAN_SNIFFER_BAUD      115200
+#define CAN_SNIFFER_STATUS_MS 1000 // Time base and drop counters are resent this often
+
+/*** SLCAN gateway ***/
+#define SLCAN_BAUD            115200
+#define SLCAN_TX_BUFFER_SIZE  64 // Two of these, one fills while the other drains
+
+/*** Loop profiler ***/
+#define LOOP_PROFILER_SAMPLE_LOOPS 64  // Stage times are taken from one loop in this many, at most 255
+#define LOOP_PROFILER_COMMAND      'p' // Dumps and resets the histograms
+
+/*** SocketCAN, Linux builds with CAN_SOCKETCAN ***/
+#ifndef CAN_INTERFACE
+#define CAN_INTERFACE          "can0"
+#endif
+#ifndef CAN_PBUS_INTERFACE
+#define CAN_PBUS_INTERFACE     "can1"
+#endif
+#define CAN_SOCKET_BATCH       16 // Frames per recvmmsg and sendmmsg
+#define CAN_SOCKET_MAX_FILTERS 16
+
 #if DEBUG
 #define DEBUG_MESSAGE(msg) Serial.println(msg);
 #else
@@ -2,14 +2,27 @@
 
 #include <Arduino.h>
 #include "communication.h"
+#include "mcp_can.h"
 
+bool initCan();
+bool initPBus();
+void detectCanBus();
+void onSleep();
+void onWake();
 void readCanBus();
+void handleCanFrame(CanFrame &frame);
+void handlePBusFrame(CanFrame &frame);
+void sniffIBusFrame(CanFrame &frame);
+void sniffPBusFrame(CanFrame &frame);
+uint16_t getRxDrops();
 uint8_t scaleBrightness(uint16_t val, uint16_t minimum, uint16_t maximum);
 void readCanBus();
 void steeringWheelActions(STEERING_WHEEL action);
-void sidActions(SID_BUTTON action);
+void sidActions(SID_BUTTON action, uint32_t pressedAt);
 void lightActions(const uint8_t *data);
 void vehicleActions(const uint8_t *data);
 uint8_t getHighBit(const uint8_t value);
 uint16_t combineBytes(uint8_t byte1, uint8_t byte2);
-uint32_t elapsed(uint32_t time);
\ No newline at end of file
+void reportCanTiming();
+void reportLoopProfile();
+void printHistogram(const char *name, const uint16_t *counts);
\ No newline at end of file
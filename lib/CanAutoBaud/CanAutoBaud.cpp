@@ -0,0 +1,83 @@
+#include "CanAutoBaud.h"
+#include <EEPROM.h>
+
+namespace canAutoBaud
+{
+    enum class Heard : uint8_t
+    {
+        Frame,
+        Errors,
+        Nothing,
+        NoController
+    };
+
+    static Heard listen(CanController *CAN, const MCP_BitTiming &timing, uint32_t startedAt)
+    {
+        if (CAN->begin(MCP_STDEXT, timing) != CAN_OK || CAN->setMode(MCP_LISTENONLY) != MCP2515_OK)
+        {
+            return Heard::NoController;
+        }
+
+        uint32_t listenAt = millis();
+        uint8_t errors = 0;
+        while (millis() - listenAt < CAN_AUTOBAUD_LISTEN_MS && millis() - startedAt < CAN_AUTOBAUD_TIMEOUT_MS)
+        {
+            if (CAN->checkReceive() == CAN_MSGAVAIL)
+            {
+                return Heard::Frame;
+            }
+            // Listen-only never sends error frames, but MERRF and REC still count what it saw
+            if (CAN->checkMessageError() != CAN_OK || (CAN->getError() & (MCP_EFLG_RXWAR | MCP_EFLG_RXEP)))
+            {
+                if (++errors >= CAN_AUTOBAUD_MAX_ERRORS)
+                {
+                    return Heard::Errors;
+                }
+            }
+            delay(1);
+        }
+        return Heard::Nothing;
+    }
+    /*
+      Leaves the controller in listen-only mode at the returned candidate if
+      it locked. Start it again with that timing, begin() resets everything.
+    */
+    Result detect(CanController *CAN, const MCP_BitTiming *candidates, uint8_t count)
+    {
+        Result result = {loadIndex(count), false, 0, 0};
+        uint32_t startedAt = millis();
+
+        for (uint8_t i = result.index; millis() - startedAt < CAN_AUTOBAUD_TIMEOUT_MS; i = (i + 1) % count)
+        {
+            result.tries++;
+            Heard heard = listen(CAN, candidates[i], startedAt);
+            if (heard == Heard::NoController)
+            {
+                break;
+            }
+            if (heard == Heard::Frame)
+            {
+                result.index = i;
+                result.isLocked = true;
+                storeIndex(i);
+                break;
+            }
+        }
+
+        result.elapsedMs = millis() - startedAt;
+        return result;
+    }
+
+    uint8_t loadIndex(uint8_t count)
+    {
+        uint8_t index = EEPROM.read(EEPROM_CAN_BUS);
+        return index < count ? index : 0;
+    }
+    /*
+      Only written when it changes, EEPROM cells last about 100 000 writes.
+    */
+    void storeIndex(uint8_t index)
+    {
+        EEPROM.update(EEPROM_CAN_BUS, index);
+    }
+}
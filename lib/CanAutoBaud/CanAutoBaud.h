@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../../include/can_controller.h"
+#include "../../include/defines.h"
+
+/*
+  Finds the bitrate of the bus without disturbing it.
+
+  Each candidate is started in listen-only mode with the masks open. One
+  valid frame locks it, a frame at the wrong rate never passes the CRC.
+  CAN_AUTOBAUD_MAX_ERRORS reception errors (MERRF, or the EFLG receive
+  warning) move on to the next candidate early, silence after
+  CAN_AUTOBAUD_LISTEN_MS. Candidates are cycled for at most
+  CAN_AUTOBAUD_TIMEOUT_MS.
+
+  The index that locked is kept in EEPROM and tried first on the next boot,
+  so a board that stays on one bus locks on its first frame.
+*/
+namespace canAutoBaud
+{
+    struct Result
+    {
+        uint8_t index; // Into candidates, the cached one if nothing locked
+        bool isLocked;
+        uint8_t tries; // Candidates listened to
+        uint16_t elapsedMs;
+    };
+
+    Result detect(CanController *CAN, const MCP_BitTiming *candidates, uint8_t count);
+    uint8_t loadIndex(uint8_t count);
+    void storeIndex(uint8_t index);
+}
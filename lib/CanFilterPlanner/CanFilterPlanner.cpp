@@ -0,0 +1,34 @@
+#include "CanFilterPlanner.h"
+
+namespace canFilter
+{
+    /*
+      Write masks and filters of the plan. Call between CAN.begin() and
+      CAN.setMode(), the controller has to be started with MCP_STDEXT for the
+      filters to be used.
+      Standard IDs go in the upper 16 bits, see MCP_CAN::mcp2515_write_mf.
+    */
+    uint8_t apply(CanController *CAN, const CanFilterPlan &plan)
+    {
+        uint8_t res = CAN_OK;
+        uint8_t filterNum = 0;
+
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            const CanFilterGroup &group = plan.rxb[i];
+            // Group without IDs reuses the other group's filter so it accepts nothing new
+            const CanFilterGroup &source = group.filterCount ? group : plan.rxb[i ^ 1];
+            uint8_t slots = i == 0 ? RXB0_FILTERS : RXB1_FILTERS;
+
+            res |= CAN->init_Mask(i, 0, (uint32_t)source.mask << 16);
+            for (uint8_t j = 0; j < slots; j++)
+            {
+                // Unused slots repeat a filter of the same group
+                uint16_t filter = source.filters[j < source.filterCount ? j : 0];
+                res |= CAN->init_Filt(filterNum++, 0, (uint32_t)filter << 16);
+            }
+        }
+
+        return res;
+    }
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../../include/can_controller.h"
+
+/*
+  Plans the MCP2515 acceptance masks and filters for a set of standard IDs.
+
+  RXB0 has mask 0 with filters 0-1 and RXB1 has mask 1 with filters 2-5.
+  A group with mask M and filters F accepts every ID where (id & M) equals
+  (f & M) for some f, so each cleared mask bit doubles what gets through.
+  The plan splits the IDs between the two buffers and clears as few mask
+  bits as possible so that every ID still hits a filter.
+
+  Everything is constexpr, a plan for a constant ID list costs nothing at
+  runtime. Search time grows with 2^n, keep n at CAN_FILTER_MAX_IDS or below.
+*/
+
+#define CAN_FILTER_MAX_IDS 12
+#define CAN_STD_ID_BITS    11
+#define CAN_STD_ID_MASK    0x7FF
+
+struct CanFilterGroup
+{
+    uint16_t mask;
+    uint16_t filters[4];
+    uint8_t filterCount;
+    uint16_t accepted; // IDs accepted by this group alone
+};
+
+struct CanFilterPlan
+{
+    CanFilterGroup rxb[2];
+    uint8_t handled;
+    uint16_t falseAccepts; // Accepted IDs that are not handled
+
+    // Per mille of unhandled standard IDs that still reach the host
+    constexpr uint16_t falseAcceptPermille() const
+    {
+        return (uint32_t)falseAccepts * 1000 / ((1 << CAN_STD_ID_BITS) - handled);
+    }
+};
+
+namespace canFilter
+{
+    constexpr uint8_t RXB0_FILTERS = 2;
+    constexpr uint8_t RXB1_FILTERS = 4;
+
+    constexpr uint8_t popCount(uint16_t value)
+    {
+        uint8_t count = 0;
+        for (; value; value &= value - 1)
+        {
+            count++;
+        }
+        return count;
+    }
+    /*
+      Count distinct masked values of the IDs selected by members.
+    */
+    constexpr uint8_t distinct(const uint16_t *ids, uint8_t n, uint32_t members, uint16_t mask)
+    {
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < n; i++)
+        {
+            if (!(members >> i & 1))
+                continue;
+
+            bool isNew = true;
+            for (uint8_t j = 0; j < i && isNew; j++)
+            {
+                if ((members >> j & 1) && (ids[j] & mask) == (ids[i] & mask))
+                    isNew = false;
+            }
+            count += isNew;
+        }
+        return count;
+    }
+    /*
+      Start from an exact mask and clear the bit that merges the most IDs
+      until the group fits into its filters.
+    */
+    constexpr CanFilterGroup planGroup(const uint16_t *ids, uint8_t n, uint32_t members, uint8_t capacity)
+    {
+        CanFilterGroup group{CAN_STD_ID_MASK, {0, 0, 0, 0}, 0, 0};
+
+        if (!members)
+            return group;
+
+        while (distinct(ids, n, members, group.mask) > capacity)
+        {
+            uint16_t bestMask = 0;
+            uint8_t bestCount = 0xFF;
+            for (uint8_t bit = 0; bit < CAN_STD_ID_BITS; bit++)
+            {
+                uint16_t mask = group.mask & ~(1 << bit);
+                if (mask == group.mask)
+                    continue;
+
+                uint8_t count = distinct(ids, n, members, mask);
+                if (count < bestCount)
+                {
+                    bestCount = count;
+                    bestMask = mask;
+                }
+            }
+            group.mask = bestMask;
+        }
+
+        for (uint8_t i = 0; i < n; i++)
+        {
+            if (!(members >> i & 1))
+                continue;
+
+            uint16_t value = ids[i] & group.mask;
+            bool isNew = true;
+            for (uint8_t j = 0; j < group.filterCount; j++)
+            {
+                if (group.filters[j] == value)
+                    isNew = false;
+            }
+            if (isNew)
+                group.filters[group.filterCount++] = value;
+        }
+
+        group.accepted = (uint16_t)group.filterCount << (CAN_STD_ID_BITS - popCount(group.mask));
+        return group;
+    }
+
+    constexpr bool accepts(const CanFilterGroup &group, uint16_t id)
+    {
+        for (uint8_t i = 0; i < group.filterCount; i++)
+        {
+            if ((id & group.mask) == group.filters[i])
+                return true;
+        }
+        return false;
+    }
+    /*
+      Try every split of the IDs between RXB0 and RXB1 and keep the one that
+      accepts the least. Up to six IDs always get exact filters.
+    */
+    template <uint8_t N>
+    constexpr CanFilterPlan plan(const uint16_t (&ids)[N])
+    {
+        static_assert(N > 0, "Nothing to filter");
+        static_assert(N <= CAN_FILTER_MAX_IDS, "Too many IDs for the filter planner");
+
+        const uint32_t all = (1UL << N) - 1;
+        CanFilterPlan best{};
+        uint32_t bestAccepted = 0xFFFFFFFF;
+
+        for (uint32_t members = 1; members <= all; members++)
+        {
+            // Exact split exists, no need to search further
+            if (N <= RXB0_FILTERS + RXB1_FILTERS && members != (all & 0x3))
+                continue;
+
+            CanFilterGroup rxb0 = planGroup(ids, N, members, RXB0_FILTERS);
+            CanFilterGroup rxb1 = planGroup(ids, N, all & ~members, RXB1_FILTERS);
+            uint32_t accepted = (uint32_t)rxb0.accepted + rxb1.accepted;
+            if (accepted < bestAccepted)
+            {
+                bestAccepted = accepted;
+                best.rxb[0] = rxb0;
+                best.rxb[1] = rxb1;
+            }
+        }
+
+        // Groups may overlap, count the union
+        uint16_t accepted = 0;
+        for (uint16_t id = 0; id <= CAN_STD_ID_MASK; id++)
+        {
+            accepted += accepts(best.rxb[0], id) || accepts(best.rxb[1], id);
+        }
+
+        best.handled = N;
+        best.falseAccepts = accepted - N;
+        return best;
+    }
+
+    uint8_t apply(CanController *CAN, const CanFilterPlan &plan);
+}
@@ -0,0 +1,150 @@
+#include "CanHealthMonitor.h"
+#include "../util/util.h"
+
+/*
+  reinit should bring the controller back to the state setup() left it in:
+  begin, filters and mode. Returns false on failure.
+*/
+CanHealthMonitor::CanHealthMonitor(CanController *CAN, bool (*reinit)())
+{
+    this->CAN = CAN;
+    _reinit = reinit;
+    _state = State::Active;
+    _tec = 0;
+    _rec = 0;
+    _lastSampleAt = 0;
+    _recoveryAt = 0;
+    _backoff = CAN_REINIT_BACKOFF_MIN_MS;
+    memset(&counters, 0, sizeof(counters));
+}
+
+void CanHealthMonitor::update()
+{
+    uint32_t now = millis();
+    if (now - _lastSampleAt < CAN_HEALTH_INTERVAL_MS)
+    {
+        return;
+    }
+    _lastSampleAt = now;
+
+    // Brownout during crank resets the MCP2515 into configuration mode
+    if (CAN->getMode() == MODE_CONFIG)
+    {
+        if (_state != State::BusOff)
+        {
+            counters.resets++;
+            DEBUG_MESSAGE("CAN RESET");
+            setState(State::BusOff);
+            reinitController(now);
+        }
+        else if (now - _recoveryAt >= _backoff)
+        {
+            reinitController(now);
+        }
+        return;
+    }
+
+    uint8_t eflg = CAN->getError();
+    _tec = CAN->errorCountTX();
+    _rec = CAN->errorCountRX();
+
+    if (eflg & (MCP_EFLG_RX0OVR | MCP_EFLG_RX1OVR))
+    {
+        counters.rxOverflows++;
+        CAN->clearRxOverflow();
+    }
+
+    if (eflg & MCP_EFLG_TXBO)
+    {
+        if (_state != State::BusOff)
+        {
+            _recoveryAt = now;
+            setState(State::BusOff);
+        }
+        // Controller recovers by itself after 128 x 11 recessive bits, if it has not by now restart it
+        else if (now - _recoveryAt >= _backoff)
+        {
+            reinitController(now);
+        }
+        return;
+    }
+
+    if (eflg & (MCP_EFLG_TXEP | MCP_EFLG_RXEP))
+    {
+        setState(State::Passive);
+    }
+    else if (eflg & MCP_EFLG_EWARN)
+    {
+        setState(State::Warning);
+    }
+    else
+    {
+        setState(State::Active);
+        _backoff = CAN_REINIT_BACKOFF_MIN_MS;
+    }
+}
+/*
+  While error-passive our frames mostly add to the problem, hold them back.
+*/
+bool CanHealthMonitor::isTxAllowed() const
+{
+    return _state == State::Active || _state == State::Warning;
+}
+
+CanHealthMonitor::State CanHealthMonitor::getState() const
+{
+    return _state;
+}
+
+uint8_t CanHealthMonitor::getTEC() const
+{
+    return _tec;
+}
+
+uint8_t CanHealthMonitor::getREC() const
+{
+    return _rec;
+}
+
+void CanHealthMonitor::setState(State state)
+{
+    if (state == _state)
+    {
+        return;
+    }
+
+    switch (state)
+    {
+    case State::Active:
+        counters.toActive++;
+        DEBUG_MESSAGE("CAN ACTIVE");
+        break;
+    case State::Warning:
+        counters.toWarning++;
+        DEBUG_MESSAGE("CAN WARNING");
+        break;
+    case State::Passive:
+        counters.toPassive++;
+        DEBUG_MESSAGE("CAN PASSIVE");
+        break;
+    case State::BusOff:
+        counters.toBusOff++;
+        DEBUG_MESSAGE("CAN BUS OFF");
+        break;
+    }
+    _state = state;
+}
+/*
+  Restart the controller, doubling the wait before the next attempt.
+*/
+void CanHealthMonitor::reinitController(uint32_t now)
+{
+    counters.reinits++;
+    if (!_reinit())
+    {
+        counters.failedReinits++;
+    }
+
+    _recoveryAt = now;
+    _backoff = util::minVal<uint32_t>((uint32_t)_backoff * 2, CAN_REINIT_BACKOFF_MAX_MS);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../../include/can_controller.h"
+#include "../../include/defines.h"
+
+/*
+  Samples EFLG, TEC and REC of the MCP2515 at a low rate and recovers the
+  controller after bus-off or a brownout reset.
+*/
+class CanHealthMonitor
+{
+public:
+    enum class State : uint8_t
+    {
+        Active,
+        Warning,
+        Passive,
+        BusOff
+    };
+
+    struct
+    {
+        uint16_t toWarning;
+        uint16_t toPassive;
+        uint16_t toBusOff;
+        uint16_t toActive;
+        uint16_t rxOverflows;
+        uint16_t resets; // Controller found in configuration mode
+        uint16_t reinits;
+        uint16_t failedReinits;
+    } counters;
+
+    CanHealthMonitor(CanController *CAN, bool (*reinit)());
+    void update();
+    bool isTxAllowed() const;
+    State getState() const;
+    uint8_t getTEC() const;
+    uint8_t getREC() const;
+
+private:
+    void setState(State state);
+    void reinitController(uint32_t now);
+
+    State _state; // Controller found reset is handled as bus-off
+    uint8_t _tec;
+    uint8_t _rec;
+    uint32_t _lastSampleAt;
+    uint32_t _recoveryAt;
+    uint16_t _backoff;
+    bool (*_reinit)();
+    CanController *CAN;
+};
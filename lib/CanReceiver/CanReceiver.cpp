@@ -0,0 +1,261 @@
+#include "CanReceiver.h"
+
+CanReceiver::CanReceiver(CanController *CAN, uint8_t intPin)
+{
+    this->CAN = CAN;
+    _intPin = intPin;
+    _head = 0;
+    _tail = 0;
+    _isInterruptDriven = false;
+    _isIntPolled = false;
+    _isr = nullptr;
+    memset(&drainStats, 0, sizeof(drainStats));
+    resetStats();
+}
+/*
+  Call after CAN.begin(). The isr should only forward to onInterrupt().
+*/
+void CanReceiver::init(void (*isr)())
+{
+    pinMode(_intPin, INPUT);
+    // Main loop SPI transactions mask the INT pin so the ISR never interrupts one
+    SPI.usingInterrupt(digitalPinToInterrupt(_intPin));
+    attachInterrupt(digitalPinToInterrupt(_intPin), isr, FALLING);
+    _isr = isr;
+    _isInterruptDriven = true;
+}
+/*
+  For a controller whose INT is not on an external interrupt pin. Frames
+  are still read from loop(), but an idle controller costs a pin read
+  instead of an SPI transaction.
+*/
+void CanReceiver::initPolled()
+{
+    pinMode(_intPin, INPUT);
+    _isIntPolled = true;
+}
+
+/*
+  Stop taking the INT pin, for example while it signals something else.
+*/
+void CanReceiver::suspend()
+{
+    if (_isInterruptDriven)
+    {
+        detachInterrupt(digitalPinToInterrupt(_intPin));
+    }
+}
+/*
+  Attach the ISR again. Frames that came in meanwhile hold INT low without
+  a new falling edge, so they are drained here.
+*/
+void CanReceiver::resume()
+{
+    if (!_isInterruptDriven)
+    {
+        return;
+    }
+    attachInterrupt(digitalPinToInterrupt(_intPin), _isr, FALLING);
+
+    noInterrupts();
+    if (digitalRead(_intPin) == LOW)
+    {
+        drain(micros());
+    }
+    interrupts();
+}
+
+void CanReceiver::onInterrupt()
+{
+    // Taken first so the frame that asserted INT is stamped with the edge, not the SPI read
+    drain(micros());
+}
+/*
+  Read both RX buffers until the controller reports no more frames, so that
+  INT is released and the next frame produces a new falling edge.
+  The first frame gets assertedAt, later ones the time they were read.
+*/
+void CanReceiver::drain(uint32_t assertedAt)
+{
+    uint8_t head = _head;
+    bool isFirst = true;
+
+    while (true)
+    {
+        uint8_t next = (head + 1) & (CAN_RX_QUEUE_SIZE - 1);
+        CanFrame *frame = &_frames[head];
+        CanFrame discard;
+
+        // Frame still has to be read out of the controller to release INT
+        if (next == _tail)
+        {
+            frame = &discard;
+        }
+
+        // Driver clocks the frame straight into the ring slot
+        if (CAN->readFrame(frame) != CAN_OK)
+        {
+            break;
+        }
+        if (isFirst)
+        {
+            frame->timestamp = assertedAt;
+            isFirst = false;
+        }
+        _stats.received++;
+
+        if (frame == &discard)
+        {
+            _stats.dropped++;
+            continue;
+        }
+
+        head = next;
+        _head = head;
+
+        uint8_t depth = (head - _tail) & (CAN_RX_QUEUE_SIZE - 1);
+        if (depth > _stats.maxDepth)
+        {
+            _stats.maxDepth = depth;
+        }
+    }
+}
+/*
+  Oldest frame, left in its ring slot. Without init() the frame is read from
+  the controller into scratch. Returns nullptr when nothing was received.
+*/
+CanFrame *CanReceiver::front(CanFrame *scratch)
+{
+    if (!_isInterruptDriven)
+    {
+        if (_isIntPolled && digitalRead(_intPin) == HIGH)
+        {
+            return nullptr;
+        }
+        return CAN->readFrame(scratch) == CAN_OK ? scratch : nullptr;
+    }
+
+    if (_tail == _head)
+    {
+        // Edge lost while the interrupt was not yet attached, INT is stuck low
+        if (digitalRead(_intPin) == LOW)
+        {
+            noInterrupts();
+            drain(micros());
+            interrupts();
+        }
+        if (_tail == _head)
+        {
+            return nullptr;
+        }
+    }
+    // The ISR never writes the slot at _tail while the queue is not empty
+    return &_frames[_tail];
+}
+/*
+  Release the slot returned by front().
+*/
+void CanReceiver::pop()
+{
+    if (_isInterruptDriven)
+    {
+        _tail = (_tail + 1) & (CAN_RX_QUEUE_SIZE - 1);
+    }
+}
+/*
+  Pop the oldest frame. Returns false when the queue is empty.
+*/
+bool CanReceiver::read(CanFrame *frame)
+{
+    CanFrame *oldest = front(frame);
+
+    if (oldest == nullptr)
+    {
+        return false;
+    }
+    if (oldest != frame)
+    {
+        memcpy(frame, oldest, sizeof(CanFrame));
+    }
+    pop();
+    return true;
+}
+
+/*
+  Hand frames to the handler until none are left or budgetUs has passed.
+  Queued frames are passed by reference from their ring slot, which is only
+  released after the handler returns.
+  At least one frame is handled per call so a small budget can not starve RX.
+*/
+uint8_t CanReceiver::poll(void (*handler)(CanFrame &frame), uint16_t budgetUs)
+{
+    CanFrame scratch;
+    CanFrame *frame;
+    uint32_t start = micros();
+    uint8_t drained = 0;
+
+    while ((frame = front(&scratch)) != nullptr)
+    {
+        uint32_t latency = micros() - frame->timestamp;
+        if (latency > drainStats.maxLatencyUs)
+        {
+            drainStats.maxLatencyUs = latency;
+        }
+
+        handler(*frame);
+        pop();
+        drained++;
+
+        if (micros() - start >= budgetUs)
+        {
+            drainStats.budgetExhausted++;
+            break;
+        }
+    }
+
+    drainStats.lastDrained = drained;
+    if (drained > drainStats.maxDrained)
+    {
+        drainStats.maxDrained = drained;
+    }
+    return drained;
+}
+
+uint8_t CanReceiver::available() const
+{
+    return (_head - _tail) & (CAN_RX_QUEUE_SIZE - 1);
+}
+/*
+  Arrival time of the oldest queued frame. Only known after init(), frames
+  still in the controller have not been stamped yet.
+*/
+bool CanReceiver::getOldestTimestamp(uint32_t *timestamp) const
+{
+    uint8_t tail = _tail;
+    if (!_isInterruptDriven || tail == _head)
+    {
+        return false;
+    }
+    *timestamp = _frames[tail].timestamp;
+    return true;
+}
+/*
+  Counters are updated from the ISR, copy them with interrupts off.
+*/
+void CanReceiver::getStats(Stats *stats)
+{
+    noInterrupts();
+    stats->received = _stats.received;
+    stats->dropped = _stats.dropped;
+    stats->maxDepth = _stats.maxDepth;
+    interrupts();
+}
+
+void CanReceiver::resetStats()
+{
+    noInterrupts();
+    _stats.received = 0;
+    _stats.dropped = 0;
+    _stats.maxDepth = 0;
+    interrupts();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../../include/can_controller.h"
+#include "../../include/defines.h"
+
+static_assert((CAN_RX_QUEUE_SIZE & (CAN_RX_QUEUE_SIZE - 1)) == 0, "CAN_RX_QUEUE_SIZE must be a power of two");
+
+/*
+  Receives frames from the MCP2515.
+
+  After init() the INT pin interrupt drains the receive buffers into a
+  single-producer/single-consumer ring. The ISR is the only writer of _head,
+  loop() is the only writer of _tail. Without init() frames are read
+  straight from the controller, after initPolled() only while INT is low.
+
+  CanFrame::timestamp is micros() when INT was asserted, or when the frame
+  was read if it came in while draining or without init().
+*/
+class CanReceiver
+{
+public:
+    struct Stats
+    {
+        uint32_t received;
+        uint32_t dropped;
+        uint8_t maxDepth;
+    };
+
+    struct DrainStats
+    {
+        uint8_t lastDrained;
+        uint8_t maxDrained;
+        uint32_t budgetExhausted;
+        uint32_t maxLatencyUs; // From frame timestamp to handler
+    };
+
+    CanReceiver(CanController *CAN, uint8_t intPin);
+    void init(void (*isr)());
+    void initPolled();
+    void onInterrupt();
+    void suspend();
+    void resume();
+    bool read(CanFrame *frame);
+    uint8_t poll(void (*handler)(CanFrame &frame), uint16_t budgetUs);
+    uint8_t available() const;
+    bool getOldestTimestamp(uint32_t *timestamp) const;
+    void getStats(Stats *stats);
+    void resetStats();
+
+    DrainStats drainStats;
+
+private:
+    void drain(uint32_t assertedAt);
+    CanFrame *front(CanFrame *scratch);
+    void pop();
+
+    CanFrame _frames[CAN_RX_QUEUE_SIZE];
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+    volatile Stats _stats;
+    bool _isInterruptDriven;
+    bool _isIntPolled;
+    void (*_isr)();
+    uint8_t _intPin;
+    CanController *CAN;
+};
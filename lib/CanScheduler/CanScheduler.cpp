@@ -0,0 +1,57 @@
+#include "CanScheduler.h"
+
+CanScheduler::CanScheduler()
+{
+    _count = 0;
+}
+/*
+  Add buses highest priority first. Returns false when CAN_MAX_BUSES are in use.
+*/
+bool CanScheduler::add(CanReceiver *receiver, void (*handler)(CanFrame &frame), uint16_t budgetUs, uint16_t maxWaitUs)
+{
+    if (_count == CAN_MAX_BUSES)
+    {
+        return false;
+    }
+
+    Bus *bus = &_buses[_count++];
+    bus->receiver = receiver;
+    bus->handler = handler;
+    bus->budgetUs = budgetUs;
+    bus->maxWaitUs = maxWaitUs;
+    bus->overdue = 0;
+    return true;
+}
+/*
+  Call once per loop().
+*/
+void CanScheduler::service()
+{
+    uint8_t serviced = 0; // Bit per bus
+    uint32_t now = micros();
+
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        Bus *bus = &_buses[i];
+        uint32_t oldest;
+        if (bus->receiver->getOldestTimestamp(&oldest) && now - oldest > bus->maxWaitUs)
+        {
+            bus->receiver->poll(bus->handler, bus->budgetUs);
+            bus->overdue++;
+            serviced |= 1 << i;
+        }
+    }
+
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (!(serviced & (1 << i)))
+        {
+            _buses[i].receiver->poll(_buses[i].handler, _buses[i].budgetUs);
+        }
+    }
+}
+
+const CanScheduler::Bus *CanScheduler::getBus(uint8_t index) const
+{
+    return index < _count ? &_buses[index] : nullptr;
+}
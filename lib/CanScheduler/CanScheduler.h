@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../CanReceiver/CanReceiver.h"
+#include "../../include/defines.h"
+
+/*
+  Shares the receive time of loop() between controllers on the same SPI bus.
+
+  Buses are serviced in the order they were added, each for at most its
+  budget. A bus whose oldest queued frame has waited longer than its
+  maxWaitUs is serviced before all others, so a busy bus added first can
+  not push the latency of the rest past that bound. Only receivers with an
+  interrupt driven queue know how old a frame is, give polled ones 0.
+
+  SPI is shared per transaction: every driver call is one SPI transaction
+  and receivers that drain from an interrupt register it with
+  SPI.usingInterrupt(), which masks only that interrupt while a transaction
+  to either controller is in progress.
+*/
+class CanScheduler
+{
+public:
+    struct Bus
+    {
+        CanReceiver *receiver;
+        void (*handler)(CanFrame &frame);
+        uint16_t budgetUs;
+        uint16_t maxWaitUs;
+        uint16_t overdue; // Times the bus was serviced first because of maxWaitUs
+    };
+
+    CanScheduler();
+    bool add(CanReceiver *receiver, void (*handler)(CanFrame &frame), uint16_t budgetUs, uint16_t maxWaitUs);
+    void service();
+    const Bus *getBus(uint8_t index) const;
+
+private:
+    Bus _buses[CAN_MAX_BUSES];
+    uint8_t _count;
+};
@@ -0,0 +1,151 @@
+#include "CanSniffer.h"
+
+CanSniffer::CanSniffer(HardwareSerial *serial)
+{
+    _serial = serial;
+    _seq = 0;
+    _lastTimestamp = 0;
+    _statusAt = 0;
+    _serialDrops = 0;
+    _rxDrops = 0;
+    _isStatusDue = true;
+}
+/*
+  Call after Serial.begin(). Sends the first status record, which the
+  decoder needs as the time base.
+*/
+void CanSniffer::begin()
+{
+    _isStatusDue = true;
+    sendStatus();
+}
+
+void CanSniffer::write(const CanFrame &frame, uint8_t bus)
+{
+    // No time base yet, the decoder could not place the frame
+    if (_isStatusDue && !sendStatus())
+    {
+        _seq++;
+        _serialDrops++;
+        return;
+    }
+
+    uint8_t record[SNIFFER_MAX_RECORD];
+    uint8_t i = 0;
+    uint8_t len = frame.len > 8 ? 8 : frame.len;
+
+    record[i++] = _seq++;
+    record[i++] = len | (frame.flags & CAN_FRAME_EXT ? SNIFFER_HEADER_EXT : 0) |
+                  (frame.flags & CAN_FRAME_RTR ? SNIFFER_HEADER_RTR : 0) | (bus ? SNIFFER_HEADER_BUS : 0);
+
+    // Buses are serviced one after the other, so the delta can be negative
+    uint32_t delta = sniffer::zigzag((int32_t)(frame.timestamp - _lastTimestamp));
+    do
+    {
+        record[i] = delta & 0x7F;
+        delta >>= 7;
+        if (delta)
+        {
+            record[i] |= 0x80;
+        }
+        i++;
+    } while (delta);
+
+    record[i++] = frame.id;
+    record[i++] = frame.id >> 8;
+    if (frame.flags & CAN_FRAME_EXT)
+    {
+        record[i++] = frame.id >> 16;
+        record[i++] = frame.id >> 24;
+    }
+
+    if (!(frame.flags & CAN_FRAME_RTR))
+    {
+        memcpy(record + i, frame.data, len);
+        i += len;
+    }
+
+    if (send(record, i))
+    {
+        _lastTimestamp = frame.timestamp;
+    }
+    else
+    {
+        _serialDrops++;
+    }
+}
+/*
+  Call from loop(). rxDrops is the running count of frames lost before
+  they could be read, it goes out with the next status record.
+*/
+void CanSniffer::update(uint16_t rxDrops)
+{
+    if (rxDrops != _rxDrops || millis() - _statusAt >= CAN_SNIFFER_STATUS_MS)
+    {
+        _rxDrops = rxDrops;
+        _isStatusDue = true;
+    }
+    if (_isStatusDue)
+    {
+        sendStatus();
+    }
+}
+
+uint16_t CanSniffer::getSerialDrops() const
+{
+    return _serialDrops;
+}
+
+bool CanSniffer::sendStatus()
+{
+    uint32_t now = micros();
+    uint8_t record[] = {
+        _seq,
+        SNIFFER_RECORD_STATUS,
+        (uint8_t)now, (uint8_t)(now >> 8), (uint8_t)(now >> 16), (uint8_t)(now >> 24),
+        (uint8_t)_serialDrops, (uint8_t)(_serialDrops >> 8),
+        (uint8_t)_rxDrops, (uint8_t)(_rxDrops >> 8)};
+
+    if (!send(record, sizeof(record)))
+    {
+        return false;
+    }
+    _lastTimestamp = now;
+    _statusAt = millis();
+    _isStatusDue = false;
+    return true;
+}
+/*
+  COBS encode the record and queue it only if the whole of it fits.
+*/
+bool CanSniffer::send(const uint8_t *record, uint8_t length)
+{
+    uint8_t encoded[SNIFFER_MAX_ENCODED];
+    uint8_t codeAt = 0;
+    uint8_t code = 1;
+    uint8_t out = 1;
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+        if (record[i] == 0)
+        {
+            encoded[codeAt] = code;
+            codeAt = out++;
+            code = 1;
+        }
+        else
+        {
+            encoded[out++] = record[i];
+            code++;
+        }
+    }
+    encoded[codeAt] = code;
+    encoded[out++] = 0;
+
+    if (_serial->availableForWrite() < out)
+    {
+        return false;
+    }
+    _serial->write(encoded, out);
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+  Binary stream written by CanSniffer and read by host/sniff_decode.
+
+  Every record is COBS encoded and followed by a 0x00 byte, so a reader can
+  resync at the next zero after any corruption. Decoded records:
+
+  Frame   seq, header, delta, id, data
+          seq     counts every frame, also those dropped before the serial port
+          header  bits 0-3 data length, SNIFFER_HEADER_EXT, SNIFFER_HEADER_RTR,
+                  SNIFFER_HEADER_BUS set for the P-BUS
+          delta   zigzag varint, micros from the previous record, 7 bits per byte
+                  least significant first
+          id      little-endian, 2 bytes or 4 for extended IDs
+          data    length bytes, none for remote frames
+
+  Status  seq, SNIFFER_RECORD_STATUS, timestamp, serialDrops, rxDrops
+          seq         of the next frame
+          timestamp   uint32 micros, base for the deltas that follow
+          serialDrops uint16, frames the serial port had no room for
+          rxDrops     uint16, frames lost before they were read
+
+  Frames the sniffer drops do not move the time base. A record lost on the
+  wire does, so times after it are off until the next status record.
+*/
+
+#define SNIFFER_RECORD_STATUS   0x80
+#define SNIFFER_HEADER_LEN_MASK 0x0F
+#define SNIFFER_HEADER_EXT      0x10
+#define SNIFFER_HEADER_RTR      0x20
+#define SNIFFER_HEADER_BUS      0x40
+
+#define SNIFFER_MAX_RECORD  19 // seq, header, 5 byte delta, 4 byte id and 8 data bytes
+#define SNIFFER_MAX_ENCODED (SNIFFER_MAX_RECORD + 2) // COBS code byte and delimiter
+
+namespace sniffer
+{
+    inline uint32_t zigzag(int32_t value)
+    {
+        return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    }
+
+    inline int32_t unzigzag(uint32_t value)
+    {
+        return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+}
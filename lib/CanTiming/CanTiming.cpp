@@ -0,0 +1,92 @@
+#include "CanTiming.h"
+
+CanTiming::CanTiming()
+{
+    reset();
+}
+/*
+  Call for every received frame, in arrival order.
+*/
+void CanTiming::onArrival(const CanFrame &frame)
+{
+    IdStats *stats = find(frame);
+    if (!stats)
+    {
+        return;
+    }
+
+    if (stats->count > 0)
+    {
+        uint32_t interval = frame.timestamp - stats->lastAt;
+        if (interval < stats->minIntervalUs)
+        {
+            stats->minIntervalUs = interval;
+        }
+        if (interval > stats->maxIntervalUs)
+        {
+            stats->maxIntervalUs = interval;
+        }
+        if (stats->count == 1)
+        {
+            stats->meanIntervalUs = interval;
+        }
+        else
+        {
+            stats->meanIntervalUs = stats->meanIntervalUs - (stats->meanIntervalUs >> 3) + (interval >> 3);
+        }
+    }
+
+    stats->lastAt = frame.timestamp;
+    if (stats->count != 0xFFFF)
+    {
+        stats->count++;
+    }
+}
+/*
+  Call once the frame has been acted on.
+*/
+void CanTiming::onHandled(const CanFrame &frame)
+{
+    IdStats *stats = find(frame);
+    if (!stats)
+    {
+        return;
+    }
+
+    uint32_t latency = micros() - frame.timestamp;
+    if (latency > stats->maxLatencyUs)
+    {
+        stats->maxLatencyUs = latency;
+    }
+}
+
+const CanTiming::IdStats *CanTiming::get(uint16_t id) const
+{
+    for (const IdStats &stats : _stats)
+    {
+        if (stats.id == id)
+        {
+            return &stats;
+        }
+    }
+    return nullptr;
+}
+
+void CanTiming::reset()
+{
+    for (uint8_t i = 0; i < CAN_TIMING_ID_COUNT; i++)
+    {
+        memset(&_stats[i], 0, sizeof(IdStats));
+        _stats[i].id = HANDLED_CAN_IDS[i];
+        _stats[i].minIntervalUs = 0xFFFFFFFF;
+    }
+}
+
+CanTiming::IdStats *CanTiming::find(const CanFrame &frame)
+{
+    if (frame.flags & CAN_FRAME_EXT)
+    {
+        return nullptr;
+    }
+    return const_cast<IdStats *>(get(frame.id));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../../include/can_controller.h"
+#include "../../include/communication.h"
+
+constexpr uint8_t CAN_TIMING_ID_COUNT = sizeof(HANDLED_CAN_IDS) / sizeof(HANDLED_CAN_IDS[0]);
+
+/*
+  Inter-arrival and arrival-to-action statistics per handled CAN ID, taken
+  from the receive timestamps of the frames.
+*/
+class CanTiming
+{
+public:
+    struct IdStats
+    {
+        uint16_t id;
+        uint16_t count; // Saturates at 0xFFFF
+        uint32_t lastAt;
+        uint32_t minIntervalUs;
+        uint32_t maxIntervalUs;
+        uint32_t meanIntervalUs; // Moving average over about 8 frames
+        uint32_t maxLatencyUs;   // From frame timestamp until it was handled
+    };
+
+    CanTiming();
+    void onArrival(const CanFrame &frame);
+    void onHandled(const CanFrame &frame);
+    const IdStats *get(uint16_t id) const;
+    const IdStats *begin() const { return _stats; }
+    const IdStats *end() const { return _stats + CAN_TIMING_ID_COUNT; }
+    void reset();
+
+private:
+    IdStats *find(const CanFrame &frame);
+
+    IdStats _stats[CAN_TIMING_ID_COUNT];
+};
@@ -0,0 +1,215 @@
+#include "CanTxQueue.h"
+
+static bool isSameId(const CanFrame &frame, uint32_t id, uint8_t flags)
+{
+    return frame.id == id && (frame.flags & CAN_FRAME_EXT) == (flags & CAN_FRAME_EXT);
+}
+
+CanTxQueue::CanTxQueue(CanController *CAN)
+{
+    this->CAN = CAN;
+    _count = 0;
+    memset(&stats, 0, sizeof(stats));
+    memset(_pending, 0, sizeof(_pending));
+}
+/*
+  Queue a frame and load what fits into the controller right away.
+  timeoutMs of 0 means the frame never expires.
+  Returns false if the queue is full.
+*/
+bool CanTxQueue::push(const CanFrame &frame, CanTxPriority priority, uint16_t timeoutMs)
+{
+    uint32_t now = millis();
+
+    if (_count == CAN_TX_QUEUE_SIZE)
+    {
+        dropExpired(now);
+    }
+    if (_count == CAN_TX_QUEUE_SIZE)
+    {
+        stats.full++;
+        return false;
+    }
+
+    Entry *entry = &_entries[_count++];
+    memcpy(&entry->frame, &frame, sizeof(CanFrame));
+    entry->priority = static_cast<uint8_t>(priority) & MCP_TXB_TXP10_M;
+    entry->hasDeadline = timeoutMs != 0;
+    entry->deadline = now + timeoutMs;
+
+    if (_count > stats.maxDepth)
+    {
+        stats.maxDepth = _count;
+    }
+
+    update();
+    return true;
+}
+/*
+  Call from loop(). Fills free TX buffers, costs one READ STATUS while
+  frames are queued and nothing when the queue is empty.
+*/
+void CanTxQueue::update()
+{
+    dropExpired(millis());
+    if (_count == 0)
+    {
+        return;
+    }
+
+    uint8_t busy = CAN->getTXBusy();
+
+    while (true)
+    {
+        int8_t best = -1;
+        uint8_t bestTxbuf = 0;
+        uint8_t bestPriority = 0;
+
+        // Highest priority first, oldest first on equal priority
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            uint8_t txbuf, priority;
+            if ((best >= 0 && _entries[i].priority <= _entries[best].priority) || isBlocked(i) ||
+                !place(_entries[i], busy, &txbuf, &priority))
+            {
+                continue;
+            }
+            best = i;
+            bestTxbuf = txbuf;
+            bestPriority = priority;
+        }
+
+        if (best < 0)
+        {
+            return;
+        }
+
+        const CanFrame &frame = _entries[best].frame;
+        if (CAN->sendFrameNB(&frame, bestTxbuf, bestPriority) != CAN_OK)
+        {
+            return;
+        }
+        _pending[bestTxbuf].id = frame.id;
+        _pending[bestTxbuf].flags = frame.flags;
+        _pending[bestTxbuf].priority = bestPriority;
+        busy |= 1 << bestTxbuf;
+        stats.loaded++;
+        remove(best);
+    }
+}
+/*
+  Drop everything queued, e.g. after the controller has been restarted.
+*/
+void CanTxQueue::clear()
+{
+    _count = 0;
+    stats.cleared++;
+}
+
+/*
+  Drop the queued frames with a standard ID, those already loaded into a TX
+  buffer still go out. Returns how many were dropped.
+*/
+uint8_t CanTxQueue::drop(uint32_t id)
+{
+    uint8_t dropped = 0;
+    uint8_t i = 0;
+    while (i < _count)
+    {
+        if (isSameId(_entries[i].frame, id, 0))
+        {
+            remove(i);
+            dropped++;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    return dropped;
+}
+
+uint8_t CanTxQueue::size() const
+{
+    return _count;
+}
+
+void CanTxQueue::dropExpired(uint32_t now)
+{
+    uint8_t i = 0;
+    while (i < _count)
+    {
+        if (_entries[i].hasDeadline && (int32_t)(now - _entries[i].deadline) >= 0)
+        {
+            remove(i);
+            stats.expired++;
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+/*
+  An older frame with the same ID is still queued.
+*/
+bool CanTxQueue::isBlocked(uint8_t index) const
+{
+    const CanFrame &frame = _entries[index].frame;
+    for (uint8_t i = 0; i < index; i++)
+    {
+        if (isSameId(_entries[i].frame, frame.id, frame.flags))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+/*
+  Find a free buffer and TXP that send the entry after every pending frame
+  with the same ID. The controller sends the highest TXP first and, on equal
+  TXP, the highest buffer number, so (TXP, buffer) has to be below theirs.
+  The entry's own priority is kept if possible, otherwise lowered.
+*/
+bool CanTxQueue::place(const Entry &entry, uint8_t busy, uint8_t *txbuf, uint8_t *priority) const
+{
+    for (int8_t txp = entry.priority; txp >= 0; txp--)
+    {
+        // Highest free buffer leaves the most room for frames that follow
+        for (int8_t i = MCP_N_TXBUFFERS - 1; i >= 0; i--)
+        {
+            if (busy & (1 << i))
+            {
+                continue;
+            }
+
+            bool isAfterPending = true;
+            for (uint8_t j = 0; j < MCP_N_TXBUFFERS; j++)
+            {
+                if (!(busy & (1 << j)) || !isSameId(entry.frame, _pending[j].id, _pending[j].flags))
+                {
+                    continue;
+                }
+                if (txp > _pending[j].priority || (txp == _pending[j].priority && i > j))
+                {
+                    isAfterPending = false;
+                    break;
+                }
+            }
+
+            if (isAfterPending)
+            {
+                *txbuf = i;
+                *priority = txp;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void CanTxQueue::remove(uint8_t index)
+{
+    _count--;
+    memmove(&_entries[index], &_entries[index + 1], (_count - index) * sizeof(Entry));
+}
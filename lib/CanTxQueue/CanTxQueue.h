@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../../include/can_controller.h"
+#include "../../include/defines.h"
+
+enum class CanTxPriority : uint8_t
+{
+    Low,
+    Normal,
+    High,
+    Urgent
+};
+
+/*
+  Software TX queue in front of the three MCP2515 transmit buffers.
+
+  push() returns immediately. Frames are loaded into free buffers with TXP
+  set from their priority, highest priority first. Frames with the same ID
+  leave in the order they were pushed: a frame is only loaded once it can
+  not overtake an earlier one, either still queued or pending in a buffer.
+  Frames that pass their deadline while queued are dropped and counted.
+*/
+class CanTxQueue
+{
+public:
+    struct Stats
+    {
+        uint32_t loaded;  // Handed to a TX buffer
+        uint16_t expired; // Dropped at their deadline
+        uint16_t full;    // Refused by push()
+        uint16_t cleared; // clear() calls, frames in the TX buffers may be lost with them
+        uint8_t maxDepth;
+    };
+
+    CanTxQueue(CanController *CAN);
+    bool push(const CanFrame &frame, CanTxPriority priority = CanTxPriority::Normal,
+              uint16_t timeoutMs = CAN_TX_TIMEOUT_MS);
+    void update();
+    void clear();
+    uint8_t drop(uint32_t id);
+    uint8_t size() const;
+
+    Stats stats;
+
+private:
+    struct Entry
+    {
+        CanFrame frame;
+        uint32_t deadline;
+        uint8_t priority;
+        bool hasDeadline;
+    };
+
+    struct Pending
+    {
+        uint32_t id;
+        uint8_t flags;
+        uint8_t priority;
+    };
+
+    void dropExpired(uint32_t now);
+    bool isBlocked(uint8_t index) const;
+    bool place(const Entry &entry, uint8_t busy, uint8_t *txbuf, uint8_t *priority) const;
+    void remove(uint8_t index);
+
+    Entry _entries[CAN_TX_QUEUE_SIZE]; // Oldest first
+    uint8_t _count;
+    Pending _pending[MCP_N_TXBUFFERS];
+    CanController *CAN;
+};
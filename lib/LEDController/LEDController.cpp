@@ -14,6 +14,16 @@ void LEDController::init()
     FastLED.addLeds<NEOPIXEL, LED_STRIP_PIN>(_ledsOfStrip, NUM_LEDS_STRIP);
 }
 
+/*
+  Turn every LED off now, update() lights them again.
+*/
+void LEDController::blank()
+{
+    fill_solid(_ledsOfRing, NUM_LEDS_RING, CRGB::Black);
+    fill_solid(_ledsOfStrip, NUM_LEDS_STRIP, CRGB::Black);
+    FastLED.show();
+}
+
 void LEDController::setBrightness(uint8_t val)
 {
     _isLightLevelSet = true;
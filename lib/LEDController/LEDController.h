@@ -10,6 +10,7 @@ public:
     void setBrightness(uint8_t val);
     void update();
     void init();
+    void blank();
 
     uint8_t hue;
 
@@ -0,0 +1,131 @@
+#include "LoopProfiler.h"
+#ifndef __AVR__
+#include <chrono>
+#endif
+
+LoopProfiler::LoopProfiler()
+{
+    _lapAt = 0;
+    reset();
+}
+/*
+  Take over Timer1, counting at F_CPU / 8 without interrupts.
+*/
+void LoopProfiler::begin()
+{
+#ifdef __AVR__
+    static_assert(F_CPU == 16000000UL, "Timer1 prescaler assumes 0.5 us ticks");
+    TCCR1A = 0;
+    TCCR1B = _BV(CS11);
+    TIMSK1 = 0;
+    TIFR1 = _BV(TOV1);
+#endif
+    lap();
+}
+/*
+  Ticks since the previous lap, 0xFFFF if 32 ms or more. On AVR the timer
+  overflow flag tells a whole turn of TCNT1 from a short wrap.
+*/
+uint16_t LoopProfiler::lap()
+{
+#ifdef __AVR__
+    uint8_t flags = TIFR1;
+    uint16_t now = TCNT1;
+    bool isOverflowed = flags & _BV(TOV1);
+    // Also clears an overflow that happened between reading TIFR1 and TCNT1
+    if (isOverflowed || now < _lapAt)
+    {
+        TIFR1 = _BV(TOV1);
+    }
+    uint16_t ticks = isOverflowed && now >= _lapAt ? 0xFFFF : now - _lapAt;
+    _lapAt = now;
+    return ticks;
+#else
+    uint32_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch()).count() / LOOP_PROFILER_TICK_NS;
+    uint32_t ticks = now - _lapAt;
+    _lapAt = now;
+    return ticks > 0xFFFF ? 0xFFFF : ticks;
+#endif
+}
+
+void LoopProfiler::recordStage(LoopStage stage, uint16_t ticks)
+{
+    _loopTicks += ticks;
+    uint16_t *stageTicks = &_stageTicks[static_cast<uint8_t>(stage)];
+    *stageTicks = *stageTicks > 0xFFFF - ticks ? 0xFFFF : *stageTicks + ticks;
+}
+/*
+  Stage times of the loop that just ended go to the histograms. The time
+  taken here is counted as self time, not as part of the next loop.
+  Returns the period of the sampled loop.
+*/
+uint16_t LoopProfiler::recordSample(uint16_t ticks)
+{
+    recordStage(LoopStage::Other, ticks);
+    uint16_t loopTicks = _loopTicks > 0xFFFF ? 0xFFFF : _loopTicks;
+    stats.samples++;
+    stats.totalTicks += _loopTicks;
+
+    for (uint8_t i = 0; i < static_cast<uint8_t>(LoopStage::Count); i++)
+    {
+        count(&_stages[i], _stageTicks[i]);
+        _stageTicks[i] = 0;
+    }
+    count(&_loop, loopTicks);
+    _loopTicks = 0;
+    _isSampling = false;
+    stats.selfTicks += lap();
+    return loopTicks;
+}
+
+void LoopProfiler::count(Histogram *histogram, uint16_t ticks)
+{
+    uint8_t bucket = 0;
+    if (ticks >> 8)
+    {
+        bucket = 8;
+        ticks >>= 8;
+    }
+    if (ticks >> 4)
+    {
+        bucket += 4;
+        ticks >>= 4;
+    }
+    if (ticks >> 2)
+    {
+        bucket += 2;
+        ticks >>= 2;
+    }
+    bucket += ticks >> 1;
+
+    if (histogram->counts[bucket] != 0xFFFF)
+    {
+        histogram->counts[bucket]++;
+    }
+}
+
+const LoopProfiler::Histogram &LoopProfiler::getStage(LoopStage stage) const
+{
+    return _stages[static_cast<uint8_t>(stage)];
+}
+/*
+  Whole loop periods of the sampled loops.
+*/
+const LoopProfiler::Histogram &LoopProfiler::getLoop() const
+{
+    return _loop;
+}
+/*
+  Clear the histograms and the worst case, the next loop starts a new sample.
+*/
+void LoopProfiler::reset()
+{
+    memset(_stages, 0, sizeof(_stages));
+    memset(&_loop, 0, sizeof(_loop));
+    memset(_stageTicks, 0, sizeof(_stageTicks));
+    memset(&stats, 0, sizeof(stats));
+    _loopTicks = 0;
+    _sampleCountdown = 1;
+    _isSampling = false;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../../include/defines.h"
+
+#define LOOP_PROFILER_BUCKETS 16 // log2 of 16 bit tick counts
+#define LOOP_PROFILER_TICK_NS 500
+
+enum class LoopStage : uint8_t
+{
+    CanRead,
+    Led,
+    Sid,
+    Other, // Everything else, from the last stage to the next loop()
+    Count
+};
+
+/*
+  Time spent per loop() stage, in log2 histograms of 0.5 us ticks from
+  Timer1 (steady_clock on the host). Bucket n counts times of 2^n up to
+  2^(n+1) ticks, the last one everything from 16 ms up.
+
+  Every loop takes one timer read for the worst-case loop period, so a
+  single stall is not missed. The stage breakdown and the histograms are
+  only taken from one loop in LOOP_PROFILER_SAMPLE_LOOPS, so an idle loop of
+  a few tens of microseconds is not slowed down by the bookkeeping.
+  stats.selfTicks is what the samples spent in here, against
+  stats.totalTicks for the sampled loops.
+
+  Timer1 runs free without interrupts, Servo and PWM on pins 9 and 10 can
+  not be used with the profiler. A stage or loop of 32 ms or more counts as
+  0xFFFF.
+*/
+class LoopProfiler
+{
+public:
+    struct Histogram
+    {
+        uint16_t counts[LOOP_PROFILER_BUCKETS]; // Saturate at 0xFFFF
+    };
+
+    struct Stats
+    {
+        uint32_t samples;
+        uint16_t maxLoopTicks; // Of every loop
+        uint32_t totalTicks; // Of the sampled loops, wraps after 35 minutes of them
+        uint32_t selfTicks;  // Spent filling the histograms
+    };
+
+    LoopProfiler();
+    void begin();
+    /*
+      Call first thing in loop(). Closes the loop before it.
+    */
+    void startLoop()
+    {
+        uint16_t ticks = lap();
+        if (_isSampling)
+        {
+            ticks = recordSample(ticks);
+        }
+        if (ticks > stats.maxLoopTicks)
+        {
+            stats.maxLoopTicks = ticks;
+        }
+        if (!--_sampleCountdown)
+        {
+            _sampleCountdown = LOOP_PROFILER_SAMPLE_LOOPS;
+            _isSampling = true;
+        }
+    }
+    void endStage(LoopStage stage)
+    {
+        if (_isSampling)
+        {
+            recordStage(stage, lap());
+        }
+    }
+    const Histogram &getStage(LoopStage stage) const;
+    const Histogram &getLoop() const;
+    void reset();
+
+    Stats stats;
+
+private:
+    uint16_t lap();
+    void recordStage(LoopStage stage, uint16_t ticks);
+    uint16_t recordSample(uint16_t ticks);
+    static void count(Histogram *histogram, uint16_t ticks);
+
+    Histogram _stages[static_cast<uint8_t>(LoopStage::Count)];
+    Histogram _loop;
+    uint16_t _stageTicks[static_cast<uint8_t>(LoopStage::Count)];
+    uint32_t _loopTicks;
+#ifdef __AVR__
+    uint16_t _lapAt;
+#else
+    uint32_t _lapAt;
+#endif
+    uint8_t _sampleCountdown;
+    bool _isSampling;
+};
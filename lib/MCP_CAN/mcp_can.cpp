@@ -32,7 +32,7 @@
 *********************************************************************************************************/
 void MCP_CAN::mcp2515_reset(void)                                      
 {
-    SPI.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE0));
+    SPI.beginTransaction(m_spiSettings);
     MCP2515_SELECT();
     spi_readwrite(MCP_RESET);
     MCP2515_UNSELECT();
@@ -48,7 +48,7 @@ INT8U MCP_CAN::mcp2515_readRegister(const INT8U address)
 {
     INT8U ret;
 
-    SPI.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE0));
+    SPI.beginTransaction(m_spiSettings);
     MCP2515_SELECT();
     spi_readwrite(MCP_READ);
     spi_readwrite(address);
@@ -66,7 +66,7 @@ INT8U MCP_CAN::mcp2515_readRegister(const INT8U address)
 void MCP_CAN::mcp2515_readRegisterS(const INT8U address, INT8U values[], const INT8U n)
 {
     INT8U i;
-    SPI.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE0));
+    SPI.beginTransaction(m_spiSettings);
     MCP2515_SELECT();
     spi_readwrite(MCP_READ);
     spi_readwrite(address);
@@ -84,7 +84,7 @@ void MCP_CAN::mcp2515_readRegisterS(const INT8U address, INT8U values[], const I
 *********************************************************************************************************/
 void MCP_CAN::mcp2515_setRegister(const INT8U address, const INT8U value)
 {
-    SPI.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE0));
+    SPI.beginTransaction(m_spiSettings);
     MCP2515_SELECT();
     spi_readwrite(MCP_WRITE);
     spi_readwrite(address);
@@ -100,7 +100,7 @@ void MCP_CAN::mcp2515_setRegister(const INT8U address, const INT8U value)
 void MCP_CAN::mcp2515_setRegisterS(const INT8U address, const INT8U values[], const INT8U n)
 {
     INT8U i;
-    SPI.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE0));
+    SPI.beginTransaction(m_spiSettings);
     MCP2515_SELECT();
     spi_readwrite(MCP_WRITE);
     spi_readwrite(address);
@@ -118,7 +118,7 @@ void MCP_CAN::mcp2515_setRegisterS(const INT8U address, const INT8U values[], co
 *********************************************************************************************************/
 void MCP_CAN::mcp2515_modifyRegister(const INT8U address, const INT8U mask, const INT8U data)
 {
-    SPI.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE0));
+    SPI.beginTransaction(m_spiSettings);
     MCP2515_SELECT();
     spi_readwrite(MCP_BITMOD);
     spi_readwrite(address);
@@ -135,7 +135,7 @@ void MCP_CAN::mcp2515_modifyRegister(const INT8U address, const INT8U mask, cons
 INT8U MCP_CAN::mcp2515_readStatus(void)                             
 {
     INT8U i;
-    SPI.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE0));
+    SPI.beginTransaction(m_spiSettings);
     MCP2515_SELECT();
     spi_readwrite(MCP_READ_STATUS);
     i = spi_read();
@@ -144,6 +144,22 @@ INT8U MCP_CAN::mcp2515_readStatus(void)
     return i;
 }
 
+/*********************************************************************************************************
+** Function name:           mcp2515_readRxStatus
+** Descriptions:            Reads which receive buffers hold a message with the RX STATUS instruction
+*********************************************************************************************************/
+INT8U MCP_CAN::mcp2515_readRxStatus(void)
+{
+    INT8U i;
+    SPI.beginTransaction(m_spiSettings);
+    MCP2515_SELECT();
+    spi_readwrite(MCP_RX_STATUS);
+    i = spi_read();
+    MCP2515_UNSELECT();
+    SPI.endTransaction();
+    return i;
+}
+
 /*********************************************************************************************************
 ** Function name:           setMode
 ** Descriptions:            Sets control mode
@@ -174,280 +190,52 @@ INT8U MCP_CAN::mcp2515_setCANCTRL_Mode(const INT8U newmode)
 }
 
 /*********************************************************************************************************
-** Function name:           mcp2515_configRate
-** Descriptions:            Set baudrate
+** Function name:           mcp2515_lookupBitTiming
+** Descriptions:            Solve bit timing for the CAN_xxxBPS and MCP_xxMHZ constants
 *********************************************************************************************************/
-INT8U MCP_CAN::mcp2515_configRate(const INT8U canSpeed, const INT8U canClock)            
+INT8U MCP_CAN::mcp2515_lookupBitTiming(const INT8U canSpeed, const INT8U canClock, MCP_BitTiming *timing)
 {
-    INT8U set, cfg1, cfg2, cfg3;
-    set = 1;
-    switch (canClock)
-    {
-        case (MCP_8MHZ):
-        switch (canSpeed) 
-        {
-            case (CAN_5KBPS):                                               //   5KBPS                  
-            cfg1 = MCP_8MHz_5kBPS_CFG1;
-            cfg2 = MCP_8MHz_5kBPS_CFG2;
-            cfg3 = MCP_8MHz_5kBPS_CFG3;
-            break;
-
-            case (CAN_10KBPS):                                              //  10KBPS                  
-            cfg1 = MCP_8MHz_10kBPS_CFG1;
-            cfg2 = MCP_8MHz_10kBPS_CFG2;
-            cfg3 = MCP_8MHz_10kBPS_CFG3;
-            break;
-
-            case (CAN_20KBPS):                                              //  20KBPS                  
-            cfg1 = MCP_8MHz_20kBPS_CFG1;
-            cfg2 = MCP_8MHz_20kBPS_CFG2;
-            cfg3 = MCP_8MHz_20kBPS_CFG3;
-            break;
-
-            case (CAN_31K25BPS):                                            //  31.25KBPS                  
-            cfg1 = MCP_8MHz_31k25BPS_CFG1;
-            cfg2 = MCP_8MHz_31k25BPS_CFG2;
-            cfg3 = MCP_8MHz_31k25BPS_CFG3;
-            break;
-
-            case (CAN_33K3BPS):                                             //  33.33KBPS                  
-            cfg1 = MCP_8MHz_33k3BPS_CFG1;
-            cfg2 = MCP_8MHz_33k3BPS_CFG2;
-            cfg3 = MCP_8MHz_33k3BPS_CFG3;
-            break;
-
-            case (CAN_40KBPS):                                              //  40Kbps
-            cfg1 = MCP_8MHz_40kBPS_CFG1;
-            cfg2 = MCP_8MHz_40kBPS_CFG2;
-            cfg3 = MCP_8MHz_40kBPS_CFG3;
-            break;
-
-            case (CAN_47KBPS):                                              //  47.619Kbps
-            cfg1 = MCP_8MHz_47kBPS_CFG1;
-            cfg2 = MCP_8MHz_47kBPS_CFG2;
-            cfg3 = MCP_8MHz_47kBPS_CFG3;
-            break;
-
-            case (CAN_50KBPS):                                              //  50Kbps
-            cfg1 = MCP_8MHz_50kBPS_CFG1;
-            cfg2 = MCP_8MHz_50kBPS_CFG2;
-            cfg3 = MCP_8MHz_50kBPS_CFG3;
-            break;
-
-            case (CAN_80KBPS):                                              //  80Kbps
-            cfg1 = MCP_8MHz_80kBPS_CFG1;
-            cfg2 = MCP_8MHz_80kBPS_CFG2;
-            cfg3 = MCP_8MHz_80kBPS_CFG3;
-            break;
-
-            case (CAN_100KBPS):                                             // 100Kbps
-            cfg1 = MCP_8MHz_100kBPS_CFG1;
-            cfg2 = MCP_8MHz_100kBPS_CFG2;
-            cfg3 = MCP_8MHz_100kBPS_CFG3;
-            break;
-
-            case (CAN_125KBPS):                                             // 125Kbps
-            cfg1 = MCP_8MHz_125kBPS_CFG1;
-            cfg2 = MCP_8MHz_125kBPS_CFG2;
-            cfg3 = MCP_8MHz_125kBPS_CFG3;
-            break;
-
-            case (CAN_200KBPS):                                             // 200Kbps
-            cfg1 = MCP_8MHz_200kBPS_CFG1;
-            cfg2 = MCP_8MHz_200kBPS_CFG2;
-            cfg3 = MCP_8MHz_200kBPS_CFG3;
-            break;
-
-            case (CAN_250KBPS):                                             // 250Kbps
-            cfg1 = MCP_8MHz_250kBPS_CFG1;
-            cfg2 = MCP_8MHz_250kBPS_CFG2;
-            cfg3 = MCP_8MHz_250kBPS_CFG3;
-            break;
-
-            case (CAN_500KBPS):                                             // 500Kbps
-            cfg1 = MCP_8MHz_500kBPS_CFG1;
-            cfg2 = MCP_8MHz_500kBPS_CFG2;
-            cfg3 = MCP_8MHz_500kBPS_CFG3;
-            break;
-        
-            case (CAN_1000KBPS):                                            //   1Mbps
-            cfg1 = MCP_8MHz_1000kBPS_CFG1;
-            cfg2 = MCP_8MHz_1000kBPS_CFG2;
-            cfg3 = MCP_8MHz_1000kBPS_CFG3;
-            break;  
+    static const INT32U bitrates[] PROGMEM = {
+        4096, 5000, 10000, 20000, 31250, 33333, 40000, 47619,           /* CAN_4K096BPS .. CAN_47KBPS   */
+        50000, 80000, 100000, 125000, 200000, 250000, 500000, 1000000   /* CAN_50KBPS .. CAN_1000KBPS   */
+    };
+    static const INT32U clocks[] PROGMEM = { 20000000, 16000000, 8000000 };
 
-            default:
-            set = 0;
-	    return MCP2515_FAIL;
-            break;
-        }
-        break;
-
-        case (MCP_16MHZ):
-        switch (canSpeed) 
-        {
-            case (CAN_5KBPS):                                               //   5Kbps
-            cfg1 = MCP_16MHz_5kBPS_CFG1;
-            cfg2 = MCP_16MHz_5kBPS_CFG2;
-            cfg3 = MCP_16MHz_5kBPS_CFG3;
-            break;
-
-            case (CAN_10KBPS):                                              //  10Kbps
-            cfg1 = MCP_16MHz_10kBPS_CFG1;
-            cfg2 = MCP_16MHz_10kBPS_CFG2;
-            cfg3 = MCP_16MHz_10kBPS_CFG3;
-            break;
-
-            case (CAN_20KBPS):                                              //  20Kbps
-            cfg1 = MCP_16MHz_20kBPS_CFG1;
-            cfg2 = MCP_16MHz_20kBPS_CFG2;
-            cfg3 = MCP_16MHz_20kBPS_CFG3;
-            break;
-
-            case (CAN_33K3BPS):                                              //  20Kbps
-            cfg1 = MCP_16MHz_33k3BPS_CFG1;
-            cfg2 = MCP_16MHz_33k3BPS_CFG2;
-            cfg3 = MCP_16MHz_33k3BPS_CFG3;
-            break;
-
-            case (CAN_40KBPS):                                              //  40Kbps
-            cfg1 = MCP_16MHz_40kBPS_CFG1;
-            cfg2 = MCP_16MHz_40kBPS_CFG2;
-            cfg3 = MCP_16MHz_40kBPS_CFG3;
-            break;
-
-            case (CAN_50KBPS):                                              //  50Kbps
-            cfg2 = MCP_16MHz_50kBPS_CFG2;
-            cfg3 = MCP_16MHz_50kBPS_CFG3;
-            break;
-
-            case (CAN_80KBPS):                                              //  80Kbps
-            cfg1 = MCP_16MHz_80kBPS_CFG1;
-            cfg2 = MCP_16MHz_80kBPS_CFG2;
-            cfg3 = MCP_16MHz_80kBPS_CFG3;
-            break;
-
-            case (CAN_100KBPS):                                             // 100Kbps
-            cfg1 = MCP_16MHz_100kBPS_CFG1;
-            cfg2 = MCP_16MHz_100kBPS_CFG2;
-            cfg3 = MCP_16MHz_100kBPS_CFG3;
-            break;
-
-            case (CAN_125KBPS):                                             // 125Kbps
-            cfg1 = MCP_16MHz_125kBPS_CFG1;
-            cfg2 = MCP_16MHz_125kBPS_CFG2;
-            cfg3 = MCP_16MHz_125kBPS_CFG3;
-            break;
-
-            case (CAN_200KBPS):                                             // 200Kbps
-            cfg1 = MCP_16MHz_200kBPS_CFG1;
-            cfg2 = MCP_16MHz_200kBPS_CFG2;
-            cfg3 = MCP_16MHz_200kBPS_CFG3;
-            break;
-
-            case (CAN_250KBPS):                                             // 250Kbps
-            cfg1 = MCP_16MHz_250kBPS_CFG1;
-            cfg2 = MCP_16MHz_250kBPS_CFG2;
-            cfg3 = MCP_16MHz_250kBPS_CFG3;
-            break;
-
-            case (CAN_500KBPS):                                             // 500Kbps
-            cfg1 = MCP_16MHz_500kBPS_CFG1;
-            cfg2 = MCP_16MHz_500kBPS_CFG2;
-            cfg3 = MCP_16MHz_500kBPS_CFG3;
-            break;
-        
-            case (CAN_1000KBPS):                                            //   1Mbps
-            cfg1 = MCP_16MHz_1000kBPS_CFG1;
-            cfg2 = MCP_16MHz_1000kBPS_CFG2;
-            cfg3 = MCP_16MHz_1000kBPS_CFG3;
-            break;  
-
-            default:
-            set = 0;
-	    return MCP2515_FAIL;
-            break;
-        }
-        break;
-        
-        case (MCP_20MHZ):
-        switch (canSpeed) 
-        {
-            case (CAN_40KBPS):                                              //  40Kbps
-            cfg1 = MCP_20MHz_40kBPS_CFG1;
-            cfg2 = MCP_20MHz_40kBPS_CFG2;
-            cfg3 = MCP_20MHz_40kBPS_CFG3;
-            break;
+    if (canSpeed > CAN_1000KBPS || canClock > MCP_8MHZ)
+        return MCP2515_FAIL;
 
-            case (CAN_50KBPS):                                              //  50Kbps
-            cfg1 = MCP_20MHz_50kBPS_CFG1;
-            cfg2 = MCP_20MHz_50kBPS_CFG2;
-            cfg3 = MCP_20MHz_50kBPS_CFG3;
-            break;
+    *timing = mcp2515_calcBitTiming(pgm_read_dword(&clocks[canClock]), pgm_read_dword(&bitrates[canSpeed]));
 
-            case (CAN_80KBPS):                                              //  80Kbps
-            cfg1 = MCP_20MHz_80kBPS_CFG1;
-            cfg2 = MCP_20MHz_80kBPS_CFG2;
-            cfg3 = MCP_20MHz_80kBPS_CFG3;
-            break;
-
-            case (CAN_100KBPS):                                             // 100Kbps
-            cfg1 = MCP_20MHz_100kBPS_CFG1;
-            cfg2 = MCP_20MHz_100kBPS_CFG2;
-            cfg3 = MCP_20MHz_100kBPS_CFG3;
-            break;
+    if (timing->errorPpm > MCP_MAX_BITRATE_ERROR_PPM)
+        return MCP2515_FAIL;
 
-            case (CAN_125KBPS):                                             // 125Kbps
-            cfg1 = MCP_20MHz_125kBPS_CFG1;
-            cfg2 = MCP_20MHz_125kBPS_CFG2;
-            cfg3 = MCP_20MHz_125kBPS_CFG3;
-            break;
+    return MCP2515_OK;
+}
 
-            case (CAN_200KBPS):                                             // 200Kbps
-            cfg1 = MCP_20MHz_200kBPS_CFG1;
-            cfg2 = MCP_20MHz_200kBPS_CFG2;
-            cfg3 = MCP_20MHz_200kBPS_CFG3;
-            break;
+/*********************************************************************************************************
+** Function name:           mcp2515_setBitTiming
+** Descriptions:            Write CNF1..3, controller has to be in configuration mode
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_setBitTiming(const MCP_BitTiming &timing)
+{
+    INT8U cnf[3] = { timing.cfg3, timing.cfg2, timing.cfg1 };          /* CNF3, CNF2, CNF1 are adjacent */
 
-            case (CAN_250KBPS):                                             // 250Kbps
-            cfg1 = MCP_20MHz_250kBPS_CFG1;
-            cfg2 = MCP_20MHz_250kBPS_CFG2;
-            cfg3 = MCP_20MHz_250kBPS_CFG3;
-            break;
+    mcp2515_setRegisterS(MCP_CNF3, cnf, 3);
+}
 
-            case (CAN_500KBPS):                                             // 500Kbps
-            cfg1 = MCP_20MHz_500kBPS_CFG1;
-            cfg2 = MCP_20MHz_500kBPS_CFG2;
-            cfg3 = MCP_20MHz_500kBPS_CFG3;
-            break;
-        
-            case (CAN_1000KBPS):                                            //   1Mbps
-            cfg1 = MCP_20MHz_1000kBPS_CFG1;
-            cfg2 = MCP_20MHz_1000kBPS_CFG2;
-            cfg3 = MCP_20MHz_1000kBPS_CFG3;
-            break;  
+/*********************************************************************************************************
+** Function name:           mcp2515_configRate
+** Descriptions:            Set baudrate
+*********************************************************************************************************/
+INT8U MCP_CAN::mcp2515_configRate(const INT8U canSpeed, const INT8U canClock)            
+{
+    MCP_BitTiming timing;
 
-            default:
-            set = 0;
-            return MCP2515_FAIL;
-            break;
-        }
-        break;
-        
-        default:
-        set = 0;
-	return MCP2515_FAIL;
-        break;
-    }
+    if (mcp2515_lookupBitTiming(canSpeed, canClock, &timing))
+        return MCP2515_FAIL;
 
-    if (set) {
-        mcp2515_setRegister(MCP_CNF1, cfg1);
-        mcp2515_setRegister(MCP_CNF2, cfg2);
-        mcp2515_setRegister(MCP_CNF3, cfg3);
-        return MCP2515_OK;
-    }
-     
-    return MCP2515_FAIL;
+    mcp2515_setBitTiming(timing);
+    return MCP2515_OK;
 }
 
 /*********************************************************************************************************
@@ -496,7 +284,7 @@ void MCP_CAN::mcp2515_initCANBuffers(void)
 ** Function name:           mcp2515_init
 ** Descriptions:            Initialize the controller
 *********************************************************************************************************/
-INT8U MCP_CAN::mcp2515_init(const INT8U canIDMode, const INT8U canSpeed, const INT8U canClock)
+INT8U MCP_CAN::mcp2515_init(const INT8U canIDMode, const MCP_BitTiming &timing)
 {
 
   INT8U res;
@@ -518,13 +306,7 @@ INT8U MCP_CAN::mcp2515_init(const INT8U canIDMode, const INT8U canSpeed, const I
 #endif
 
     // Set Baudrate
-    if(mcp2515_configRate(canSpeed, canClock))
-    {
-#if DEBUG_MODE
-      Serial.print("Setting Baudrate Failure...\r\n");
-#endif
-      return res;
-    }
+    mcp2515_setBitTiming(timing);
 #if DEBUG_MODE
     Serial.print("Setting Baudrate Successful!\r\n");
 #endif
@@ -600,13 +382,12 @@ INT8U MCP_CAN::mcp2515_init(const INT8U canIDMode, const INT8U canSpeed, const I
 }
 
 /*********************************************************************************************************
-** Function name:           mcp2515_write_id
-** Descriptions:            Write CAN ID
+** Function name:           mcp2515_encode_id
+** Descriptions:            Encode CAN ID into SIDH, SIDL, EID8 and EID0 register layout
 *********************************************************************************************************/
-void MCP_CAN::mcp2515_write_id( const INT8U mcp_addr, const INT8U ext, const INT32U id )
+void MCP_CAN::mcp2515_encode_id( const INT8U ext, const INT32U id, INT8U tbufdata[] )
 {
     uint16_t canid;
-    INT8U tbufdata[4];
 
     canid = (uint16_t)(id & 0x0FFFF);
 
@@ -627,7 +408,17 @@ void MCP_CAN::mcp2515_write_id( const INT8U mcp_addr, const INT8U ext, const INT
         tbufdata[MCP_EID0] = 0;
         tbufdata[MCP_EID8] = 0;
     }
-    
+}
+
+/*********************************************************************************************************
+** Function name:           mcp2515_write_id
+** Descriptions:            Write CAN ID
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_write_id( const INT8U mcp_addr, const INT8U ext, const INT32U id )
+{
+    INT8U tbufdata[4];
+
+    mcp2515_encode_id( ext, id, tbufdata );
     mcp2515_setRegisterS( mcp_addr, tbufdata, 4 );
 }
 
@@ -693,76 +484,156 @@ void MCP_CAN::mcp2515_read_id( const INT8U mcp_addr, INT8U* ext, INT32U* id )
 ** Function name:           mcp2515_write_canMsg
 ** Descriptions:            Write message
 *********************************************************************************************************/
-void MCP_CAN::mcp2515_write_canMsg( const INT8U buffer_sidh_addr)
+void MCP_CAN::mcp2515_write_canMsg( const INT8U buffer_sidh_addr, const INT32U id, const INT8U flags,
+                                    INT8U len, const INT8U *buf )
 {
     INT8U mcp_addr;
     mcp_addr = buffer_sidh_addr;
-    mcp2515_setRegisterS(mcp_addr+5, m_nDta, m_nDlc );                  /* write data bytes             */
+    if (len > MAX_CHAR_IN_MESSAGE)
+        len = MAX_CHAR_IN_MESSAGE;
+    mcp2515_setRegisterS(mcp_addr+5, buf, len );                        /* write data bytes             */
 	
-    if ( m_nRtr == 1)                                                   /* if RTR set bit in byte       */
-        m_nDlc |= MCP_RTR_MASK;  
+    if ( flags & CAN_FRAME_RTR )                                        /* if RTR set bit in byte       */
+        len |= MCP_RTR_MASK;  
 
-    mcp2515_setRegister((mcp_addr+4), m_nDlc );                         /* write the RTR and DLC        */
-    mcp2515_write_id(mcp_addr, m_nExtFlg, m_nID );                      /* write CAN id                 */
+    mcp2515_setRegister((mcp_addr+4), len );                            /* write the RTR and DLC        */
+    mcp2515_write_id(mcp_addr, (flags & CAN_FRAME_EXT) ? 1 : 0, id );   /* write CAN id                 */
 
 }
 
 /*********************************************************************************************************
 ** Function name:           mcp2515_read_canMsg
-** Descriptions:            Read message
+** Descriptions:            Read message with a single READ RX BUFFER instruction. ID, DLC and data
+**                          are clocked out in one burst straight into the caller's storage and RXnIF
+**                          is cleared when /CS is raised.
 *********************************************************************************************************/
-void MCP_CAN::mcp2515_read_canMsg( const INT8U buffer_sidh_addr)        /* read can msg                 */
+void MCP_CAN::mcp2515_read_canMsg( const INT8U read_rx_instr, INT32U *id, INT8U *flags,
+                                   INT8U *len, INT8U buf[] )
 {
-    INT8U mcp_addr, ctrl;
+    INT8U tbufdata[5];
+    INT8U i, dlc;
+    INT32U canId;
 
-    mcp_addr = buffer_sidh_addr;
+    SPI.beginTransaction(m_spiSettings);
+    MCP2515_SELECT();
+    spi_readwrite(read_rx_instr);
+                                                                        /* SIDH, SIDL, EID8, EID0, DLC  */
+    for (i=0; i<5; i++)
+        tbufdata[i] = spi_read();
 
-    mcp2515_read_id( mcp_addr, &m_nExtFlg,&m_nID );
+    dlc = tbufdata[4] & MCP_DLC_MASK;
+    if (dlc > MAX_CHAR_IN_MESSAGE)
+        dlc = MAX_CHAR_IN_MESSAGE;
 
-    ctrl = mcp2515_readRegister( mcp_addr-1 );
-    m_nDlc = mcp2515_readRegister( mcp_addr+4 );
+    for (i=0; i<dlc; i++)
+        buf[i] = spi_read();
 
-    if (ctrl & 0x08)
-        m_nRtr = 1;
-    else
-        m_nRtr = 0;
+    MCP2515_UNSELECT();                                                 /* clears RXnIF                 */
+    SPI.endTransaction();
+
+    canId = (tbufdata[MCP_SIDH]<<3) + (tbufdata[MCP_SIDL]>>5);
+    *flags = 0;
+
+    if ( (tbufdata[MCP_SIDL] & MCP_TXB_EXIDE_M) ==  MCP_TXB_EXIDE_M )
+    {
+                                                                        /* extended id                  */
+        canId = (canId<<2) + (tbufdata[MCP_SIDL] & 0x03);
+        canId = (canId<<8) + tbufdata[MCP_EID8];
+        canId = (canId<<8) + tbufdata[MCP_EID0];
+        *flags = CAN_FRAME_EXT;
+        if (tbufdata[4] & MCP_RXB_RTR_M)
+            *flags |= CAN_FRAME_RTR;
+    }
+    else if (tbufdata[MCP_SIDL] & MCP_RXB_SRR_M)
+    {
+        *flags = CAN_FRAME_RTR;                                         /* standard remote frame        */
+    }
 
-    m_nDlc &= MCP_DLC_MASK;
-    mcp2515_readRegisterS( mcp_addr+5, &(m_nDta[0]), m_nDlc );
+    *id = canId;
+    *len = dlc;
+}
+
+/*********************************************************************************************************
+** Function name:           mcp2515_load_canMsg
+** Descriptions:            Write message with a single LOAD TX BUFFER instruction
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_load_canMsg( const INT8U txbuf_idx, const INT32U id, const INT8U flags,
+                                   INT8U len, const INT8U *buf )
+{
+    static const INT8U loadInstr[MCP_N_TXBUFFERS] = { MCP_LOAD_TX0, MCP_LOAD_TX1, MCP_LOAD_TX2 };
+    INT8U tbufdata[4];
+    INT8U dlc, i;
+
+    mcp2515_encode_id( (flags & CAN_FRAME_EXT) ? 1 : 0, id, tbufdata );
+
+    if (len > MAX_CHAR_IN_MESSAGE)
+        len = MAX_CHAR_IN_MESSAGE;
+    dlc = len;
+    if ( flags & CAN_FRAME_RTR )                                        /* if RTR set bit in byte       */
+        dlc |= MCP_RTR_MASK;
+
+    SPI.beginTransaction(m_spiSettings);
+    MCP2515_SELECT();
+    spi_readwrite(loadInstr[txbuf_idx]);                                /* starts at TXBnSIDH           */
+    for (i=0; i<4; i++)
+        spi_readwrite(tbufdata[i]);
+    spi_readwrite(dlc);
+    for (i=0; i<len; i++)
+        spi_readwrite(buf[i]);
+    MCP2515_UNSELECT();
+    SPI.endTransaction();
+}
+
+/*********************************************************************************************************
+** Function name:           mcp2515_requestToSend
+** Descriptions:            Start transmission of a loaded buffer with the RTS instruction
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_requestToSend( const INT8U txbuf_idx )
+{
+    static const INT8U rtsInstr[MCP_N_TXBUFFERS] = { MCP_RTS_TX0, MCP_RTS_TX1, MCP_RTS_TX2 };
+
+    SPI.beginTransaction(m_spiSettings);
+    MCP2515_SELECT();
+    spi_readwrite(rtsInstr[txbuf_idx]);
+    MCP2515_UNSELECT();
+    SPI.endTransaction();
 }
 
 /*********************************************************************************************************
 ** Function name:           mcp2515_getNextFreeTXBuf
-** Descriptions:            Send message
+** Descriptions:            Find a TX buffer with TXREQ cleared. One READ STATUS covers all three buffers.
 *********************************************************************************************************/
 INT8U MCP_CAN::mcp2515_getNextFreeTXBuf(INT8U *txbuf_n)                 /* get Next free txbuf          */
 {
-    INT8U res, i, ctrlval;
+    INT8U i, status;
     INT8U ctrlregs[MCP_N_TXBUFFERS] = { MCP_TXB0CTRL, MCP_TXB1CTRL, MCP_TXB2CTRL };
 
-    res = MCP_ALLTXBUSY;
     *txbuf_n = 0x00;
-
+    status = mcp2515_readStatus();
                                                                         /* check all 3 TX-Buffers       */
     for (i=0; i<MCP_N_TXBUFFERS; i++) {
-        ctrlval = mcp2515_readRegister( ctrlregs[i] );
-        if ( (ctrlval & MCP_TXB_TXREQ_M) == 0 ) {
+        if ( (status & (MCP_STAT_TX0REQ << (i * 2))) == 0 ) {
             *txbuf_n = ctrlregs[i]+1;                                   /* return SIDH-address of Buffer*/
-            
-            res = MCP2515_OK;
-            return res;                                                 /* ! function exit              */
+            return MCP2515_OK;                                          /* ! function exit              */
         }
     }
-    return res;
+
+    return MCP_ALLTXBUSY;
 }
 
 /*********************************************************************************************************
 ** Function name:           MCP_CAN
-** Descriptions:            Public function to declare CAN class and the /CS pin.
+** Descriptions:            Public function to declare CAN class, the /CS pin and the SPI clock.
 *********************************************************************************************************/
-MCP_CAN::MCP_CAN(INT8U _CS)
+MCP_CAN::MCP_CAN(INT8U _CS, INT32U spiClock)
+    : m_spiSettings(spiClock, MSBFIRST, SPI_MODE0)
 {
     MCPCS = _CS;
+#if defined(__AVR__)
+    m_nCsPort = portOutputRegister(digitalPinToPort(MCPCS));            /* resolve pin once so /CS is   */
+    m_nCsMask = digitalPinToBitMask(MCPCS);                             /* a single port write          */
+#endif
+    m_nTxPending = 0;
     MCP2515_UNSELECT();
     pinMode(MCPCS, OUTPUT);
 }
@@ -772,14 +643,34 @@ MCP_CAN::MCP_CAN(INT8U _CS)
 ** Descriptions:            Public function to declare controller initialization parameters.
 *********************************************************************************************************/
 INT8U MCP_CAN::begin(INT8U idmodeset, INT8U speedset, INT8U clockset)
+{
+    MCP_BitTiming timing;
+
+    if (mcp2515_lookupBitTiming(speedset, clockset, &timing))
+    {
+#if DEBUG_MODE
+        Serial.print("Setting Baudrate Failure...\r\n");
+#endif
+        return CAN_FAILINIT;
+    }
+
+    return begin(idmodeset, timing);
+}
+
+/*********************************************************************************************************
+** Function name:           begin
+** Descriptions:            Public function to declare controller initialization parameters with bit
+**                          timing from mcpBitTiming<>() or mcp2515_calcBitTiming().
+*********************************************************************************************************/
+INT8U MCP_CAN::begin(INT8U idmodeset, const MCP_BitTiming &timing)
 {
     INT8U res;
 
     SPI.begin();
-    res = mcp2515_init(idmodeset, speedset, clockset);
+    res = mcp2515_init(idmodeset, timing);
     if (res == MCP2515_OK)
         return CAN_OK;
-    
+
     return CAN_FAILINIT;
 }
 
@@ -1000,45 +891,11 @@ INT8U MCP_CAN::init_Filt(INT8U num, INT32U ulData)
     return res;
 }
 
-/*********************************************************************************************************
-** Function name:           setMsg
-** Descriptions:            Set can message, such as dlc, id, dta[] and so on
-*********************************************************************************************************/
-INT8U MCP_CAN::setMsg(INT32U id, INT8U rtr, INT8U ext, INT8U len, INT8U *pData)
-{
-    int i = 0;
-    m_nID     = id;
-    m_nRtr    = rtr;
-    m_nExtFlg = ext;
-    m_nDlc    = len;
-    for(i = 0; i<MAX_CHAR_IN_MESSAGE; i++)
-        m_nDta[i] = *(pData+i);
-	
-    return MCP2515_OK;
-}
-
-/*********************************************************************************************************
-** Function name:           clearMsg
-** Descriptions:            Set all messages to zero
-*********************************************************************************************************/
-INT8U MCP_CAN::clearMsg()
-{
-    m_nID       = 0;
-    m_nDlc      = 0;
-    m_nExtFlg   = 0;
-    m_nRtr      = 0;
-    m_nfilhit   = 0;
-    for(int i = 0; i<m_nDlc; i++ )
-      m_nDta[i] = 0x00;
-
-    return MCP2515_OK;
-}
-
 /*********************************************************************************************************
 ** Function name:           sendMsg
-** Descriptions:            Send message
+** Descriptions:            Send message and wait for it to leave the bus
 *********************************************************************************************************/
-INT8U MCP_CAN::sendMsg()
+INT8U MCP_CAN::sendMsg(INT32U id, INT8U flags, INT8U len, const INT8U *buf)
 {
     INT8U res, res1, txbuf_n;
     uint16_t uiTimeOut = 0;
@@ -1053,7 +910,7 @@ INT8U MCP_CAN::sendMsg()
         return CAN_GETTXBFTIMEOUT;                                      /* get tx buff time out         */
     }
     uiTimeOut = 0;
-    mcp2515_write_canMsg( txbuf_n);
+    mcp2515_write_canMsg( txbuf_n, id, flags, len, buf );
     mcp2515_modifyRegister( txbuf_n-1 , MCP_TXB_TXREQ_M, MCP_TXB_TXREQ_M );
     
     do
@@ -1075,12 +932,7 @@ INT8U MCP_CAN::sendMsg()
 *********************************************************************************************************/
 INT8U MCP_CAN::sendMsgBuf(INT32U id, INT8U ext, INT8U len, INT8U *buf)
 {
-    INT8U res;
-	
-    setMsg(id, 0, ext, len, buf);
-    res = sendMsg();
-    
-    return res;
+    return sendMsg(id, ext ? CAN_FRAME_EXT : 0, len, buf);
 }
 
 /*********************************************************************************************************
@@ -1089,47 +941,216 @@ INT8U MCP_CAN::sendMsgBuf(INT32U id, INT8U ext, INT8U len, INT8U *buf)
 *********************************************************************************************************/
 INT8U MCP_CAN::sendMsgBuf(INT32U id, INT8U len, INT8U *buf)
 {
-    INT8U ext = 0, rtr = 0;
-    INT8U res;
+    INT8U flags = 0;
     
     if((id & 0x80000000) == 0x80000000)
-        ext = 1;
+        flags |= CAN_FRAME_EXT;
  
     if((id & 0x40000000) == 0x40000000)
-        rtr = 1;
+        flags |= CAN_FRAME_RTR;
         
-    setMsg(id, rtr, ext, len, buf);
-    res = sendMsg();
-    
-    return res;
+    return sendMsg(id & 0x1FFFFFFF, flags, len, buf);
 }
 
 /*********************************************************************************************************
-** Function name:           readMsg
-** Descriptions:            Read message
+** Function name:           sendFrame
+** Descriptions:            Public function, Sends frame straight from the caller's storage.
+*********************************************************************************************************/
+INT8U MCP_CAN::sendFrame(const CanFrame *frame)
+{
+    return sendMsg(frame->id, frame->flags, frame->len, frame->data);
+}
+
+/*********************************************************************************************************
+** Function name:           sendMsgNB
+** Descriptions:            Load message into a free TX buffer and request transmission without waiting
+**                          for it to leave the bus. Completion is reported by checkTXComplete().
 *********************************************************************************************************/
-INT8U MCP_CAN::readMsg()
+INT8U MCP_CAN::sendMsgNB(INT32U id, INT8U flags, INT8U len, const INT8U *buf)
 {
-    INT8U stat, res;
+    INT8U status, i, txif;
 
-    stat = mcp2515_readStatus();
+    status = mcp2515_readStatus();
 
-    if ( stat & MCP_STAT_RX0IF )                                        /* Msg in Buffer 0              */
+    for (i=0; i<MCP_N_TXBUFFERS; i++)
     {
-        mcp2515_read_canMsg( MCP_RXBUF_0);
-        mcp2515_modifyRegister(MCP_CANINTF, MCP_RX0IF, 0);
-        res = CAN_OK;
+        if ( status & (MCP_STAT_TX0REQ << (i * 2)) )
+            continue;
+
+        txif = MCP_TX0IF << i;
+        if ( status & (MCP_STAT_TX0IF << (i * 2)) )                     /* stale flag from earlier send */
+            mcp2515_modifyRegister(MCP_CANINTF, txif, 0);
+
+        mcp2515_load_canMsg(i, id, flags, len, buf);
+        mcp2515_requestToSend(i);
+        m_nTxPending |= txif;
+        return CAN_OK;
     }
-    else if ( stat & MCP_STAT_RX1IF )                                   /* Msg in Buffer 1              */
+
+    return CAN_TXBUSY;
+}
+
+/*********************************************************************************************************
+** Function name:           sendMsgBufNB
+** Descriptions:            Public function, Queues message to transmit buffer and returns immediately.
+*********************************************************************************************************/
+INT8U MCP_CAN::sendMsgBufNB(INT32U id, INT8U ext, INT8U len, INT8U *buf)
+{
+    return sendMsgNB(id, ext ? CAN_FRAME_EXT : 0, len, buf);
+}
+
+/*********************************************************************************************************
+** Function name:           sendMsgBufNB
+** Descriptions:            Public function, Queues message to transmit buffer and returns immediately.
+*********************************************************************************************************/
+INT8U MCP_CAN::sendMsgBufNB(INT32U id, INT8U len, INT8U *buf)
+{
+    INT8U flags = 0;
+
+    if((id & 0x80000000) == 0x80000000)
+        flags |= CAN_FRAME_EXT;
+
+    if((id & 0x40000000) == 0x40000000)
+        flags |= CAN_FRAME_RTR;
+
+    return sendMsgNB(id & 0x1FFFFFFF, flags, len, buf);
+}
+
+/*********************************************************************************************************
+** Function name:           sendFrameNB
+** Descriptions:            Public function, Queues frame straight from the caller's storage and returns
+**                          immediately.
+*********************************************************************************************************/
+INT8U MCP_CAN::sendFrameNB(const CanFrame *frame)
+{
+    return sendMsgNB(frame->id, frame->flags, frame->len, frame->data);
+}
+
+/*********************************************************************************************************
+** Function name:           sendFrameNB
+** Descriptions:            Public function, Loads frame into TX buffer txbuf with transmit priority
+**                          txPriority (TXP, 0-3) and requests transmission. TXBnCTRL, ID, DLC and data
+**                          are written in one WRITE burst. Of the pending buffers the one with the
+**                          highest TXP goes first, on equal TXP the highest buffer number. txbuf must be
+**                          idle, see getTXBusy().
+*********************************************************************************************************/
+INT8U MCP_CAN::sendFrameNB(const CanFrame *frame, INT8U txbuf, INT8U txPriority)
+{
+    static const INT8U ctrlRegs[MCP_N_TXBUFFERS] = { MCP_TXB0CTRL, MCP_TXB1CTRL, MCP_TXB2CTRL };
+    INT8U tbufdata[4];
+    INT8U txif, len, dlc, i;
+
+    if (txbuf >= MCP_N_TXBUFFERS)
+        return CAN_FAILTX;
+
+    txif = MCP_TX0IF << txbuf;
+    mcp2515_modifyRegister(MCP_CANINTF, txif, 0);                       /* stale flag from earlier send */
+
+    mcp2515_encode_id( (frame->flags & CAN_FRAME_EXT) ? 1 : 0, frame->id, tbufdata );
+
+    len = frame->len;
+    if (len > MAX_CHAR_IN_MESSAGE)
+        len = MAX_CHAR_IN_MESSAGE;
+    dlc = len;
+    if ( frame->flags & CAN_FRAME_RTR )
+        dlc |= MCP_RTR_MASK;
+
+    SPI.beginTransaction(m_spiSettings);
+    MCP2515_SELECT();
+    spi_readwrite(MCP_WRITE);
+    spi_readwrite(ctrlRegs[txbuf]);                                     /* TXBnCTRL, then TXBnSIDH..    */
+    spi_readwrite(txPriority & MCP_TXB_TXP10_M);
+    for (i=0; i<4; i++)
+        spi_readwrite(tbufdata[i]);
+    spi_readwrite(dlc);
+    for (i=0; i<len; i++)
+        spi_readwrite(frame->data[i]);
+    MCP2515_UNSELECT();
+    SPI.endTransaction();
+
+    mcp2515_requestToSend(txbuf);
+    m_nTxPending |= txif;
+    return CAN_OK;
+}
+
+/*********************************************************************************************************
+** Function name:           getTXBusy
+** Descriptions:            Public function, Returns bit n set while TXBn has TXREQ set, from one
+**                          READ STATUS.
+*********************************************************************************************************/
+INT8U MCP_CAN::getTXBusy(void)
+{
+    INT8U status, busy, i;
+
+    status = mcp2515_readStatus();
+    busy = 0;
+    for (i=0; i<MCP_N_TXBUFFERS; i++)
     {
-        mcp2515_read_canMsg( MCP_RXBUF_1);
-        mcp2515_modifyRegister(MCP_CANINTF, MCP_RX1IF, 0);
-        res = CAN_OK;
+        if ( status & (MCP_STAT_TX0REQ << (i * 2)) )
+            busy |= 1 << i;
     }
+    return busy;
+}
+
+/*********************************************************************************************************
+** Function name:           checkTXComplete
+** Descriptions:            Public function, Returns TXnIF bits (MCP_TX0IF..MCP_TX2IF) of buffers queued
+**                          by sendMsgBufNB that have been transmitted since the last call.
+*********************************************************************************************************/
+INT8U MCP_CAN::checkTXComplete(void)
+{
+    INT8U status, done, i;
+
+    if (m_nTxPending == 0)
+        return 0;
+
+    status = mcp2515_readStatus();
+    done = 0;
+    for (i=0; i<MCP_N_TXBUFFERS; i++)
+    {
+        if ( status & (MCP_STAT_TX0IF << (i * 2)) )
+            done |= MCP_TX0IF << i;
+    }
+
+    done &= m_nTxPending;
+    if (done)
+    {
+        mcp2515_modifyRegister(MCP_CANINTF, done, 0);
+        m_nTxPending &= ~done;
+    }
+
+    return done;
+}
+
+/*********************************************************************************************************
+** Function name:           isTXPending
+** Descriptions:            Public function, Returns true while a frame queued by sendMsgBufNB has not
+**                          been reported by checkTXComplete().
+*********************************************************************************************************/
+bool MCP_CAN::isTXPending(void)
+{
+    return m_nTxPending != 0;
+}
+
+/*********************************************************************************************************
+** Function name:           readMsg
+** Descriptions:            Read the next message straight into the caller's storage
+*********************************************************************************************************/
+INT8U MCP_CAN::readMsg(INT32U *id, INT8U *flags, INT8U *len, INT8U buf[], INT8U *filterHit)
+{
+    INT8U stat;
+
+    stat = mcp2515_readRxStatus();
+
+    if ( stat & MCP_RXSTAT_RXB0 )                                       /* Msg in Buffer 0              */
+        mcp2515_read_canMsg( MCP_READ_RX0, id, flags, len, buf );
+    else if ( stat & MCP_RXSTAT_RXB1 )                                  /* Msg in Buffer 1              */
+        mcp2515_read_canMsg( MCP_READ_RX1, id, flags, len, buf );
     else 
-        res = CAN_NOMSG;
-    
-    return res;
+        return CAN_NOMSG;
+
+    *filterHit = stat & MCP_RXSTAT_FILHIT_MASK;
+    return CAN_OK;
 }
 
 /*********************************************************************************************************
@@ -1138,42 +1159,69 @@ INT8U MCP_CAN::readMsg()
 *********************************************************************************************************/
 INT8U MCP_CAN::readMsgBuf(INT32U *id, INT8U *ext, INT8U *len, INT8U buf[])
 {
-    if(readMsg() == CAN_NOMSG)
+    INT8U flags, filterHit;
+
+    if(readMsg(id, &flags, len, buf, &filterHit) == CAN_NOMSG)
 	return CAN_NOMSG;
 	
-    *id  = m_nID;
-    *len = m_nDlc;
-    *ext = m_nExtFlg;
-    for(int i = 0; i<m_nDlc; i++)
-        buf[i] = m_nDta[i];
-
+    *ext = (flags & CAN_FRAME_EXT) ? 1 : 0;
     return CAN_OK;
 }
 
 /*********************************************************************************************************
 ** Function name:           readMsgBuf
-** Descriptions:            Public function, Reads message from receive buffer.
+** Descriptions:            Public function, Reads message from receive buffer. Extended and remote
+**                          frames are flagged in bit 31 and 30 of the ID.
 *********************************************************************************************************/
 INT8U MCP_CAN::readMsgBuf(INT32U *id, INT8U *len, INT8U buf[])
 {
-    if(readMsg() == CAN_NOMSG)
+    INT8U flags, filterHit;
+
+    if(readMsg(id, &flags, len, buf, &filterHit) == CAN_NOMSG)
 	return CAN_NOMSG;
 
-    if (m_nExtFlg)
-        m_nID |= 0x80000000;
+    if (flags & CAN_FRAME_EXT)
+        *id |= 0x80000000;
 
-    if (m_nRtr)
-        m_nID |= 0x40000000;
-	
-    *id  = m_nID;
-    *len = m_nDlc;
-    
-    for(int i = 0; i<m_nDlc; i++)
-        buf[i] = m_nDta[i];
+    if (flags & CAN_FRAME_RTR)
+        *id |= 0x40000000;
 
     return CAN_OK;
 }
 
+/*********************************************************************************************************
+** Function name:           readFrame
+** Descriptions:            Public function, Reads the next frame straight into the caller's CanFrame,
+**                          with flags, filter hit and the micros() time it was read.
+*********************************************************************************************************/
+INT8U MCP_CAN::readFrame(CanFrame *frame)
+{
+    if (readMsg(&frame->id, &frame->flags, &frame->len, frame->data, &frame->filterHit) == CAN_NOMSG)
+        return CAN_NOMSG;
+
+    frame->timestamp = micros();
+    return CAN_OK;
+}
+
+/*********************************************************************************************************
+** Function name:           poll
+** Descriptions:            Public function, Passes received frames to handler until the controller is
+**                          empty or maxFrames have been handled. Frames are read into one CanFrame on
+**                          the stack and handed over by reference. Returns the number handled.
+*********************************************************************************************************/
+INT8U MCP_CAN::poll(void (*handler)(CanFrame &frame), INT8U maxFrames)
+{
+    CanFrame frame;
+    INT8U handled = 0;
+
+    while (handled < maxFrames && readFrame(&frame) == CAN_OK)
+    {
+        handler(frame);
+        handled++;
+    }
+    return handled;
+}
+
 /*********************************************************************************************************
 ** Function name:           checkReceive
 ** Descriptions:            Public function, Checks for received data.  (Used if not using the interrupt output)
@@ -1188,6 +1236,16 @@ INT8U MCP_CAN::checkReceive(void)
         return CAN_NOMSG;
 }
 
+/*********************************************************************************************************
+** Function name:           checkReceiveBuffers
+** Descriptions:            Public function, Returns MCP_RXSTAT_RXB0 and/or MCP_RXSTAT_RXB1 for buffers
+**                          holding a message, from a single RX STATUS byte.
+*********************************************************************************************************/
+INT8U MCP_CAN::checkReceiveBuffers(void)
+{
+    return mcp2515_readRxStatus() & MCP_RXSTAT_RXB_MASK;
+}
+
 /*********************************************************************************************************
 ** Function name:           checkError
 ** Descriptions:            Public function, Returns error register data.
@@ -1211,6 +1269,42 @@ INT8U MCP_CAN::getError(void)
     return mcp2515_readRegister(MCP_EFLG);
 }
 
+/*********************************************************************************************************
+** Function name:           checkMessageError
+** Descriptions:            Returns CAN_CTRLERROR if an error was seen while receiving or sending since
+**                          the last call, and clears MERRF. Set in listen-only mode too, so a wrong
+**                          bitrate shows up without the controller touching the bus.
+*********************************************************************************************************/
+INT8U MCP_CAN::checkMessageError(void)
+{
+    if (mcp2515_readRegister(MCP_CANINTF) & MCP_MERRF)
+    {
+        mcp2515_modifyRegister(MCP_CANINTF, MCP_MERRF, 0);
+        return CAN_CTRLERROR;
+    }
+    return CAN_OK;
+}
+
+/*********************************************************************************************************
+** Function name:           clearRxOverflow
+** Descriptions:            Clears RX0OVR and RX1OVR so overflows can be detected again
+*********************************************************************************************************/
+INT8U MCP_CAN::clearRxOverflow(void)
+{
+    mcp2515_modifyRegister(MCP_EFLG, MCP_EFLG_RX0OVR | MCP_EFLG_RX1OVR, 0);
+    return CAN_OK;
+}
+
+/*********************************************************************************************************
+** Function name:           getMode
+** Descriptions:            Returns operation mode from CANSTAT. A controller that has been reset by a
+**                          brownout reports MODE_CONFIG.
+*********************************************************************************************************/
+INT8U MCP_CAN::getMode(void)
+{
+    return mcp2515_readRegister(MCP_CANSTAT) & MODE_MASK;
+}
+
 /*********************************************************************************************************
 ** Function name:           mcp2515_errorCountRX
 ** Descriptions:            Returns REC register value
@@ -1270,6 +1364,31 @@ INT8U MCP_CAN::abortTX(void)
 	    return CAN_OK;
 }
 
+/*********************************************************************************************************
+** Function name:           sleep
+** Descriptions:            Public function, enters sleep mode with the wake-up interrupt enabled. Bus
+**                          activity sets WAKIF, asserts INT and wakes the controller into listen-only
+**                          mode. The frame that woke it is lost, the ones after it are received.
+*********************************************************************************************************/
+INT8U MCP_CAN::sleep(void)
+{
+    mcp2515_modifyRegister(MCP_CANINTF, MCP_WAKIF, 0);
+    mcp2515_modifyRegister(MCP_CANINTE, MCP_WAKIF, MCP_WAKIF);
+    return mcp2515_setCANCTRL_Mode(MCP_SLEEP);                          /* mcpMode is kept for wake()   */
+}
+
+/*********************************************************************************************************
+** Function name:           wake
+** Descriptions:            Public function, releases INT from the wake-up interrupt and returns to the
+**                          mode set before sleep(). Also wakes the controller if it is still asleep.
+*********************************************************************************************************/
+INT8U MCP_CAN::wake(void)
+{
+    mcp2515_modifyRegister(MCP_CANINTE, MCP_WAKIF, 0);
+    mcp2515_modifyRegister(MCP_CANINTF, MCP_WAKIF, 0);
+    return mcp2515_setCANCTRL_Mode(mcpMode);
+}
+
 /*********************************************************************************************************
 ** Function name:           setGPO
 ** Descriptions:            Public function, Checks for r
@@ -25,21 +25,36 @@
 #define _MCP2515_H_
 
 #include "mcp_can_dfs.h"
+#include "mcp_can_timing.h"
 #define MAX_CHAR_IN_MESSAGE 8
 
+#define CAN_FRAME_EXT       0x01                                        /* 29-bit identifier            */
+#define CAN_FRAME_RTR       0x02                                        /* Remote transmission request  */
+
+struct CanFrame
+{
+    INT32U  id;                                                         // CAN ID without flag bits
+    INT32U  timestamp;                                                  // micros() when the frame arrived
+    INT8U   flags;                                                      // CAN_FRAME_EXT, CAN_FRAME_RTR
+    INT8U   len;                                                        // Data Length Code, at most 8
+    INT8U   filterHit;                                                  // Filter that accepted the frame,
+                                                                        // 0-5, or 6/7 for RXF0/RXF1
+                                                                        // rolled over into RXB1
+    INT8U   data[MAX_CHAR_IN_MESSAGE];                                  // Data array
+};
+
 class MCP_CAN
 {
     private:
     
-    INT8U   m_nExtFlg;                                                  // Identifier Type
-                                                                        // Extended (29 bit) or Standard (11 bit)
-    INT32U  m_nID;                                                      // CAN ID
-    INT8U   m_nDlc;                                                     // Data Length Code
-    INT8U   m_nDta[MAX_CHAR_IN_MESSAGE];                            	// Data array
-    INT8U   m_nRtr;                                                     // Remote request flag
-    INT8U   m_nfilhit;                                                  // The number of the filter that matched the message
     INT8U   MCPCS;                                                      // Chip Select pin number
+#if defined(__AVR__)
+    volatile INT8U *m_nCsPort;                                          // Chip Select output port register
+    INT8U   m_nCsMask;                                                  // Chip Select bit in the port
+#endif
+    SPISettings m_spiSettings;                                          // Built once, not per transaction
     INT8U   mcpMode;                                                    // Mode to return to after configurations are performed.
+    INT8U   m_nTxPending;                                               // TXnIF bits of buffers queued by sendMsgNB
     
 
 /*********************************************************************************************************
@@ -70,18 +85,26 @@ class MCP_CAN
                                 const INT8U data);
 
     INT8U mcp2515_readStatus(void);                                     // Read MCP2515 Status
+    INT8U mcp2515_readRxStatus(void);                                   // Read MCP2515 RX Status
     INT8U mcp2515_setCANCTRL_Mode(const INT8U newmode);                 // Set mode
+    INT8U mcp2515_lookupBitTiming(const INT8U canSpeed,                 // Solve timing for CAN_xxxBPS
+                                  const INT8U canClock,
+                                  MCP_BitTiming *timing);
+    void mcp2515_setBitTiming(const MCP_BitTiming &timing);             // Write CNF registers
     INT8U mcp2515_configRate(const INT8U canSpeed,                      // Set baud rate
                              const INT8U canClock);
                              
     INT8U mcp2515_init(const INT8U canIDMode,                           // Initialize Controller
-                       const INT8U canSpeed,
-                       const INT8U canClock);
+                       const MCP_BitTiming &timing);
 		       
     void mcp2515_write_mf( const INT8U mcp_addr,                        // Write CAN Mask or Filter
                            const INT8U ext,
                            const INT32U id );
 			       
+    void mcp2515_encode_id( const INT8U ext,                            // Encode CAN ID to register layout
+                            const INT32U id,
+                            INT8U tbufdata[] );
+
     void mcp2515_write_id( const INT8U mcp_addr,                        // Write CAN ID
                            const INT8U ext,
                            const INT32U id );
@@ -90,22 +113,38 @@ class MCP_CAN
 				INT8U* ext,
                                 INT32U* id );
 
-    void mcp2515_write_canMsg( const INT8U buffer_sidh_addr );          // Write CAN message
-    void mcp2515_read_canMsg( const INT8U buffer_sidh_addr);            // Read CAN message
+    void mcp2515_write_canMsg( const INT8U buffer_sidh_addr,            // Write CAN message
+                               const INT32U id,
+                               const INT8U flags,
+                               INT8U len,
+                               const INT8U *buf );
+    void mcp2515_read_canMsg( const INT8U read_rx_instr,                // Read CAN message
+                              INT32U *id,
+                              INT8U *flags,
+                              INT8U *len,
+                              INT8U buf[] );
+    void mcp2515_load_canMsg( const INT8U txbuf_idx,                    // Load CAN message with LOAD TX
+                              const INT32U id,
+                              const INT8U flags,
+                              INT8U len,
+                              const INT8U *buf );
+    void mcp2515_requestToSend( const INT8U txbuf_idx );                // Request to send with RTS
     INT8U mcp2515_getNextFreeTXBuf(INT8U *txbuf_n);                     // Find empty transmit buffer
 
 /*********************************************************************************************************
  *  CAN operator function
  *********************************************************************************************************/
 
-    INT8U setMsg(INT32U id, INT8U rtr, INT8U ext, INT8U len, INT8U *pData);        // Set message
-    INT8U clearMsg();                                                   // Clear all message to zero
-    INT8U readMsg();                                                    // Read message
-    INT8U sendMsg();                                                    // Send message
+    INT8U readMsg(INT32U *id, INT8U *flags, INT8U *len,                // Read message
+                  INT8U buf[], INT8U *filterHit);
+    INT8U sendMsg(INT32U id, INT8U flags, INT8U len, const INT8U *buf); // Send message
+    INT8U sendMsgNB(INT32U id, INT8U flags, INT8U len,                  // Send message without waiting
+                    const INT8U *buf);
 
 public:
-    MCP_CAN(INT8U _CS);
+    MCP_CAN(INT8U _CS, INT32U spiClock = MCP_SPI_CLOCK);
     INT8U begin(INT8U idmodeset, INT8U speedset, INT8U clockset);       // Initialize controller parameters
+    INT8U begin(INT8U idmodeset, const MCP_BitTiming &timing);          // Initialize with solved bit timing
     INT8U init_Mask(INT8U num, INT8U ext, INT32U ulData);               // Initialize Mask(s)
     INT8U init_Mask(INT8U num, INT32U ulData);                          // Initialize Mask(s)
     INT8U init_Filt(INT8U num, INT8U ext, INT32U ulData);               // Initialize Filter(s)
@@ -113,16 +152,35 @@ public:
     INT8U setMode(INT8U opMode);                                        // Set operational mode
     INT8U sendMsgBuf(INT32U id, INT8U ext, INT8U len, INT8U *buf);      // Send message to transmit buffer
     INT8U sendMsgBuf(INT32U id, INT8U len, INT8U *buf);                 // Send message to transmit buffer
+    INT8U sendMsgBufNB(INT32U id, INT8U ext, INT8U len, INT8U *buf);    // Queue message without waiting for TX
+    INT8U sendMsgBufNB(INT32U id, INT8U len, INT8U *buf);               // Queue message without waiting for TX
+    INT8U sendFrame(const CanFrame *frame);                             // Send frame from caller storage
+    INT8U sendFrameNB(const CanFrame *frame);                           // Queue frame without waiting for TX
+    INT8U sendFrameNB(const CanFrame *frame,                            // Load given TX buffer with priority
+                      INT8U txbuf,
+                      INT8U txPriority);
+    INT8U getTXBusy(void);                                              // TXREQ of each TX buffer
+    INT8U checkTXComplete(void);                                        // Get and clear TXnIF of sent buffers
+    bool isTXPending(void);                                             // Any non-blocking send in flight
     INT8U readMsgBuf(INT32U *id, INT8U *ext, INT8U *len, INT8U *buf);   // Read message from receive buffer
     INT8U readMsgBuf(INT32U *id, INT8U *len, INT8U *buf);               // Read message from receive buffer
+    INT8U readFrame(CanFrame *frame);                                   // Read frame into caller storage
+    INT8U poll(void (*handler)(CanFrame &frame),                        // Hand received frames to handler
+               INT8U maxFrames = MCP_POLL_MAX_FRAMES);
     INT8U checkReceive(void);                                           // Check for received data
+    INT8U checkReceiveBuffers(void);                                    // Which RX buffers hold data
     INT8U checkError(void);                                             // Check for errors
     INT8U getError(void);                                               // Check for errors
+    INT8U checkMessageError(void);                                      // Get and clear MERRF
     INT8U errorCountRX(void);                                           // Get error count
     INT8U errorCountTX(void);                                           // Get error count
+    INT8U clearRxOverflow(void);                                        // Clear RX0OVR and RX1OVR
+    INT8U getMode(void);                                                // Get current operation mode
     INT8U enOneShotTX(void);                                            // Enable one-shot transmission
     INT8U disOneShotTX(void);                                           // Disable one-shot transmission
     INT8U abortTX(void);                                                // Abort queued transmission(s)
+    INT8U sleep(void);                                                  // Sleep until bus activity asserts INT
+    INT8U wake(void);                                                   // Back to the mode before sleep()
     INT8U setGPO(INT8U data);                                           // Sets GPO
     INT8U getGPI(void);                                                 // Reads GPI
 };
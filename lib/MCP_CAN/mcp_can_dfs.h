@@ -36,8 +36,10 @@
 #define INT8U byte
 #endif
 
-// if print debug information
-#define DEBUG_MODE 1
+// if print debug information, build with -DDEBUG_MODE=1
+#ifndef DEBUG_MODE
+#define DEBUG_MODE 0
+#endif
 
 /*
  *   Begin mt
@@ -72,11 +74,23 @@
 
 #define MCP_TXB_RTR_M       0x40                                        /* In TXBnDLC                   */
 #define MCP_RXB_IDE_M       0x08                                        /* In RXBnSIDL                  */
+#define MCP_RXB_SRR_M       0x10                                        /* In RXBnSIDL                  */
 #define MCP_RXB_RTR_M       0x40                                        /* In RXBnDLC                   */
 
 #define MCP_STAT_RXIF_MASK   (0x03)
 #define MCP_STAT_RX0IF       (1<<0)
 #define MCP_STAT_RX1IF       (1<<1)
+#define MCP_STAT_TX0REQ      (1<<2)
+#define MCP_STAT_TX0IF       (1<<3)
+#define MCP_STAT_TX1REQ      (1<<4)
+#define MCP_STAT_TX1IF       (1<<5)
+#define MCP_STAT_TX2REQ      (1<<6)
+#define MCP_STAT_TX2IF       (1<<7)
+
+#define MCP_RXSTAT_RXB0      (1<<6)                                     /* RX STATUS instruction result */
+#define MCP_RXSTAT_RXB1      (1<<7)
+#define MCP_RXSTAT_RXB_MASK  (0xC0)
+#define MCP_RXSTAT_FILHIT_MASK (0x07)                                   /* Filter match of the frame    */
 
 #define MCP_EFLG_RX1OVR     (1<<7)
 #define MCP_EFLG_RX0OVR     (1<<6)
@@ -411,8 +425,15 @@
 #define MCP_RXBUF_0 (MCP_RXB0SIDH)
 #define MCP_RXBUF_1 (MCP_RXB1SIDH)
 
+#define MCP_SPI_CLOCK (10000000)
+
+#if defined(__AVR__)
+#define MCP2515_SELECT()   (*m_nCsPort &= ~m_nCsMask)                   /* ~2 cycles vs ~50 for digitalWrite */
+#define MCP2515_UNSELECT() (*m_nCsPort |= m_nCsMask)
+#else
 #define MCP2515_SELECT()   digitalWrite(MCPCS, LOW)
 #define MCP2515_UNSELECT() digitalWrite(MCPCS, HIGH)
+#endif
 
 #define MCP2515_OK         (0)
 #define MCP2515_FAIL       (1)
@@ -471,9 +492,11 @@
 #define CAN_CTRLERROR      (5)
 #define CAN_GETTXBFTIMEOUT (6)
 #define CAN_SENDMSGTIMEOUT (7)
+#define CAN_TXBUSY         (8)
 #define CAN_FAIL       (0xff)
 
 #define CAN_MAX_CHAR_IN_MESSAGE (8)
+#define MCP_POLL_MAX_FRAMES     (16)                                    /* Frames per poll() call       */
 
 #endif
 /*********************************************************************************************************
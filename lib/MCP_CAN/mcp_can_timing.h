@@ -0,0 +1,115 @@
+/*
+  mcp_can_timing.h
+
+  Bit timing solver for the MCP2515. Computes CNF1/CNF2/CNF3 for any crystal
+  and bitrate instead of looking them up from fixed tables.
+
+  One bit is SyncSeg (1 TQ) + PropSeg (1-8) + PS1 (1-8) + PS2 (2-8), 5 to 25
+  time quanta, and TQ = 2 * (BRP + 1) / Fosc with BRP 0-63.
+*/
+#ifndef _MCP2515TIMING_H_
+#define _MCP2515TIMING_H_
+
+#include "mcp_can_dfs.h"
+
+#define MCP_MIN_TQ                  5
+#define MCP_MAX_TQ                  25
+#define MCP_MAX_BRP                 64
+#define MCP_DEFAULT_SAMPLE_POINT    750                                 /* per mille                    */
+#define MCP_DEFAULT_SJW             2
+#define MCP_MAX_BITRATE_ERROR_PPM   5000
+#define MCP_MIN_BITRATE             1000                                /* Below the range of any crystal */
+
+struct MCP_BitTiming
+{
+    INT8U   cfg1;
+    INT8U   cfg2;
+    INT8U   cfg3;
+    INT32U  bitrate;                                                    // Bitrate actually produced
+    INT32U  errorPpm;                                                   // Distance from requested bitrate
+    uint16_t samplePoint;                                               // Per mille
+};
+
+/*********************************************************************************************************
+** Function name:           mcp2515_calcBitTiming
+** Descriptions:            Pick the BRP and segment lengths with the smallest bitrate error, then the
+**                          sample point closest to the requested one, then the most time quanta.
+**                          errorPpm is 0xFFFFFFFF if the bitrate can not be produced at all.
+*********************************************************************************************************/
+constexpr MCP_BitTiming mcp2515_calcBitTiming(const INT32U oscHz, const INT32U bitrate,
+                                              const uint16_t samplePoint = MCP_DEFAULT_SAMPLE_POINT,
+                                              const INT8U sjw = MCP_DEFAULT_SJW,
+                                              const bool tripleSample = false)
+{
+    MCP_BitTiming best = { 0, 0, 0, 0, 0xFFFFFFFF, 0 };
+    uint16_t bestSpError = 0xFFFF;
+
+    if (bitrate < MCP_MIN_BITRATE)                                      /* errorPpm divides by bitrate / 1000 */
+        return best;
+
+    for (INT8U tq = MCP_MAX_TQ; tq >= MCP_MIN_TQ; tq--)
+    {
+        INT32U div = 2UL * tq * bitrate;
+        INT32U brp = (oscHz + div / 2) / div;                           /* BRP + 1                      */
+        if (brp < 1 || brp > MCP_MAX_BRP)
+            continue;
+
+        INT8U ps2 = (tq * (1000 - samplePoint) + 500) / 1000;
+        if (ps2 < 2)
+            ps2 = 2;
+        INT8U rem = tq - 1 - ps2;                                       /* PropSeg + PS1                */
+        if (rem > 16)
+        {
+            rem = 16;
+            ps2 = tq - 1 - rem;
+        }
+        if (ps2 > 8 || rem < 2 || rem < ps2)
+            continue;
+
+        INT32U actual = oscHz / (2UL * tq * brp);
+        INT32U diff = actual > bitrate ? actual - bitrate : bitrate - actual;
+        INT32U errorPpm = diff < 4294 ? diff * 1000000UL / bitrate      /* avoid 32-bit overflow        */
+                                      : diff * 1000UL / (bitrate / 1000);
+        uint16_t sp = (uint16_t)(1 + rem) * 1000 / tq;
+        uint16_t spError = sp > samplePoint ? sp - samplePoint : samplePoint - sp;
+
+        if (errorPpm > best.errorPpm || (errorPpm == best.errorPpm && spError >= bestSpError))
+            continue;
+
+        INT8U ps1 = (rem + 1) / 2;
+        INT8U prop = rem - ps1;
+        INT8U sjwLen = sjw < 1 ? 1 : sjw;
+        if (sjwLen >= ps2)                                              /* PS2 must be longer than SJW  */
+            sjwLen = ps2 - 1;
+        if (sjwLen > 4)
+            sjwLen = 4;
+
+        best.cfg1 = ((sjwLen - 1) << 6) | (brp - 1);
+        best.cfg2 = BTLMODE | (tripleSample ? SAMPLE_3X : SAMPLE_1X) | ((ps1 - 1) << 3) | (prop - 1);
+        best.cfg3 = SOF_DISABLE | WAKFIL_DISABLE | (ps2 - 1);
+        best.bitrate = actual;
+        best.errorPpm = errorPpm;
+        best.samplePoint = sp;
+        bestSpError = spError;
+    }
+
+    return best;
+}
+
+/*********************************************************************************************************
+** Function name:           mcpBitTiming
+** Descriptions:            Compile time bit timing. Fails to compile if the bitrate error is too high.
+*********************************************************************************************************/
+template <INT32U OSC_HZ, INT32U BITRATE, uint16_t SAMPLE_POINT = MCP_DEFAULT_SAMPLE_POINT,
+          INT8U SJW = MCP_DEFAULT_SJW, INT32U MAX_ERROR_PPM = MCP_MAX_BITRATE_ERROR_PPM>
+constexpr MCP_BitTiming mcpBitTiming()
+{
+    static_assert(mcp2515_calcBitTiming(OSC_HZ, BITRATE, SAMPLE_POINT, SJW).errorPpm <= MAX_ERROR_PPM,
+                  "Bitrate error too high for this crystal");
+    return mcp2515_calcBitTiming(OSC_HZ, BITRATE, SAMPLE_POINT, SJW);
+}
+
+#endif
+/*********************************************************************************************************
+  END FILE
+*********************************************************************************************************/
@@ -0,0 +1,120 @@
+#include "PowerManager.h"
+#include "../util/util.h"
+#if defined(__AVR__)
+#include <avr/sleep.h>
+
+static uint8_t wakeInterrupt;
+
+// INT stays low until WAKIF is cleared, a level interrupt would keep firing
+static void onWakeInterrupt()
+{
+    detachInterrupt(wakeInterrupt);
+}
+#endif
+
+/*
+  onSleep runs before powering down and onWake right after frames are taken
+  again, for the LEDs and anything else that must not run while asleep.
+*/
+PowerManager::PowerManager(CanController *CAN, CanReceiver *receiver, uint8_t intPin, void (*onSleep)(), void (*onWake)())
+{
+    this->CAN = CAN;
+    _receiver = receiver;
+    _intPin = intPin;
+    _onSleep = onSleep;
+    _onWake = onWake;
+    _lastFrameAt = 0;
+    _wokeAt = 0;
+    _isWaking = false;
+    memset(&stats, 0, sizeof(stats));
+}
+/*
+  Call for every received frame.
+*/
+void PowerManager::onFrame(const CanFrame &frame)
+{
+    _lastFrameAt = millis();
+    if (_isWaking)
+    {
+        _isWaking = false;
+        stats.firstFrameUs = frame.timestamp - _wokeAt;
+        stats.maxFirstFrameUs = util::maxVal(stats.maxFirstFrameUs, stats.firstFrameUs);
+#if DEBUG
+        Serial.print("WAKE restore us: ");
+        Serial.print(stats.restoreUs);
+        Serial.print(" first frame us: ");
+        Serial.println(stats.firstFrameUs);
+#endif
+    }
+}
+
+void PowerManager::update()
+{
+    if (millis() - _lastFrameAt >= CAN_SLEEP_IDLE_MS)
+    {
+        sleep();
+    }
+}
+
+void PowerManager::sleep()
+{
+    DEBUG_MESSAGE("SLEEP");
+#if DEBUG
+    Serial.flush();
+#endif
+    _onSleep();
+    _receiver->suspend();
+    if (CAN->sleep() != MCP2515_OK)
+    {
+        // Try again after another idle period
+        stats.failedSleeps++;
+        CAN->wake();
+        _receiver->resume();
+        _onWake();
+        _lastFrameAt = millis();
+        return;
+    }
+
+    powerDown();
+
+    // WAKIF is cleared first, otherwise INT stays low and the receiver never sees an edge
+    _wokeAt = micros();
+    CAN->wake();
+    _receiver->resume();
+    stats.restoreUs = micros() - _wokeAt;
+    stats.sleeps++;
+    _isWaking = true;
+    _lastFrameAt = millis();
+    _onWake();
+}
+/*
+  Returns once INT is pulled low by the controller.
+*/
+void PowerManager::powerDown()
+{
+#if defined(__AVR__)
+    uint8_t adcsra = ADCSRA;
+    ADCSRA = 0; // The ADC draws current in power-down unless disabled
+
+    wakeInterrupt = digitalPinToInterrupt(_intPin);
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    noInterrupts();
+    // Only a low level wakes from power-down, edge detection needs the I/O clock
+    attachInterrupt(wakeInterrupt, onWakeInterrupt, LOW);
+    sleep_enable();
+#ifdef BODS
+    sleep_bod_disable();
+#endif
+    interrupts(); // sleep_cpu() still runs first, an INT already low then wakes it at once
+    sleep_cpu();
+    sleep_disable();
+
+    ADCSRA = adcsra;
+#else
+    // Host builds let time pass until the model sees bus activity
+    while (digitalRead(_intPin) == HIGH)
+    {
+        delay(1);
+    }
+#endif
+}
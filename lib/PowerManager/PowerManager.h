@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../../include/can_controller.h"
+#include "../../include/defines.h"
+#include "../CanReceiver/CanReceiver.h"
+
+/*
+  Powers down when the bus goes quiet and comes back on bus activity.
+
+  After CAN_SLEEP_IDLE_MS without a frame the MCP2515 is put to sleep with
+  its wake-up interrupt enabled and the AVR goes to power-down on the INT
+  pin. The frame that wakes the controller is lost. The controller then
+  listens until wake() restores its mode, so the frames after it are kept
+  as long as the restore takes less than two frame times.
+
+  On wake stats.restoreUs is the time from leaving power-down until frames
+  are taken again, and stats.firstFrameUs until the first frame arrived.
+  Neither includes the crystal start-up of the AVR, 16K clocks or 1 ms on
+  the Nano, as micros() does not run in power-down.
+*/
+class PowerManager
+{
+public:
+    struct Stats
+    {
+        uint16_t sleeps;
+        uint16_t failedSleeps; // Controller did not enter sleep mode
+        uint32_t restoreUs;
+        uint32_t firstFrameUs;
+        uint32_t maxFirstFrameUs;
+    };
+
+    PowerManager(CanController *CAN, CanReceiver *receiver, uint8_t intPin, void (*onSleep)(), void (*onWake)());
+    void onFrame(const CanFrame &frame);
+    void update();
+
+    Stats stats;
+
+private:
+    void sleep();
+    void powerDown();
+
+    uint32_t _lastFrameAt;
+    uint32_t _wokeAt;
+    bool _isWaking; // First frame after wake not seen yet
+    uint8_t _intPin;
+    void (*_onSleep)();
+    void (*_onWake)();
+    CanReceiver *_receiver;
+    CanController *CAN;
+};
@@ -0,0 +1,390 @@
+#include "SlcanGateway.h"
+#include "../util/util.h"
+
+#define SLCAN_OK   '\r'
+#define SLCAN_BELL '\a'
+
+// S0-S8
+static const uint32_t slcanBitrates[] PROGMEM = {
+    10000, 20000, 50000, 100000, 125000, 250000, 500000, 800000, 1000000};
+
+static bool parseHex(const char *str, uint8_t digits, uint32_t *value)
+{
+    *value = 0;
+    for (uint8_t i = 0; i < digits; i++)
+    {
+        char c = str[i];
+        uint8_t nibble;
+        if (c >= '0' && c <= '9')
+            nibble = c - '0';
+        else if (c >= 'A' && c <= 'F')
+            nibble = c - 'A' + 10;
+        else if (c >= 'a' && c <= 'f')
+            nibble = c - 'a' + 10;
+        else
+            return false;
+        *value = *value << 4 | nibble;
+    }
+    return true;
+}
+
+SlcanGateway::SlcanGateway(CanController *CAN, CanReceiver *receiver, CanTxQueue *txQueue, HardwareSerial *serial)
+{
+    this->CAN = CAN;
+    _receiver = receiver;
+    _txQueue = txQueue;
+    _serial = serial;
+    _fill = 0;
+    _fillLength = 0;
+    _drainLength = 0;
+    _drainAt = 0;
+    _lineLength = 0;
+    _isOverlong = false;
+    _timing = I_BUS;
+    _mode = MODE_CONFIG;
+    _isTimestamped = false;
+    memset(&stats, 0, sizeof(stats));
+}
+/*
+  Start the controller with the selected bitrate and put it back in the
+  mode it was opened in. Closed leaves it in configuration mode, off the bus.
+  Used as the reinit of the health monitor, which only runs while open.
+*/
+bool SlcanGateway::restart()
+{
+    if (CAN->begin(MCP_STDEXT, _timing) != CAN_OK)
+    {
+        return false;
+    }
+    // begin() leaves the masks open, every frame is passed on
+    return CAN->setMode(_mode) == MCP2515_OK;
+}
+
+void SlcanGateway::update()
+{
+    readCommands();
+
+    CanFrame frame;
+    while (_mode != MODE_CONFIG && hasRoom(SLCAN_MAX_FRAME_LINE) && _receiver->read(&frame))
+    {
+        writeFrame(frame);
+    }
+    flush();
+}
+
+bool SlcanGateway::isOpen() const
+{
+    return _mode != MODE_CONFIG;
+}
+/*
+  Commands are only taken while their reply fits, the rest wait in the
+  serial RX buffer.
+*/
+void SlcanGateway::readCommands()
+{
+    while (hasRoom(SLCAN_MAX_REPLY) && _serial->available() > 0)
+    {
+        char c = _serial->read();
+        if (c == '\n')
+        {
+            continue;
+        }
+        if (c != '\r')
+        {
+            if (_lineLength < SLCAN_MAX_COMMAND)
+                _line[_lineLength++] = c;
+            else
+                _isOverlong = true;
+            continue;
+        }
+
+        if (_isOverlong || (_lineLength && !execute()))
+        {
+            stats.refused++;
+            put(SLCAN_BELL);
+        }
+        _lineLength = 0;
+        _isOverlong = false;
+    }
+}
+/*
+  Run the command in _line. Replies other than a plain CR are written here,
+  false means the command is answered with BELL.
+*/
+bool SlcanGateway::execute()
+{
+    uint32_t value;
+
+    switch (_line[0])
+    {
+    case 'S':
+        if (_lineLength != 2 || _line[1] < '0' || _line[1] > '8' || isOpen())
+        {
+            return false;
+        }
+        return setBitrate(pgm_read_dword(&slcanBitrates[_line[1] - '0']), MCP_DEFAULT_SAMPLE_POINT, MCP_DEFAULT_SJW);
+    case 's':
+    {
+        // BTR0 and BTR1 of an SJA1000 at 16 MHz, turned into a bitrate for our crystal
+        if (_lineLength != 5 || !parseHex(_line + 1, 4, &value) || isOpen())
+        {
+            return false;
+        }
+        uint8_t brp = (value >> 8 & 0x3F) + 1;
+        uint8_t sjw = (value >> 14 & 0x03) + 1;
+        uint8_t tseg1 = (value & 0x0F) + 1;
+        uint8_t tseg2 = (value >> 4 & 0x07) + 1;
+        uint8_t tq = 1 + tseg1 + tseg2;
+        return setBitrate(SLCAN_BTR_CLOCK_HZ / (2UL * brp * tq), 1000 * (1 + tseg1) / tq, sjw);
+    }
+    case 'O':
+        return _lineLength == 1 && open(MCP_NORMAL);
+    case 'L':
+        return _lineLength == 1 && open(MCP_LISTENONLY);
+    case 'C':
+        if (_lineLength != 1)
+        {
+            return false;
+        }
+        _mode = MODE_CONFIG;
+        _txQueue->clear();
+        CAN->setMode(MODE_CONFIG);
+        break;
+    case 't':
+    case 'T':
+    case 'r':
+    case 'R':
+        if (!transmit())
+        {
+            return false;
+        }
+        put(_line[0] == 't' || _line[0] == 'r' ? 'z' : 'Z');
+        break;
+    case 'F':
+        if (_lineLength != 1 || !isOpen())
+        {
+            return false;
+        }
+        put('F');
+        putHex(getStatusFlags(), 2);
+        break;
+    case 'Z':
+        if (_lineLength != 2 || (_line[1] != '0' && _line[1] != '1'))
+        {
+            return false;
+        }
+        _isTimestamped = _line[1] == '1';
+        break;
+    case 'M':
+    case 'm':
+        // Acceptance code and mask, the masks stay open
+        if (_lineLength != 9 || !parseHex(_line + 1, 8, &value))
+        {
+            return false;
+        }
+        break;
+    case 'V':
+        put('V');
+        putHex(SLCAN_VERSION, 4);
+        break;
+    case 'N':
+        put('N');
+        putHex(SLCAN_SERIAL_NUMBER, 4);
+        break;
+    default:
+        return false;
+    }
+    put(SLCAN_OK);
+    return true;
+}
+
+bool SlcanGateway::setBitrate(uint32_t bitrate, uint16_t samplePoint, uint8_t sjw)
+{
+    // Same solver mcp2515_configRate() runs for the CAN_xxxBPS constants
+    MCP_BitTiming timing = mcp2515_calcBitTiming(MCP_OSC_HZ, bitrate, samplePoint, sjw);
+    if (timing.errorPpm > MCP_MAX_BITRATE_ERROR_PPM)
+    {
+        return false;
+    }
+    _timing = timing;
+    return true;
+}
+
+bool SlcanGateway::open(uint8_t mode)
+{
+    if (isOpen())
+    {
+        return false;
+    }
+
+    _mode = mode;
+    if (!restart())
+    {
+        _mode = MODE_CONFIG;
+        CAN->setMode(MODE_CONFIG);
+        return false;
+    }
+
+    // Nothing was received while closed, except what came in before closing
+    CanFrame frame;
+    while (_receiver->read(&frame))
+    {
+    }
+    return true;
+}
+/*
+  Parse t/T/r/R and push the frame to the TX queue. Refused while closed,
+  listen-only or when the queue is full, so the tool sees the loss.
+*/
+bool SlcanGateway::transmit()
+{
+    CanFrame frame;
+    bool isExtended = _line[0] == 'T' || _line[0] == 'R';
+    bool isRemote = _line[0] == 'r' || _line[0] == 'R';
+    uint8_t idDigits = isExtended ? 8 : 3;
+    uint32_t value;
+
+    if (_mode != MCP_NORMAL || _lineLength < idDigits + 2)
+    {
+        return false;
+    }
+    if (!parseHex(_line + 1, idDigits, &value) || value > (isExtended ? 0x1FFFFFFFUL : 0x7FFUL))
+    {
+        return false;
+    }
+    frame.id = value;
+    if (!parseHex(_line + 1 + idDigits, 1, &value) || value > 8)
+    {
+        return false;
+    }
+    frame.len = value;
+    frame.flags = (isExtended ? CAN_FRAME_EXT : 0) | (isRemote ? CAN_FRAME_RTR : 0);
+    frame.filterHit = 0;
+    frame.timestamp = micros();
+
+    const char *data = _line + 2 + idDigits;
+    uint8_t dataBytes = isRemote ? 0 : frame.len;
+    if (_lineLength != 2 + idDigits + 2 * dataBytes)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < dataBytes; i++)
+    {
+        if (!parseHex(data + 2 * i, 2, &value))
+        {
+            return false;
+        }
+        frame.data[i] = value;
+    }
+
+    if (!_txQueue->push(frame))
+    {
+        return false;
+    }
+    stats.transmitted++;
+    return true;
+}
+/*
+  Lawicel status flags from the queues and EFLG.
+*/
+uint8_t SlcanGateway::getStatusFlags()
+{
+    uint8_t eflg = CAN->getError();
+    uint8_t flags = 0;
+
+    if (_receiver->available() == CAN_RX_QUEUE_SIZE - 1)
+        flags |= 0x01; // RX queue full, the ring holds one less than its size
+    if (_txQueue->size() == CAN_TX_QUEUE_SIZE)
+        flags |= 0x02; // TX queue full
+    if (eflg & MCP_EFLG_EWARN)
+        flags |= 0x04; // Error warning
+    if (eflg & (MCP_EFLG_RX0OVR | MCP_EFLG_RX1OVR))
+        flags |= 0x08; // Data overrun
+    if (eflg & (MCP_EFLG_RXEP | MCP_EFLG_TXEP))
+        flags |= 0x20; // Error passive
+    if (eflg & MCP_EFLG_TXBO)
+        flags |= 0x80; // Bus error
+    return flags;
+}
+/*
+  tiiiLdd..[tttt] or Tiiiiiiiildd..[tttt], timestamp in ms modulo 60000.
+*/
+void SlcanGateway::writeFrame(const CanFrame &frame)
+{
+    bool isExtended = frame.flags & CAN_FRAME_EXT;
+    bool isRemote = frame.flags & CAN_FRAME_RTR;
+    uint8_t len = frame.len > 8 ? 8 : frame.len;
+
+    put(isRemote ? (isExtended ? 'R' : 'r') : (isExtended ? 'T' : 't'));
+    putHex(frame.id, isExtended ? 8 : 3);
+    putHex(len, 1);
+    if (!isRemote)
+    {
+        for (uint8_t i = 0; i < len; i++)
+        {
+            putHex(frame.data[i], 2);
+        }
+    }
+    if (_isTimestamped)
+    {
+        putHex(util::millisAt(frame.timestamp) % 60000, 4);
+    }
+    put('\r');
+    stats.received++;
+}
+
+void SlcanGateway::putHex(uint32_t value, uint8_t digits)
+{
+    while (digits--)
+    {
+        uint8_t nibble = value >> (4 * digits) & 0x0F;
+        put(nibble < 10 ? '0' + nibble : 'A' + nibble - 10);
+    }
+}
+/*
+  Callers check hasRoom() for the whole line first.
+*/
+void SlcanGateway::put(char c)
+{
+    _buffers[_fill][_fillLength++] = c;
+}
+
+bool SlcanGateway::hasRoom(uint8_t length)
+{
+    if (SLCAN_TX_BUFFER_SIZE - _fillLength >= length)
+    {
+        return true;
+    }
+    flush();
+    return SLCAN_TX_BUFFER_SIZE - _fillLength >= length;
+}
+/*
+  Hand the serial port as much as it takes without blocking, swapping
+  buffers whenever the draining one empties. One write per buffer chunk.
+*/
+void SlcanGateway::flush()
+{
+    for (;;)
+    {
+        if (_drainAt == _drainLength)
+        {
+            if (!_fillLength)
+            {
+                return;
+            }
+            _drainLength = _fillLength;
+            _drainAt = 0;
+            _fillLength = 0;
+            _fill ^= 1;
+        }
+
+        int space = _serial->availableForWrite();
+        if (space <= 0)
+        {
+            return;
+        }
+        uint8_t count = util::minVal<int>(space, _drainLength - _drainAt);
+        _serial->write(_buffers[_fill ^ 1] + _drainAt, count);
+        _drainAt += count;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../../include/can_controller.h"
+#include "../../include/defines.h"
+#include "../CanReceiver/CanReceiver.h"
+#include "../CanTxQueue/CanTxQueue.h"
+
+#define SLCAN_MAX_COMMAND    26 // T, 8 ID digits, DLC and 16 data digits
+#define SLCAN_MAX_FRAME_LINE 31 // Longest receive line: T, ID, DLC, data, timestamp and CR
+#define SLCAN_MAX_REPLY      6  // V0101 and CR
+#define SLCAN_BTR_CLOCK_HZ   16000000UL // sxxyy gives SJA1000 BTR0/BTR1 for this clock
+#define SLCAN_VERSION        0x0101
+#define SLCAN_SERIAL_NUMBER  0x0007
+
+/*
+  Lawicel SLCAN adapter on the serial port, for slcand, SavvyCAN and other
+  tools that speak it.
+
+  Supported commands: S0-S8 and sxxyy (bitrate, while closed), O (open), L
+  (open listen-only), C (close), t/T/r/R (transmit), F (status flags), Z0/Z1
+  (timestamps off/on), V and N. M and m are accepted, all IDs are received.
+
+  Output goes to one of two buffers while the other drains to the serial
+  port, never more at once than the port takes without blocking. Received
+  frames are only taken from the CanReceiver while a whole line fits, so a
+  slow port backs up into the receive queue instead of losing frames here.
+*/
+class SlcanGateway
+{
+public:
+    struct Stats
+    {
+        uint32_t received;    // Frames written to the serial port
+        uint32_t transmitted; // Frames pushed to the TX queue
+        uint16_t refused;     // Commands answered with BELL
+    };
+
+    SlcanGateway(CanController *CAN, CanReceiver *receiver, CanTxQueue *txQueue, HardwareSerial *serial);
+    bool restart();
+    void update();
+    bool isOpen() const;
+
+    Stats stats;
+
+private:
+    void readCommands();
+    bool execute();
+    bool setBitrate(uint32_t bitrate, uint16_t samplePoint, uint8_t sjw);
+    bool open(uint8_t mode);
+    bool transmit();
+    uint8_t getStatusFlags();
+    void writeFrame(const CanFrame &frame);
+    void putHex(uint32_t value, uint8_t digits);
+    void put(char c);
+    bool hasRoom(uint8_t length);
+    void flush();
+
+    uint8_t _buffers[2][SLCAN_TX_BUFFER_SIZE];
+    uint8_t _fill; // Buffer being filled, the other one drains
+    uint8_t _fillLength;
+    uint8_t _drainLength;
+    uint8_t _drainAt;
+    char _line[SLCAN_MAX_COMMAND];
+    uint8_t _lineLength;
+    bool _isOverlong;
+
+    MCP_BitTiming _timing;
+    uint8_t _mode; // MODE_CONFIG while closed
+    bool _isTimestamped;
+
+    CanReceiver *_receiver;
+    CanTxQueue *_txQueue;
+    HardwareSerial *_serial;
+    CanController *CAN;
+};
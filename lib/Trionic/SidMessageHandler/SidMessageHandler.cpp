@@ -1,44 +1,60 @@
 #include "SidMessageHandler.h"
 
-SidMessageHandler::SidMessageHandler(MCP_CAN *CAN)
+SidMessageHandler::SidMessageHandler(CanTxQueue *txQueue)
+    : _rowArbiter(txQueue, CAN_ID::RADIO_PRIORITY, 2, RADIO)
 {
-    this->CAN = CAN;
+    _txQueue = txQueue;
     _isReceivedMessageComplete = false;
+    _isTxEnabled = true;
     _user.messageDisplayTime = 0;
     _user.messageSentAt = 0;
+    _user.messageLength = 0;
+    _user.priority = SidMessagePriority::Low;
+    _queueCount = 0;
+    memset(_priorities, 0, sizeof(_priorities));
     _displayedMessage = DisplayedMessage::Trionic;
+    _sending.pendingParts = 0;
+    memset(_rows, 0, sizeof(_rows));
+    _txLosses = txQueue->stats.expired + txQueue->stats.cleared;
+    scroll.stepMs = SID_SCROLL_STEP_MS;
+    scroll.stepChars = SID_SCROLL_STEP_CHARS;
+    scroll.pauseMs = SID_SCROLL_PAUSE_MS;
+    scroll.isLooping = SID_SCROLL_LOOP;
 }
 
 /**
- * Forward received messages to here
+ * Forward received messages to here, receivedAt is the millis() time the frame arrived
  */
-void SidMessageHandler::onReceive(unsigned long id, uint8_t *data)
+void SidMessageHandler::onReceive(unsigned long id, uint8_t *data, uint32_t receivedAt)
 {
     // Only handle messages coming from radio
     if (id != static_cast<unsigned long>(CAN_ID::RADIO_MSG)) return;
 
-    // This is how the messages are ordered. First we will receive 42, then 1 and then 0.
-    if (data[0] == 42)
-    {
-        memcpy(_receivedMessageBuffer, data, 8);
-        _isReceivedMessageComplete = false;
-        return;
-    }
+    updateShadow(data);
 
-    if (data[0] == 1)
+    // This is how the messages are ordered. First we will receive 0x42, then 1 and then 0.
+    uint8_t part = getPart(data[0]);
+    if (part >= SID_MESSAGE_PARTS) return;
+
+    memcpy(_receivedMessageBuffer + part * 8, data, 8);
+    if (part == 0)
     {
-        memcpy(_receivedMessageBuffer + 8, data, 8);
+        // The radio's new message takes the row over from ours or a restore
+        if (isSending() && getRow(data) == getRow(_sending.buffer))
+        {
+            abortSending();
+        }
+        _isReceivedMessageComplete = false;
         return;
     }
 
-    if (data[0] == 0)
+    if (part == SID_MESSAGE_PARTS - 1)
     {
-        memcpy(_receivedMessageBuffer + 16, data, 8);
         _displayedMessage = DisplayedMessage::Trionic;
         _isReceivedMessageComplete = true;
 
         // When receiving last message, check has user message been displayed for enough time and if not, resend
-        if (_user.messageSentAt + _user.messageDisplayTime > millis())
+        if (receivedAt - _user.messageSentAt < _user.messageDisplayTime)
         {
             sendMessage(_user.messageBuffer, DisplayedMessage::User);
         }
@@ -52,9 +68,30 @@ void SidMessageHandler::onReceive(unsigned long id, uint8_t *data)
  */
 void SidMessageHandler::update()
 {
+    checkTxLosses();
+
+    // Requests are held back with the rest of our frames
+    if (_isTxEnabled)
+    {
+        _rowArbiter.update(isRowNeeded(millis()), isRowGranted(2, RADIO));
+    }
+
+    // Nothing new is started until the message in flight is complete, new
+    // user messages and the radio resends supersede it right away
+    if (isSending())
+    {
+        advanceSending();
+        return;
+    }
+
     uint32_t now = millis();
+    // The next queued message takes over from one that has had its time
+    if (_queueCount && !isUserMessageActive(now) && showNext(now))
+    {
+        return;
+    }
     // Check if user message has been displayed for too long
-    if (_isReceivedMessageComplete && _displayedMessage == DisplayedMessage::User && _user.messageSentAt + _user.messageDisplayTime < now)
+    if (_isReceivedMessageComplete && _displayedMessage == DisplayedMessage::User && !isUserMessageActive(now))
     {
         sendMessage(_receivedMessageBuffer, DisplayedMessage::Trionic);
         return;
@@ -66,80 +103,443 @@ void SidMessageHandler::update()
     }
 
     // Check if we need to roll the message in case it is too long
-    uint8_t msgLength = _user.messageLength - _messageRolling.rollingIndex;
-    if (msgLength > SID_MAX_CHAR && now - _messageRolling.lastRolledAt > _messageRolling.rollingDelay) 
+    if (_user.messageLength > SID_MAX_CHAR && isUserMessageActive(now) &&
+        now - _messageRolling.lastRolledAt >= getScrollDelay())
+    {
+        _messageRolling.lastRolledAt = now;
+        if (scrollStep())
+        {
+            sendMessage(_user.messageBuffer, DisplayedMessage::User);
+        }
+    }
+}
+/*
+  Move the text scroll.stepChars left within the frames, the last step
+  only up to the end, and pull in the next characters instead of building
+  the whole message again. Returns false at the end of the text unless
+  scrolling loops.
+*/
+bool SidMessageHandler::scrollStep()
+{
+    uint8_t lastIndex = _user.messageLength - SID_MAX_CHAR;
+    if (_messageRolling.rollingIndex == lastIndex)
+    {
+        if (!scroll.isLooping)
+        {
+            return false;
+        }
+        _messageRolling.rollingIndex = 0;
+        constructMessage(_user.messageString, _user.messageBuffer, _user.messageLength);
+        return true;
+    }
+
+    uint8_t shift = util::minVal<uint8_t>(getStepChars(), lastIndex - _messageRolling.rollingIndex);
+    uint8_t *buffer = _user.messageBuffer;
+    for (uint8_t i = 0; i < SID_MAX_CHAR - shift; i++)
+    {
+        buffer[getCharOffset(i)] = buffer[getCharOffset(i + shift)];
+    }
+    _messageRolling.rollingIndex += shift;
+    for (uint8_t i = SID_MAX_CHAR - shift; i < SID_MAX_CHAR; i++)
+    {
+        buffer[getCharOffset(i)] = _user.messageString[_messageRolling.rollingIndex + i];
+    }
+    return true;
+}
+/*
+  The text stays still for scroll.pauseMs at both ends.
+*/
+uint16_t SidMessageHandler::getScrollDelay() const
+{
+    uint8_t lastIndex = _user.messageLength - SID_MAX_CHAR;
+    if (_messageRolling.rollingIndex == 0 || _messageRolling.rollingIndex == lastIndex)
+    {
+        return scroll.pauseMs;
+    }
+    return scroll.stepMs;
+}
+/*
+  From showing the start of the text to the end of the pause after its end.
+*/
+uint16_t SidMessageHandler::getScrollTime(uint8_t length) const
+{
+    if (length <= SID_MAX_CHAR)
+    {
+        return 0;
+    }
+    uint8_t steps = (length - SID_MAX_CHAR + getStepChars() - 1) / getStepChars();
+    return 2 * scroll.pauseMs + steps * scroll.stepMs;
+}
+
+uint8_t SidMessageHandler::getStepChars() const
+{
+    return util::maxVal<uint8_t>(scroll.stepChars, 1);
+}
+/*
+  Position of a visible character in the message buffer, five per frame
+  after the order, id and row bytes.
+*/
+uint8_t SidMessageHandler::getCharOffset(uint8_t position)
+{
+    return position / 5 * 8 + 3 + position % 5;
+}
+/*
+  Index of a frame within its message from the order byte, 0 for the first
+  one. SID_MESSAGE_PARTS or more if it is not a message frame.
+*/
+uint8_t SidMessageHandler::getPart(uint8_t order)
+{
+    uint8_t partsLeft = order & 0x3F;
+    return partsLeft < SID_MESSAGE_PARTS ? SID_MESSAGE_PARTS - 1 - partsLeft : SID_MESSAGE_PARTS;
+}
+/*
+  Shadow of the row a frame is written to, nullptr if it is not row 1 or 2.
+*/
+SidMessageHandler::SidRow *SidMessageHandler::getRow(const uint8_t *frame)
+{
+    if (frame[2] < 1 || frame[2] > 2)
+    {
+        return nullptr;
+    }
+    return &_rows[frame[2] - 1];
+}
+/*
+  The SID keeps the latest frame of each part and shows them together when
+  the last part arrives. Until then the row shows something we no longer
+  know, unless none of the parts changed.
+*/
+void SidMessageHandler::updateShadow(const uint8_t *frame)
+{
+    SidRow *row = getRow(frame);
+    uint8_t part = getPart(frame[0]);
+    if (!row || part >= SID_MESSAGE_PARTS)
     {
-        msgLength--;
-        _messageRolling.rollingIndex++;
+        return;
+    }
 
-        char *addr = _user.messageString + _messageRolling.rollingIndex;
-        constructMessage(addr, _user.messageBuffer, msgLength);
+    uint8_t *shadow = row->frames + part * 8;
+    if (memcmp(shadow, frame, 8))
+    {
+        memcpy(shadow, frame, 8);
+        row->isShown = false;
+    }
+    row->knownParts |= 1 << part;
+    if (part == SID_MESSAGE_PARTS - 1)
+    {
+        row->isShown = row->knownParts == (1 << SID_MESSAGE_PARTS) - 1;
+    }
+}
+/*
+  Our frames count as shown once queued, as they are not received back. A
+  frame the TX queue expired or cleared, e.g. on sleep or a restart, never
+  reached the SID: forget what the rows show and send the message in flight
+  or showing again.
+*/
+void SidMessageHandler::checkTxLosses()
+{
+    uint16_t losses = _txQueue->stats.expired + _txQueue->stats.cleared;
+    if (losses == _txLosses)
+    {
+        return;
+    }
+    _txLosses = losses;
+    memset(_rows, 0, sizeof(_rows));
+    if (isSending())
+    {
+        _sending.pendingParts = (1 << SID_MESSAGE_PARTS) - 1;
+    }
+    else if (_displayedMessage == DisplayedMessage::User && isUserMessageActive(millis()))
+    {
         sendMessage(_user.messageBuffer, DisplayedMessage::User);
-        _messageRolling.lastRolledAt = now;
     }
 }
+/*
+  Whether the row of the message already shows it.
+*/
+bool SidMessageHandler::isShown(const uint8_t *buffer)
+{
+    SidRow *row = getRow(buffer);
+    return row && row->isShown && !memcmp(row->frames, buffer, sizeof(row->frames));
+}
 
-// In the future queueing the message could be better
+/*
+  Queue the first frame of the message now and the others from update(),
+  SID_PART_GAP_MS apart. All three go out even if some did not change, a
+  partial update has not been checked against a real SID. A message still
+  in flight is abandoned.
+*/
 bool SidMessageHandler::sendMessage(uint8_t *buffer, DisplayedMessage displayedMessage)
 {
-    if (!isAllowedToWrite(2, RADIO)) return false;    
+    if (!isAllowedToWrite(2, RADIO)) return false;
 
-    for (uint8_t i = 0; i < 3; i++)
+    abortSending();
+    if (isShown(buffer))
     {
-        uint8_t *addr = buffer + i * 8;
-        CAN->sendMsgBuf(static_cast<unsigned long>(CAN_ID::RADIO_MSG), 0, 8, addr);
-        // No need to delay last iteration
-        if (i != 2) {
-            delay(10);
-        }
+        _displayedMessage = displayedMessage;
+        return true;
+    }
+
+    memcpy(_sending.buffer, buffer, sizeof(_sending.buffer));
+    _sending.displayedMessage = displayedMessage;
+    _sending.pendingParts = (1 << SID_MESSAGE_PARTS) - 1;
+    if (!sendNextPart())
+    {
+        _sending.pendingParts = 0;
+        return false;
+    }
+    return true;
+}
+
+bool SidMessageHandler::isSending() const
+{
+    return _sending.pendingParts;
+}
+/*
+  Stop the message in flight and drop its parts still in the TX queue. The
+  SID may hold some of them, so the row is no longer known and the next
+  message starts over from its first part and the 0x42 order byte.
+*/
+void SidMessageHandler::abortSending()
+{
+    if (!isSending())
+    {
+        return;
+    }
+    _txQueue->drop(static_cast<unsigned long>(CAN_ID::RADIO_MSG));
+    SidRow *row = getRow(_sending.buffer);
+    if (row)
+    {
+        row->knownParts = 0;
+        row->isShown = false;
+    }
+    _sending.pendingParts = 0;
+}
+/*
+  Frame is only queued, the TX queue keeps the parts in order.
+*/
+bool SidMessageHandler::sendNextPart()
+{
+    uint8_t part = 0;
+    while (!(_sending.pendingParts & 1 << part))
+    {
+        part++;
+    }
+
+    CanFrame frame;
+    frame.id = static_cast<unsigned long>(CAN_ID::RADIO_MSG);
+    frame.flags = 0;
+    frame.len = 8;
+    memcpy(frame.data, _sending.buffer + part * 8, 8);
+    if (!_txQueue->push(frame))
+    {
+        return false;
     }
 
-    _displayedMessage = displayedMessage;
+    // Our own frames are not received back, see checkTxLosses()
+    updateShadow(frame.data);
+    _sending.partQueuedAt = millis();
+    _sending.pendingParts &= ~(1 << part);
+    if (!_sending.pendingParts)
+    {
+        _displayedMessage = _sending.displayedMessage;
+    }
     return true;
 }
+/*
+  Queue the next frame once the gap has passed. A full TX queue is retried
+  on the next call, losing the row abandons the message.
+*/
+void SidMessageHandler::advanceSending()
+{
+    if (millis() - _sending.partQueuedAt < SID_PART_GAP_MS)
+    {
+        return;
+    }
+    if (!isAllowedToWrite(2, RADIO))
+    {
+        abortSending();
+        return;
+    }
+    sendNextPart();
+}
 /**
  * Maximum length for the message is MESSAGE_MAX_LENGTH, overlapping chararctes will not be displayed.
- * Strings longer than 12 characters will be rolled visible on the SID
+ * Strings longer than 12 characters will be rolled visible on the SID, and stay
+ * up for at least one pass of the text.
+ * Returns false if the queue is full of messages that rank at least as high.
  */
-bool SidMessageHandler::sendMessage(const char *buffer, uint16_t displayTime)
+bool SidMessageHandler::sendMessage(const char *message, uint16_t displayTime, SidMessagePriority priority,
+                                    uint16_t timeoutMs)
 {
-    _messageRolling.rollingIndex = 0;
-    _user.messageLength = util::minVal<uint8_t>(strlen(buffer), MESSAGE_MAX_LENGTH);
-    if (_user.messageLength > SID_MAX_CHAR)
+    uint32_t now = millis();
+    uint8_t length = util::minVal<size_t>(strlen(message), MESSAGE_MAX_LENGTH);
+
+    // Repeats, such as quick presses of the same button, keep the message up
+    if (isUserMessageActive(now) && isShowing(message, length))
+    {
+        _user.messageSentAt = now;
+        _user.messageDisplayTime = util::maxVal(displayTime, getScrollTime(length));
+        _user.priority = util::maxVal(_user.priority, priority);
+        return true;
+    }
+    for (uint8_t i = 0; i < _queueCount; i++)
+    {
+        if (_queue[i].length == length && !memcmp(_queue[i].message, message, length))
+        {
+            _queue[i].deadline = now + timeoutMs;
+            _queue[i].displayTime = displayTime;
+            _queue[i].priority = util::maxVal(_queue[i].priority, priority);
+            return true;
+        }
+    }
+
+    dropExpired(now);
+    if (_queueCount == SID_QUEUE_SIZE)
+    {
+        // Make room by dropping the oldest of the lowest priority
+        uint8_t lowest = 0;
+        for (uint8_t i = 1; i < _queueCount; i++)
+        {
+            if (_queue[i].priority < _queue[lowest].priority)
+            {
+                lowest = i;
+            }
+        }
+        if (_queue[lowest].priority >= priority)
+        {
+            return false;
+        }
+        removeQueued(lowest);
+    }
+
+    QueuedMessage *queued = &_queue[_queueCount++];
+    memcpy(queued->message, message, length);
+    queued->length = length;
+    queued->deadline = now + timeoutMs;
+    queued->displayTime = displayTime;
+    queued->priority = priority;
+    _rowArbiter.retry();
+
+    if (!isUserMessageActive(now) || priority > _user.priority)
+    {
+        showNext(now);
+    }
+    return true;
+}
+
+/*
+  Row is kept while messages wait or show, and until the radio's message
+  has been put back.
+*/
+bool SidMessageHandler::isRowNeeded(uint32_t now) const
+{
+    if (_queueCount || isSending())
+    {
+        return true;
+    }
+    return _displayedMessage == DisplayedMessage::User && (isUserMessageActive(now) || _isReceivedMessageComplete);
+}
+
+bool SidMessageHandler::isUserMessageActive(uint32_t now) const
+{
+    return now - _user.messageSentAt < _user.messageDisplayTime;
+}
+
+bool SidMessageHandler::isShowing(const char *message, uint8_t length) const
+{
+    return length == _user.messageLength && !memcmp(message, _user.messageString, length);
+}
+/*
+  Show the highest priority message in the queue, oldest first. It stays
+  queued while the row is not ours or the TX queue is full.
+*/
+bool SidMessageHandler::showNext(uint32_t now)
+{
+    dropExpired(now);
+    if (!_queueCount || !isAllowedToWrite(2, RADIO))
     {
-        // For example:
-        // displayTime = 1000
-        // Message length = 13
-        // Overlap = 13 - 12 = 1
-        // RollingDelay = 1000 / (1 + 1) = 500
-        _messageRolling.rollingDelay = displayTime / ((_user.messageLength - SID_MAX_CHAR) + 1);
+        return false;
+    }
 
-        // Store the original string for rolling the text
-        memcpy(_user.messageString, buffer, _user.messageLength);
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < _queueCount; i++)
+    {
+        if (_queue[i].priority > _queue[best].priority)
+        {
+            best = i;
+        }
     }
+    if (!showMessage(_queue[best], now))
+    {
+        return false;
+    }
+    removeQueued(best);
+    return true;
+}
+
+bool SidMessageHandler::showMessage(const QueuedMessage &queued, uint32_t now)
+{
+    _messageRolling.rollingIndex = 0;
+    _user.messageLength = queued.length;
+    // Store the original string for rolling the text and spotting repeats
+    memcpy(_user.messageString, queued.message, _user.messageLength);
     // Store the constructed message in buffer
-    constructMessage(buffer, _user.messageBuffer, _user.messageLength);
+    constructMessage(queued.message, _user.messageBuffer, _user.messageLength);
     if (!sendMessage(_user.messageBuffer, DisplayedMessage::User))
     {
         return false;
     }
 
-    _user.messageSentAt = millis();
-    _messageRolling.lastRolledAt = _user.messageSentAt;
-    _user.messageDisplayTime = displayTime;
+    _user.messageSentAt = now;
+    _messageRolling.lastRolledAt = now;
+    _user.messageDisplayTime = util::maxVal(queued.displayTime, getScrollTime(_user.messageLength));
+    _user.priority = queued.priority;
     return true;
 }
+/*
+  Stale messages are dropped instead of shown late.
+*/
+void SidMessageHandler::dropExpired(uint32_t now)
+{
+    uint8_t i = 0;
+    while (i < _queueCount)
+    {
+        if ((int32_t)(now - _queue[i].deadline) >= 0)
+        {
+            removeQueued(i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void SidMessageHandler::removeQueued(uint8_t index)
+{
+    _queueCount--;
+    memmove(&_queue[index], &_queue[index + 1], (_queueCount - index) * sizeof(QueuedMessage));
+}
 /**
  * Cancels the last message user has sent if it is displayed and sends the original by Trionic
  */
 void SidMessageHandler::cancelMessage()
 {
-    if (_displayedMessage == DisplayedMessage::Trionic)
+    // The SID keeps showing what it had until the last frame of a message
+    bool isSendingUser = isSending() && _sending.displayedMessage == DisplayedMessage::User;
+    if (isSendingUser)
+    {
+        abortSending();
+    }
+    else if (_displayedMessage == DisplayedMessage::Trionic)
     {
         return;
     }
 
-    sendMessage(_receivedMessageBuffer, DisplayedMessage::Trionic);
+    if (_displayedMessage == DisplayedMessage::User)
+    {
+        sendMessage(_receivedMessageBuffer, DisplayedMessage::Trionic);
+    }
     _user.messageDisplayTime = 0;
     _user.messageSentAt = 0;
 }
@@ -194,14 +594,34 @@ void SidMessageHandler::constructMessage(const char *message, uint8_t *buffer, u
 */
 void SidMessageHandler::setPriority(uint8_t row, uint8_t priority)
 {
+    if (row >= sizeof(_priorities)) return;
     _priorities[row] = priority;
 }
+/*
+  Holds back all SID writes, used while the CAN controller is error-passive.
+*/
+void SidMessageHandler::setTxEnabled(bool isEnabled)
+{
+    _isTxEnabled = isEnabled;
+}
+
+const SidRowArbiter &SidMessageHandler::getRowArbiter() const
+{
+    return _rowArbiter;
+}
 /*
   Check priority for SID rows to see if it's wise to overwrite them.
   If both rows are used, write is not allowed.
   If priority for requested row is equal to your device id, write is allowed.
 */
 bool SidMessageHandler::isAllowedToWrite(uint8_t row, uint8_t writeAs)
+{
+    if (!_isTxEnabled)
+        return false;
+    return isRowGranted(row, writeAs);
+}
+
+bool SidMessageHandler::isRowGranted(uint8_t row, uint8_t writeAs) const
 {
     if (_priorities[0] != 0xFF)
         return false;
@@ -1,9 +1,38 @@
 #include <Arduino.h>
-#include "mcp_can.h"
+#include "../../include/can_controller.h"
+#include "../CanTxQueue/CanTxQueue.h"
+#include "../SidRowArbiter/SidRowArbiter.h"
 #include "../../include/defines.h"
 #include "../../include/communication.h"
 #include "../util/util.h"
 
+enum class SidMessagePriority : uint8_t
+{
+    Low,
+    Normal,
+    High
+};
+
+/*
+  User messages on SID row 2, in between the radio's own messages.
+
+  sendMessage() queues a copy of the text for up to SID_QUEUE_SIZE
+  messages. The highest priority one is shown as soon as the current
+  message has had its display time, or right away if it outranks it. A message that repeats the
+  one showing or one already queued only refreshes it, and one that could
+  not be shown before its timeout is dropped.
+
+  Text longer than SID_MAX_CHAR scrolls as set in scroll. Each step shifts
+  the text in place by scroll.stepChars, fewer steps send fewer frames.
+
+  A shadow of each row follows every RADIO_MSG frame on the bus, the
+  radio's and ours. A message the row already shows is not sent again,
+  any other goes out as all three frames, scroll steps included. The
+  shadow is forgotten whenever the TX queue loses frames.
+
+  Row 2 is asked for from the SID while there is something to show on it,
+  messages wait in the queue until it is granted.
+*/
 class SidMessageHandler
 {
     enum class DisplayedMessage : uint8_t
@@ -13,17 +42,66 @@ class SidMessageHandler
     };
 
 public:
-    SidMessageHandler(MCP_CAN *CAN);
-    void onReceive(unsigned long id, uint8_t *data);
-    bool sendMessage(const char *buffer, uint16_t displayTime);
+    SidMessageHandler(CanTxQueue *txQueue);
+    void onReceive(unsigned long id, uint8_t *data, uint32_t receivedAt);
+    bool sendMessage(const char *message, uint16_t displayTime,
+                     SidMessagePriority priority = SidMessagePriority::Normal,
+                     uint16_t timeoutMs = SID_MESSAGE_TIMEOUT_MS);
     void setPriority(uint8_t row, uint8_t priority);
     bool isAllowedToWrite(uint8_t row, uint8_t writeAs);
     void update();
     void cancelMessage();
+    void setTxEnabled(bool isEnabled);
+    const SidRowArbiter &getRowArbiter() const;
+
+    struct {
+        uint16_t stepMs;   // Per step
+        uint8_t stepChars; // Characters moved per step
+        uint16_t pauseMs;  // At both ends of the text
+        bool isLooping;   // Start over after the end pause while the message is up
+    } scroll;
 
 private:
+    struct SidRow
+    {
+        uint8_t frames[24];  // Latest frame of each part on the bus
+        uint8_t knownParts;  // Bit per part seen since start up
+        bool isShown;        // No part has changed since the last one latched them
+    };
+
+    struct QueuedMessage
+    {
+        char message[MESSAGE_MAX_LENGTH]; // Copied, the caller's buffer may change
+        uint8_t length;
+        uint32_t deadline;
+        uint16_t displayTime;
+        SidMessagePriority priority;
+    };
+
+    bool isRowNeeded(uint32_t now) const;
+    bool isRowGranted(uint8_t row, uint8_t writeAs) const;
+    bool isUserMessageActive(uint32_t now) const;
+    bool isShowing(const char *message, uint8_t length) const;
+    bool showNext(uint32_t now);
+    bool showMessage(const QueuedMessage &queued, uint32_t now);
+    void dropExpired(uint32_t now);
+    void removeQueued(uint8_t index);
     bool sendMessage(uint8_t *buffer, DisplayedMessage displayedMessage);
+    bool isSending() const;
+    void abortSending();
+    bool sendNextPart();
+    void advanceSending();
     void constructMessage(const char *message, uint8_t *buffer, uint8_t length);
+    bool scrollStep();
+    uint16_t getScrollDelay() const;
+    uint16_t getScrollTime(uint8_t length) const;
+    uint8_t getStepChars() const;
+    static uint8_t getCharOffset(uint8_t position);
+    static uint8_t getPart(uint8_t order);
+    SidRow *getRow(const uint8_t *frame);
+    void updateShadow(const uint8_t *frame);
+    bool isShown(const uint8_t *buffer);
+    void checkTxLosses();
 
     struct {
         // Original string is stored here in case we need to roll it
@@ -33,17 +111,33 @@ private:
         uint8_t messageBuffer[24];
         uint32_t messageSentAt;
         uint16_t messageDisplayTime;
+        SidMessagePriority priority;
     } _user;
 
+    QueuedMessage _queue[SID_QUEUE_SIZE]; // Oldest first
+    uint8_t _queueCount;
+
+    // Message whose frames are being queued, SID_PART_GAP_MS apart
+    struct {
+        uint8_t buffer[24];
+        uint8_t pendingParts; // Bit per frame still to queue, 0 when idle
+        uint32_t partQueuedAt;
+        DisplayedMessage displayedMessage;
+    } _sending;
+
     struct {
         uint8_t rollingIndex;
-        uint16_t rollingDelay;
         uint32_t lastRolledAt;
     } _messageRolling;
 
+    SidRow _rows[2]; // Rows 1 and 2 as the SID has them
+    uint16_t _txLosses; // Expired and cleared count of the TX queue
+
     bool _isReceivedMessageComplete;
+    bool _isTxEnabled;
     uint8_t _receivedMessageBuffer[24];
     uint8_t _priorities[3];
     DisplayedMessage _displayedMessage;
-    MCP_CAN *CAN;
+    CanTxQueue *_txQueue;
+    SidRowArbiter _rowArbiter;
 };
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "SidRowArbiter.h"
+
+SidRowArbiter::SidRowArbiter(CanTxQueue *txQueue, CAN_ID requestId, uint8_t row, uint8_t deviceId)
+{
+    _txQueue = txQueue;
+    _requestId = requestId;
+    _row = row;
+    _deviceId = deviceId;
+    _state = State::Idle;
+    _requestedAt = 0;
+    _sentAt = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+/*
+  Call from every loop. isNeeded is whether there is something to show on
+  the row, isGranted whether TEXT_PRIORITY currently gives it to us.
+*/
+void SidRowArbiter::update(bool isNeeded, bool isGranted)
+{
+    uint32_t now = millis();
+
+    if (!isNeeded)
+    {
+        if (_state != State::Idle) // A timed out request can still be granted later
+        {
+            sendRequest(SID_ROW_RELEASE);
+        }
+        _state = State::Idle;
+        return;
+    }
+
+    if (isGranted)
+    {
+        if (_state == State::Requesting || _state == State::TimedOut)
+        {
+            uint32_t waitMs = now - _requestedAt;
+            if (_state == State::TimedOut) // Granted late, _requestedAt moved on at the timeout
+            {
+                waitMs += SID_ROW_GRANT_TIMEOUT_MS;
+            }
+            stats.maxWaitMs = util::maxVal<uint32_t>(stats.maxWaitMs, util::minVal<uint32_t>(waitMs, 0xFFFF));
+            stats.grants++;
+            _state = State::Granted;
+        }
+        if (_state == State::Granted && now - _sentAt >= SID_ROW_REFRESH_MS)
+        {
+            sendRequest(SID_ROW_REQUEST);
+        }
+        return;
+    }
+
+    switch (_state)
+    {
+    case State::Idle:
+    case State::Granted: // Taken away while in use
+        startRequest(now);
+        break;
+    case State::Requesting:
+        if (now - _requestedAt >= SID_ROW_GRANT_TIMEOUT_MS)
+        {
+            stats.timeouts++;
+            _state = State::TimedOut;
+            _requestedAt = now;
+        }
+        else if (now - _sentAt >= SID_ROW_REQUEST_MS)
+        {
+            sendRequest(SID_ROW_REQUEST);
+        }
+        break;
+    case State::TimedOut:
+        if (now - _requestedAt >= SID_ROW_RETRY_MS)
+        {
+            startRequest(now);
+        }
+        break;
+    }
+}
+/*
+  A new message asks for the row again without waiting out the backoff.
+*/
+void SidRowArbiter::retry()
+{
+    if (_state == State::TimedOut)
+    {
+        _state = State::Idle;
+    }
+}
+
+SidRowArbiter::State SidRowArbiter::getState() const
+{
+    return _state;
+}
+void SidRowArbiter::startRequest(uint32_t now)
+{
+    _state = State::Requesting;
+    _requestedAt = now;
+    sendRequest(SID_ROW_REQUEST);
+}
+/*
+  A request that does not fit in the TX queue is retried on the interval.
+*/
+bool SidRowArbiter::sendRequest(uint8_t level)
+{
+    CanFrame frame;
+    frame.id = static_cast<unsigned long>(_requestId);
+    frame.flags = 0;
+    frame.len = 8;
+    memset(frame.data, 0, sizeof(frame.data));
+    frame.data[REQUEST_IDK] = 0x11; // Unknown, the same in every request seen on the bus
+    frame.data[REQUEST_ROW] = _row;
+    frame.data[REQUEST_LEVEL] = level;
+    frame.data[REQUEST_ID] = _deviceId;
+
+    _sentAt = millis();
+    if (!_txQueue->push(frame, CanTxPriority::High))
+    {
+        return false;
+    }
+    stats.requests++;
+    return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../../include/can_controller.h"
+#include "../CanTxQueue/CanTxQueue.h"
+#include "../../include/defines.h"
+#include "../../include/communication.h"
+#include "../util/util.h"
+
+/*
+  Asks the SID for a text row and holds it while it is needed.
+
+  The SID hands out rows on TEXT_PRIORITY, the owner's id per row. While
+  there is something to show on a row that is not ours, a request is sent
+  every SID_ROW_REQUEST_MS until the grant is seen or SID_ROW_GRANT_TIMEOUT_MS
+  has passed. After a timeout the row is asked for again once
+  SID_ROW_RETRY_MS has passed, or right away when retry() is called for a
+  new message. A row we asked for is asked for again every SID_ROW_REFRESH_MS
+  while in use and released afterwards. A row that was ours without asking
+  is left alone, it belongs to the device we write as.
+*/
+class SidRowArbiter
+{
+public:
+    enum class State : uint8_t
+    {
+        Idle,
+        Requesting,
+        Granted,
+        TimedOut // Until SID_ROW_RETRY_MS has passed, retry() or a late grant
+    };
+
+    struct
+    {
+        uint16_t requests;
+        uint16_t grants;
+        uint16_t timeouts;
+        uint16_t maxWaitMs; // Longest request to grant
+    } stats;
+
+    SidRowArbiter(CanTxQueue *txQueue, CAN_ID requestId, uint8_t row, uint8_t deviceId);
+    void update(bool isNeeded, bool isGranted);
+    void retry();
+    State getState() const;
+
+private:
+    void startRequest(uint32_t now);
+    bool sendRequest(uint8_t level);
+
+    CanTxQueue *_txQueue;
+    CAN_ID _requestId;
+    uint8_t _row;
+    uint8_t _deviceId;
+    State _state;
+    uint32_t _requestedAt; // Or timed out, while TimedOut
+    uint32_t _sentAt;
+};
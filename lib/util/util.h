@@ -1,5 +1,7 @@
 #pragma once
 
+#include <Arduino.h>
+
 namespace util
 {
     template <typename T>
@@ -13,4 +15,13 @@ namespace util
     {
         return a > b ? a : b;
     }
+
+    /*
+      Convert a micros() timestamp, such as CanFrame::timestamp, to the
+      millis() time base. Works across either counter wrapping.
+    */
+    inline uint32_t millisAt(uint32_t timestampUs)
+    {
+        return millis() - (micros() - timestampUs) / 1000;
+    }
 }
\ No newline at end of file
@@ -4,16 +4,90 @@
 */
 
 #include <Arduino.h>
-#include "mcp_can.h"
+#include "can_controller.h"
 #include "defines.h"
 #include "communication.h"
 #include "headers.h"
 #include "LEDController.h"
 #include "SidMessageHandler/SidMessageHandler.h"
+#include "CanReceiver.h"
+#include "CanFilterPlanner.h"
+#include "CanHealthMonitor.h"
+#include "CanTiming.h"
+#include "CanTxQueue.h"
+#include "CanScheduler.h"
+#include "CanSniffer.h"
+#include "SlcanGateway.h"
+#include "CanAutoBaud.h"
+#include "PowerManager.h"
+#include "LoopProfiler.h"
 
-MCP_CAN CAN(CAN_CS_PIN);
+#ifdef CAN_SOCKETCAN
+CanController CAN(CAN_INTERFACE);
+#else
+CanController CAN(CAN_CS_PIN);
+#endif
 LEDController ledController;
-SidMessageHandler sidMessageHandler(&CAN);
+CanTxQueue canTxQueue(&CAN);
+SidMessageHandler sidMessageHandler(&canTxQueue);
+#if CAN_AUTOBAUD
+// Auto-baud candidates, the index found is kept in EEPROM
+constexpr MCP_BitTiming canBitTimings[] = {I_BUS, P_BUS};
+constexpr uint8_t CAN_BUS_PBUS = 1;
+MCP_BitTiming canBitTiming = I_BUS;
+bool isOnPBus; // Plugged into the P-BUS, only listen and use its filters
+#else
+constexpr MCP_BitTiming canBitTiming = I_BUS;
+constexpr bool isOnPBus = false;
+#endif
+constexpr CanFilterPlan canFilterPlan = canFilter::plan(HANDLED_CAN_IDS);
+static_assert(canFilterPlan.falseAccepts <= CAN_FILTER_MAX_FALSE_ACCEPTS, "CAN filters let too many unhandled IDs through");
+constexpr CanFilterPlan pbusFilterPlan = canFilter::plan(PBUS_HANDLED_CAN_IDS);
+
+CanReceiver canReceiver(&CAN, CAN_INT_PIN);
+CanHealthMonitor canHealth(&CAN, initCan);
+CanScheduler canScheduler;
+
+#if CAN_PBUS
+#ifdef CAN_SOCKETCAN
+CanController pbusCan(CAN_PBUS_INTERFACE);
+#else
+CanController pbusCan(PBUS_CS_PIN);
+#endif
+CanReceiver pbusReceiver(&pbusCan, PBUS_INT_PIN);
+CanHealthMonitor pbusHealth(&pbusCan, initPBus);
+#endif
+#if CAN_SLEEP
+PowerManager powerManager(&CAN, &canReceiver, CAN_INT_PIN, onSleep, onWake);
+#endif
+#if CAN_TIMING_STATS
+CanTiming canTiming;
+uint32_t canTimingReportedAt;
+#endif
+#if CAN_SNIFFER
+static_assert(!DEBUG, "DEBUG messages would corrupt the sniffer stream");
+CanSniffer canSniffer(&Serial);
+#endif
+#if CAN_SLCAN
+static_assert(!DEBUG && !CAN_SNIFFER, "SLCAN needs the serial port to itself");
+static_assert(!CAN_PBUS, "SLCAN is a single channel adapter");
+SlcanGateway slcanGateway(&CAN, &canReceiver, &canTxQueue, &Serial);
+#endif
+
+#if LOOP_PROFILER
+static_assert(!CAN_SNIFFER && !CAN_SLCAN, "The profiler dump would corrupt the serial stream");
+LoopProfiler loopProfiler;
+#define LOOP_STAGE(stage) loopProfiler.endStage(LoopStage::stage);
+#else
+#define LOOP_STAGE(stage)
+#endif
+
+#if CAN_RX_INTERRUPT
+void onCanInterrupt()
+{
+    canReceiver.onInterrupt();
+}
+#endif
 
 bool isBluetoothEnabled;
 bool isNightPanelEnabled;
@@ -28,27 +102,206 @@ void setup()
 {
     isBluetoothEnabled = false;
     isNightPanelEnabled = false;
-#if DEBUG
+#if DEBUG || LOOP_PROFILER
     Serial.begin(115200);
+#endif
+#if CAN_SNIFFER
+    Serial.begin(CAN_SNIFFER_BAUD);
+    canSniffer.begin();
+#endif
+#if CAN_SLCAN
+    Serial.begin(SLCAN_BAUD);
 #endif
     ledController.init();
     pinMode(BUTTON_PIN, INPUT);
     pinMode(BLUETOOTH_PIN0, OUTPUT);
     pinMode(BLUETOOTH_PIN1, OUTPUT);
     pinMode(TRANSISTOR_PIN, OUTPUT);
-    while (CAN.begin(MCP_ANY, I_BUS, MCP_8MHZ) != CAN_OK)
+#if CAN_AUTOBAUD
+    detectCanBus();
+#endif
+    while (!initCan())
     {
         delay(100);
     }
-    CAN.setMode(MCP_NORMAL);
+#if DEBUG
+    Serial.print("CAN filter false accepts: ");
+    Serial.println(canFilterPlan.falseAccepts);
+#endif
+#if CAN_RX_INTERRUPT
+    canReceiver.init(onCanInterrupt);
+#endif
+#if CAN_PBUS
+    // A missing P-BUS must not hold up the I-BUS, pbusHealth keeps retrying
+    initPBus();
+#ifndef CAN_SOCKETCAN
+    pbusReceiver.initPolled();
+#endif
+    // 500 kbps fills the two RX buffers ten times faster, service it first.
+    // Its frames wait in the controller without a timestamp, so no maxWait.
+#if CAN_SNIFFER
+    canScheduler.add(&pbusReceiver, sniffPBusFrame, PBUS_RX_BUDGET_US, 0);
+#else
+    canScheduler.add(&pbusReceiver, handlePBusFrame, PBUS_RX_BUDGET_US, 0);
+#endif
+#endif
+#if CAN_SLCAN
+    // Frames are taken by slcanGateway as fast as the serial port drains them
+#elif CAN_SNIFFER
+    canScheduler.add(&canReceiver, sniffIBusFrame, CAN_RX_BUDGET_US, CAN_RX_MAX_WAIT_US);
+#else
+    canScheduler.add(&canReceiver, isOnPBus ? handlePBusFrame : handleCanFrame, CAN_RX_BUDGET_US, CAN_RX_MAX_WAIT_US);
+#endif
+#if LOOP_PROFILER
+    loopProfiler.begin();
+#endif
 }
 
 void loop()
 {
+#if CAN_SLCAN
+    slcanGateway.update();
+    // Closed leaves the controller in configuration mode, not a reset to recover from
+    if (slcanGateway.isOpen())
+    {
+        canHealth.update();
+    }
+    canTxQueue.update();
+#else
+#if LOOP_PROFILER
+    loopProfiler.startLoop();
+#endif
     readCanBus();
+    LOOP_STAGE(CanRead)
+    canHealth.update();
+#if CAN_PBUS
+    pbusHealth.update();
+#endif
+#if CAN_SNIFFER
+    // Only listens, nothing else may use the serial port or transmit
+    canSniffer.update(getRxDrops());
+#else
+    sidMessageHandler.setTxEnabled(canHealth.isTxAllowed() && !isOnPBus);
+    LOOP_STAGE(Other)
     ledController.update();
+    LOOP_STAGE(Led)
     sidMessageHandler.update();
+    LOOP_STAGE(Sid)
+    canTxQueue.update();
+#endif
+#if CAN_SLEEP
+    powerManager.update();
+#endif
+#endif
+#if CAN_TIMING_STATS && DEBUG
+    reportCanTiming();
+#endif
+#if LOOP_PROFILER
+    reportLoopProfile();
+#endif
 }
+/*
+  Start the controller with our bit timing and filters. Also used by
+  canHealth to restart it after bus-off or a brownout reset.
+*/
+bool initCan()
+{
+#if CAN_SLCAN
+    // Bitrate and mode are chosen over the serial port
+    return slcanGateway.restart();
+#else
+    // A restart loses the TX buffers, what is queued behind them is stale
+    canTxQueue.clear();
+    if (CAN.begin(MCP_STDEXT, canBitTiming) != CAN_OK)
+    {
+        return false;
+    }
+#if CAN_SNIFFER
+    // begin() leaves the masks open, take everything without acknowledging it
+    return CAN.setMode(MCP_LISTENONLY) == MCP2515_OK;
+#else
+#ifdef CAN_SOCKETCAN
+    // Kernel filters are exact, no need to share masks
+    if (CAN.setFilters(HANDLED_CAN_IDS) != CAN_OK)
+#else
+    if (canFilter::apply(&CAN, isOnPBus ? pbusFilterPlan : canFilterPlan) != CAN_OK)
+#endif
+    {
+        return false;
+    }
+    // Nothing of ours belongs on the engine bus
+    return CAN.setMode(isOnPBus ? MCP_LISTENONLY : MCP_NORMAL) == MCP2515_OK;
+#endif
+#endif
+}
+
+#if CAN_AUTOBAUD
+/*
+  Listen for the bitrate of the bus the board is plugged into. If the bus
+  stays silent the rate that locked last time is used.
+*/
+void detectCanBus()
+{
+    canAutoBaud::Result result = canAutoBaud::detect(&CAN, canBitTimings, sizeof(canBitTimings) / sizeof(canBitTimings[0]));
+    canBitTiming = canBitTimings[result.index];
+    isOnPBus = result.index == CAN_BUS_PBUS;
+#if DEBUG
+    Serial.print(isOnPBus ? "P-BUS" : "I-BUS");
+    Serial.print(result.isLocked ? " locked in " : " assumed after ");
+    Serial.print(result.elapsedMs);
+    Serial.print(" ms, tries ");
+    Serial.println(result.tries);
+#endif
+}
+#endif
+
+#if CAN_PBUS
+/*
+  Same as initCan() for the P-BUS controller, which only listens.
+*/
+bool initPBus()
+{
+    if (pbusCan.begin(MCP_STDEXT, P_BUS) != CAN_OK)
+    {
+        return false;
+    }
+#if CAN_SNIFFER
+    // begin() leaves the masks open, take everything
+    return pbusCan.setMode(MCP_LISTENONLY) == MCP2515_OK;
+#else
+#ifdef CAN_SOCKETCAN
+    if (pbusCan.setFilters(PBUS_HANDLED_CAN_IDS) != CAN_OK)
+#else
+    if (canFilter::apply(&pbusCan, pbusFilterPlan) != CAN_OK)
+#endif
+    {
+        return false;
+    }
+    // Never transmits or acknowledges anything on the engine bus
+    return pbusCan.setMode(MCP_LISTENONLY) == MCP2515_OK;
+#endif
+}
+#endif
+#if CAN_SLEEP
+/*
+  Nothing may stay lit or wait to be sent while powered down.
+*/
+void onSleep()
+{
+    ledController.blank();
+    canTxQueue.clear();
+#if CAN_PBUS
+    pbusCan.sleep();
+#endif
+}
+
+void onWake()
+{
+#if CAN_PBUS
+    pbusCan.wake();
+#endif
+}
+#endif
 /*
    Turn bluetooth on or off
 */
@@ -85,43 +338,97 @@ uint8_t scaleBrightness(uint16_t val, uint16_t minimum, uint16_t maximum)
     return map(val, minimum, maximum, 20, 255);
 }
 /*
-  Reads incoming data from CAN bus, if there is any and runs desired action.
+  Handles received frames of each bus until its controller or receive queue
+  is empty, or its budget has passed.
 */
 void readCanBus()
 {
-    uint8_t len;
-    uint8_t data[8];
-    long unsigned id;
+    canScheduler.service();
+}
+
+void handleCanFrame(CanFrame &frame)
+{
+    uint8_t *data = frame.data;
+
+#if CAN_SLEEP
+    powerManager.onFrame(frame);
+#endif
+    // Trionic only uses 11-bit data frames
+    if (frame.flags & (CAN_FRAME_EXT | CAN_FRAME_RTR))
+    {
+        return;
+    }
+#if CAN_TIMING_STATS
+    canTiming.onArrival(frame);
+#endif
 
-    if (CAN.checkReceive() == CAN_MSGAVAIL)
+    switch (static_cast<CAN_ID>(frame.id))
     {
-        CAN.readMsgBuf(&id, &len, data);
-        switch (static_cast<CAN_ID>(id))
-        {
-        case CAN_ID::IBUS_BUTTONS:
-        {
-            uint8_t action = getHighBit(data[AUDIO]);
-            steeringWheelActions(static_cast<STEERING_WHEEL>(action));
+    case CAN_ID::IBUS_BUTTONS:
+    {
+        uint8_t action = getHighBit(data[AUDIO]);
+        steeringWheelActions(static_cast<STEERING_WHEEL>(action));
 
-            action = getHighBit(data[SID]);
-            sidActions(static_cast<SID_BUTTON>(action));
-            break;
-        }
-        case CAN_ID::LIGHTING:
-            lightActions(data);
-            break;
-        case CAN_ID::SPEED_RPM:
-            vehicleActions(data);
-            break;
-        case CAN_ID::TEXT_PRIORITY:
-            sidMessageHandler.setPriority(data[0], data[1]);
-            break;
-        case CAN_ID::RADIO_MSG:
-            sidMessageHandler.onReceive(id, data);
-            break;
-        }
+        action = getHighBit(data[SID]);
+        sidActions(static_cast<SID_BUTTON>(action), util::millisAt(frame.timestamp));
+        break;
     }
+    case CAN_ID::LIGHTING:
+        lightActions(data);
+        break;
+    case CAN_ID::SPEED_RPM:
+        vehicleActions(data);
+        break;
+    case CAN_ID::TEXT_PRIORITY:
+        sidMessageHandler.setPriority(data[0], data[1]);
+        break;
+    case CAN_ID::RADIO_MSG:
+        sidMessageHandler.onReceive(frame.id, data, util::millisAt(frame.timestamp));
+        break;
+    default:
+        // IDs we only send
+        break;
+    }
+#if CAN_TIMING_STATS
+    canTiming.onHandled(frame);
+#endif
+}
+
+/*
+  P-BUS frames only wake the sleeping node, none of them is decoded.
+*/
+void handlePBusFrame(CanFrame &frame)
+{
+#if CAN_SLEEP
+    powerManager.onFrame(frame);
+#endif
+}
+
+#if CAN_SNIFFER
+void sniffIBusFrame(CanFrame &frame)
+{
+    canSniffer.write(frame, 0);
+}
+
+void sniffPBusFrame(CanFrame &frame)
+{
+    canSniffer.write(frame, 1);
 }
+/*
+  Frames lost to a full receive queue or an RX buffer overflow on either bus.
+*/
+uint16_t getRxDrops()
+{
+    CanReceiver::Stats stats;
+    canReceiver.getStats(&stats);
+    uint32_t drops = stats.dropped + canHealth.counters.rxOverflows;
+#if CAN_PBUS
+    pbusReceiver.getStats(&stats);
+    drops += stats.dropped + pbusHealth.counters.rxOverflows;
+#endif
+    return drops;
+}
+#endif
 
 void steeringWheelActions(STEERING_WHEEL action)
 {
@@ -157,7 +464,11 @@ void steeringWheelActions(STEERING_WHEEL action)
     }
 }
 
-void sidActions(SID_BUTTON action)
+/*
+  pressedAt is the millis() time the button frame arrived, so double-taps
+  are not stretched or shortened by how long the loop took to get to it.
+*/
+void sidActions(SID_BUTTON action, uint32_t pressedAt)
 {
     switch (action)
     {
@@ -172,24 +483,24 @@ void sidActions(SID_BUTTON action)
         DEBUG_MESSAGE("DOWN");
         break;
     case SID_BUTTON::SET:
-        if (elapsed(sidButtons.setLastPressedAt) < 500)
+        if (pressedAt - sidButtons.setLastPressedAt < 500)
         {
             ledController.config.areLedStripsEnabled = true;
             sidMessageHandler.sendMessage("LEDS ON", 500);
             DEBUG_MESSAGE("SET DOUBLETAP");
         }
-        sidButtons.setLastPressedAt = millis();
+        sidButtons.setLastPressedAt = pressedAt;
         DEBUG_MESSAGE("SET");
         break;
     case SID_BUTTON::CLR:
-        if (elapsed(sidButtons.clearLastPressedAt) < 500)
+        if (pressedAt - sidButtons.clearLastPressedAt < 500)
         {
             ledController.config.areLedStripsEnabled = false;
             sidMessageHandler.sendMessage("LEDS OFF", 500);
             DEBUG_MESSAGE("CLEAR DOUBLETAP");
         }
         sidMessageHandler.cancelMessage();
-        sidButtons.clearLastPressedAt = millis();
+        sidButtons.clearLastPressedAt = pressedAt;
         DEBUG_MESSAGE("CLEAR");
         break;
     }
@@ -239,7 +550,84 @@ uint16_t combineBytes(uint8_t byte1, uint8_t byte2)
     return (byte1 << 8 | byte2);
 }
 
-uint32_t elapsed(uint32_t time)
+#if CAN_TIMING_STATS && DEBUG
+/*
+  Print inter-arrival and arrival-to-action times of each handled ID.
+*/
+void reportCanTiming()
+{
+    if (millis() - canTimingReportedAt < CAN_TIMING_REPORT_MS)
+    {
+        return;
+    }
+    canTimingReportedAt = millis();
+
+    for (const CanTiming::IdStats &stats : canTiming)
+    {
+        if (!stats.count)
+        {
+            continue;
+        }
+        Serial.print(stats.id, HEX);
+        Serial.print(" n=");
+        Serial.print(stats.count);
+        Serial.print(" dt=");
+        Serial.print(stats.minIntervalUs);
+        Serial.print("/");
+        Serial.print(stats.meanIntervalUs);
+        Serial.print("/");
+        Serial.print(stats.maxIntervalUs);
+        Serial.print(" lat=");
+        Serial.println(stats.maxLatencyUs);
+    }
+}
+#endif
+#if LOOP_PROFILER
+/*
+  Print and reset the loop profile when LOOP_PROFILER_COMMAND comes in.
+  Histogram columns are upper bounds in us, the last one open ended.
+*/
+void reportLoopProfile()
+{
+    if (Serial.available() <= 0 || Serial.read() != LOOP_PROFILER_COMMAND)
+    {
+        return;
+    }
+
+    const LoopProfiler::Stats &stats = loopProfiler.stats;
+    // A sample stands for LOOP_PROFILER_SAMPLE_LOOPS loops of the same length
+    uint64_t allTicks = (uint64_t)stats.totalTicks * LOOP_PROFILER_SAMPLE_LOOPS;
+    Serial.print("samples ");
+    Serial.print(stats.samples);
+    Serial.print(" max ");
+    Serial.print(stats.maxLoopTicks / (1000 / LOOP_PROFILER_TICK_NS));
+    Serial.print(" us self ");
+    Serial.print(allTicks ? (uint32_t)(stats.selfTicks * 1000ULL / allTicks) : 0);
+    Serial.println(" permille");
+
+    Serial.print("us     ");
+    for (uint8_t i = 0; i < LOOP_PROFILER_BUCKETS - 1; i++)
+    {
+        Serial.print(' ');
+        Serial.print(1UL << i);
+    }
+    Serial.println(" more");
+    printHistogram("CAN RX ", loopProfiler.getStage(LoopStage::CanRead).counts);
+    printHistogram("LED    ", loopProfiler.getStage(LoopStage::Led).counts);
+    printHistogram("SID    ", loopProfiler.getStage(LoopStage::Sid).counts);
+    printHistogram("Other  ", loopProfiler.getStage(LoopStage::Other).counts);
+    printHistogram("Loop   ", loopProfiler.getLoop().counts);
+    loopProfiler.reset();
+}
+
+void printHistogram(const char *name, const uint16_t *counts)
 {
-    return millis() - time;
-}
\ No newline at end of file
+    Serial.print(name);
+    for (uint8_t i = 0; i < LOOP_PROFILER_BUCKETS; i++)
+    {
+        Serial.print(' ');
+        Serial.print(counts[i]);
+    }
+    Serial.println();
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,86 @@
+/*
+  Bitrate detection between the I-BUS and the P-BUS, with the result kept
+  in EEPROM.
+*/
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <unity.h>
+#include "mcp_can.h"
+#include "CanAutoBaud.h"
+#include "../../host/mcp2515/MCP2515Model.h"
+#include "../../include/defines.h"
+
+#define FRAME_INTERVAL_US 10000
+
+static MCP2515Model model(CAN_CS_PIN, CAN_INT_PIN);
+static MCP_CAN CAN(CAN_CS_PIN);
+static const MCP_BitTiming candidates[] = {I_BUS, P_BUS};
+static uint32_t frameAt;
+
+// P-BUS engine frame every 10 ms of virtual time
+static void busTraffic()
+{
+    if ((int32_t)(micros() - frameAt) >= FRAME_INTERVAL_US)
+    {
+        frameAt = micros();
+        MCP2515Model::Frame frame = {};
+        frame.id = 0x1A0;
+        frame.len = 8;
+        model.receive(frame);
+    }
+}
+
+void setUp()
+{
+    host::useVirtualClock(true);
+    host::setClockListener(busTraffic);
+    model.setBusBitrate(MCP_OSC_HZ, 500000);
+    EEPROM.write(EEPROM_CAN_BUS, 0xFF);
+}
+
+void tearDown()
+{
+    host::setClockListener(nullptr);
+    host::useVirtualClock(false);
+    model.setBusBitrate(0, 0);
+}
+
+void test_finds_pbus_after_ibus()
+{
+    canAutoBaud::Result result = canAutoBaud::detect(&CAN, candidates, 2);
+    TEST_ASSERT_TRUE(result.isLocked);
+    TEST_ASSERT_EQUAL(1, result.index);
+    TEST_ASSERT_EQUAL(2, result.tries);
+    TEST_ASSERT_EQUAL(MCP_LISTENONLY, model.getMode());
+    TEST_ASSERT_EQUAL(1, EEPROM.read(EEPROM_CAN_BUS));
+}
+
+void test_cached_rate_is_tried_first()
+{
+    canAutoBaud::storeIndex(1);
+    canAutoBaud::Result result = canAutoBaud::detect(&CAN, candidates, 2);
+    TEST_ASSERT_TRUE(result.isLocked);
+    TEST_ASSERT_EQUAL(1, result.tries);
+    TEST_ASSERT_LESS_OR_EQUAL(FRAME_INTERVAL_US / 1000, result.elapsedMs);
+}
+
+void test_silent_bus_falls_back_to_cached_rate()
+{
+    canAutoBaud::storeIndex(1);
+    uint32_t writes = EEPROM.writes;
+    host::setClockListener(nullptr);
+    canAutoBaud::Result result = canAutoBaud::detect(&CAN, candidates, 2);
+    TEST_ASSERT_FALSE(result.isLocked);
+    TEST_ASSERT_EQUAL(1, result.index);
+    TEST_ASSERT_LESS_OR_EQUAL(CAN_AUTOBAUD_TIMEOUT_MS, result.elapsedMs);
+    TEST_ASSERT_EQUAL(writes, EEPROM.writes);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_finds_pbus_after_ibus);
+    RUN_TEST(test_cached_rate_is_tried_first);
+    RUN_TEST(test_silent_bus_falls_back_to_cached_rate);
+    return UNITY_END();
+}
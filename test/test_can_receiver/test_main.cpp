@@ -0,0 +1,89 @@
+/*
+  CanReceiver draining the MCP2515 from its INT pin into the frame queue.
+*/
+#include <Arduino.h>
+#include <unity.h>
+#include "mcp_can.h"
+#include "CanReceiver.h"
+#include "../../host/mcp2515/MCP2515Model.h"
+#include "../../include/defines.h"
+
+static MCP2515Model model(CAN_CS_PIN, CAN_INT_PIN);
+static MCP_CAN CAN(CAN_CS_PIN);
+static CanReceiver receiver(&CAN, CAN_INT_PIN);
+
+static MCP2515Model::Frame makeFrame(uint32_t id, uint8_t seq)
+{
+    MCP2515Model::Frame frame = {};
+    frame.id = id;
+    frame.len = 8;
+    frame.data[0] = seq;
+    return frame;
+}
+
+void setUp()
+{
+    CAN.begin(MCP_STDEXT, I_BUS);
+    CAN.setMode(MCP_NORMAL);
+    receiver.init([]() { receiver.onInterrupt(); });
+    receiver.resetStats();
+}
+
+void tearDown()
+{
+    detachInterrupt(digitalPinToInterrupt(CAN_INT_PIN));
+}
+
+void test_interrupt_drains_frame()
+{
+    CanFrame frame;
+    model.receive(makeFrame(0x460, 0));
+    TEST_ASSERT_FALSE(model.isInterruptAsserted());
+    TEST_ASSERT_TRUE(receiver.read(&frame));
+    TEST_ASSERT_EQUAL_HEX32(0x460, frame.id);
+    TEST_ASSERT_FALSE(receiver.read(&frame));
+}
+
+void test_frames_keep_arrival_order()
+{
+    CanFrame frame;
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        model.receive(makeFrame(0x290, i));
+    }
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_TRUE(receiver.read(&frame));
+        TEST_ASSERT_EQUAL(i, frame.data[0]);
+    }
+}
+
+void test_full_queue_counts_drops()
+{
+    // One slot stays free to tell a full ring from an empty one
+    const uint8_t capacity = CAN_RX_QUEUE_SIZE - 1;
+    CanFrame frame;
+    for (uint8_t i = 0; i < capacity + 2; i++)
+    {
+        model.receive(makeFrame(0x290, i));
+    }
+    CanReceiver::Stats stats;
+    receiver.getStats(&stats);
+    TEST_ASSERT_EQUAL(2, stats.dropped);
+    TEST_ASSERT_EQUAL(0, model.overflowedFrames);
+    uint8_t count = 0;
+    while (receiver.read(&frame))
+    {
+        count++;
+    }
+    TEST_ASSERT_EQUAL(capacity, count);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_interrupt_drains_frame);
+    RUN_TEST(test_frames_keep_arrival_order);
+    RUN_TEST(test_full_queue_counts_drops);
+    return UNITY_END();
+}
@@ -0,0 +1,133 @@
+/*
+  CanTxQueue ordering, priority and deadlines over the three TX buffers.
+*/
+#include <Arduino.h>
+#include <unity.h>
+#include "mcp_can.h"
+#include "CanTxQueue.h"
+#include "../../host/mcp2515/MCP2515Model.h"
+#include "../../include/defines.h"
+
+static MCP2515Model model(CAN_CS_PIN, CAN_INT_PIN);
+static MCP_CAN CAN(CAN_CS_PIN);
+static CanTxQueue *txQueue;
+
+static CanFrame makeFrame(uint32_t id, uint8_t seq)
+{
+    CanFrame frame = {};
+    frame.id = id;
+    frame.len = 8;
+    frame.data[0] = seq;
+    return frame;
+}
+
+static void transmitAll()
+{
+    while (model.transmitNext())
+    {
+        txQueue->update();
+    }
+    CAN.checkTXComplete();
+}
+
+void setUp()
+{
+    host::useVirtualClock(true);
+    model.setAutoTransmit(false);
+    CAN.begin(MCP_STDEXT, I_BUS);
+    CAN.setMode(MCP_NORMAL);
+    model.transmitted.clear();
+    static CanTxQueue queue(&CAN);
+    queue.clear();
+    queue.stats = {};
+    txQueue = &queue;
+}
+
+void tearDown()
+{
+    host::useVirtualClock(false);
+}
+
+void test_same_id_stays_in_order()
+{
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_TRUE(txQueue->push(makeFrame(0x328, i)));
+    }
+    transmitAll();
+    TEST_ASSERT_EQUAL(5, model.transmitted.size());
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_EQUAL(i, model.transmitted[i].data[0]);
+    }
+}
+
+void test_higher_priority_overtakes_other_ids()
+{
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        txQueue->push(makeFrame(0x328, i));
+    }
+    txQueue->push(makeFrame(0x348, 0), CanTxPriority::High);
+    TEST_ASSERT_EQUAL(2, txQueue->size());
+    txQueue->update();
+    transmitAll();
+    TEST_ASSERT_EQUAL(5, model.transmitted.size());
+    TEST_ASSERT_EQUAL_HEX32(0x328, model.transmitted[0].id);
+    TEST_ASSERT_EQUAL_HEX32(0x348, model.transmitted[1].id);
+}
+
+void test_expired_frame_is_dropped()
+{
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        txQueue->push(makeFrame(0x328, i), CanTxPriority::Normal, 5);
+    }
+    delay(10);
+    txQueue->update();
+    TEST_ASSERT_EQUAL(0, txQueue->size());
+    TEST_ASSERT_EQUAL(1, txQueue->stats.expired);
+    transmitAll();
+    TEST_ASSERT_EQUAL(3, model.transmitted.size());
+}
+
+void test_drop_leaves_loaded_frames()
+{
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        txQueue->push(makeFrame(0x328, i));
+    }
+    txQueue->push(makeFrame(0x348, 0));
+    TEST_ASSERT_EQUAL(2, txQueue->drop(0x328));
+    transmitAll();
+    TEST_ASSERT_EQUAL(4, model.transmitted.size());
+    uint8_t loaded = 0;
+    for (const MCP2515Model::Frame &frame : model.transmitted)
+    {
+        loaded += frame.id == 0x328;
+    }
+    TEST_ASSERT_EQUAL(MCP_N_TXBUFFERS, loaded);
+}
+
+void test_full_queue_refuses()
+{
+    model.setAutoTransmit(false);
+    uint8_t pushed = 0;
+    while (txQueue->push(makeFrame(0x328, pushed)))
+    {
+        pushed++;
+        TEST_ASSERT_LESS_OR_EQUAL(MCP_N_TXBUFFERS + CAN_TX_QUEUE_SIZE, pushed);
+    }
+    TEST_ASSERT_EQUAL(1, txQueue->stats.full);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_same_id_stays_in_order);
+    RUN_TEST(test_higher_priority_overtakes_other_ids);
+    RUN_TEST(test_expired_frame_is_dropped);
+    RUN_TEST(test_drop_leaves_loaded_frames);
+    RUN_TEST(test_full_queue_refuses);
+    return UNITY_END();
+}
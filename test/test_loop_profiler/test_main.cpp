@@ -0,0 +1,62 @@
+/*
+  LoopProfiler on the host, where the ticks come from steady_clock and
+  delay() really sleeps.
+*/
+#include <Arduino.h>
+#include <unity.h>
+#include "LoopProfiler.h"
+#include "../../include/defines.h"
+
+static LoopProfiler profiler;
+
+static void runLoops(uint16_t loops, uint16_t stallAt)
+{
+    for (uint16_t i = 0; i < loops; i++)
+    {
+        profiler.startLoop();
+        profiler.endStage(LoopStage::CanRead);
+        if (i == stallAt)
+        {
+            delay(5);
+        }
+        profiler.endStage(LoopStage::Sid);
+    }
+    profiler.startLoop();
+}
+
+void setUp()
+{
+    profiler.begin();
+    profiler.reset();
+}
+
+void tearDown()
+{
+}
+
+void test_stall_between_samples_is_worst_case()
+{
+    // Loop 1 is not one of the sampled ones
+    runLoops(2 * LOOP_PROFILER_SAMPLE_LOOPS, 1);
+    TEST_ASSERT_EQUAL(2, profiler.stats.samples);
+    TEST_ASSERT_GREATER_OR_EQUAL(5000000UL / LOOP_PROFILER_TICK_NS, profiler.stats.maxLoopTicks);
+    // Not in the stage histograms, bucket 13 holds 8192 up to 16383 ticks
+    TEST_ASSERT_EQUAL(0, profiler.getStage(LoopStage::Sid).counts[13]);
+}
+
+void test_stages_come_from_sampled_loops()
+{
+    runLoops(LOOP_PROFILER_SAMPLE_LOOPS, 0);
+    TEST_ASSERT_EQUAL(1, profiler.stats.samples);
+    // 5 ms is 10000 ticks
+    TEST_ASSERT_EQUAL(1, profiler.getStage(LoopStage::Sid).counts[13]);
+    TEST_ASSERT_EQUAL(1, profiler.getLoop().counts[13]);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stall_between_samples_is_worst_case);
+    RUN_TEST(test_stages_come_from_sampled_loops);
+    return UNITY_END();
+}
@@ -0,0 +1,178 @@
+/*
+  MCP_CAN driver and bit timing solver against the MCP2515 register model.
+*/
+#include <Arduino.h>
+#include <unity.h>
+#include "mcp_can.h"
+#include "../../host/mcp2515/MCP2515Model.h"
+#include "../../include/defines.h"
+
+static MCP2515Model model(CAN_CS_PIN, CAN_INT_PIN);
+static MCP_CAN CAN(CAN_CS_PIN);
+static uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+static MCP2515Model::Frame makeFrame(uint32_t id, uint8_t len)
+{
+    MCP2515Model::Frame frame = {};
+    frame.id = id;
+    frame.len = len;
+    for (uint8_t i = 0; i < len; i++)
+        frame.data[i] = i + 1;
+    return frame;
+}
+
+void setUp()
+{
+    model.setAutoTransmit(true);
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.begin(MCP_STDEXT, I_BUS));
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.setMode(MCP_NORMAL));
+    model.transmitted.clear();
+}
+
+void tearDown()
+{
+}
+
+void test_begin_writes_ibus_timing()
+{
+    TEST_ASSERT_EQUAL_HEX8(0x83, model.getRegister(MCP_CNF1));
+    TEST_ASSERT_EQUAL_HEX8(0xBE, model.getRegister(MCP_CNF2));
+    TEST_ASSERT_EQUAL_HEX8(0x04, model.getRegister(MCP_CNF3));
+    TEST_ASSERT_EQUAL(MCP_NORMAL, model.getMode());
+}
+
+void test_bit_timing_keeps_sjw_below_ps2()
+{
+    const uint32_t clocks[] = {8000000, 16000000, 20000000};
+    const uint32_t bitrates[] = {5000, 10000, 33333, 47619, 50000, 100000, 125000, 250000, 500000, 1000000};
+    for (uint32_t osc : clocks)
+    {
+        for (uint32_t bitrate : bitrates)
+        {
+            MCP_BitTiming timing = mcp2515_calcBitTiming(osc, bitrate, MCP_DEFAULT_SAMPLE_POINT, 4);
+            if (timing.errorPpm > MCP_MAX_BITRATE_ERROR_PPM)
+                continue;
+            uint8_t ps2 = (timing.cfg3 & 0x07) + 1;
+            uint8_t sjw = (timing.cfg1 >> 6) + 1;
+            TEST_ASSERT_GREATER_THAN(sjw, ps2);
+        }
+    }
+}
+
+void test_bit_timing_rejects_unreachable_bitrates()
+{
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFF, mcp2515_calcBitTiming(8000000, 0).errorPpm);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFF, mcp2515_calcBitTiming(8000000, 999).errorPpm);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFF, mcp2515_calcBitTiming(16000000, 4096).errorPpm);
+    TEST_ASSERT_EQUAL(0, mcp2515_calcBitTiming(16000000, 5000).errorPpm);
+}
+
+void test_empty_controller_has_nothing()
+{
+    INT32U id;
+    INT8U len;
+    INT8U buf[8];
+    TEST_ASSERT_EQUAL(CAN_NOMSG, CAN.checkReceive());
+    TEST_ASSERT_EQUAL(CAN_NOMSG, CAN.readMsgBuf(&id, &len, buf));
+}
+
+void test_read_frame()
+{
+    INT32U id;
+    INT8U len;
+    INT8U buf[8];
+    model.receive(makeFrame(0x290, 8));
+    TEST_ASSERT_EQUAL(CAN_MSGAVAIL, CAN.checkReceive());
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.readMsgBuf(&id, &len, buf));
+    TEST_ASSERT_EQUAL_HEX32(0x290, id);
+    TEST_ASSERT_EQUAL(8, len);
+    TEST_ASSERT_EQUAL(8, buf[7]);
+
+    model.receive(makeFrame(0x290, 2));
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.readMsgBuf(&id, &len, buf));
+    TEST_ASSERT_EQUAL(2, len);
+}
+
+void test_second_frame_rolls_over_to_rxb1()
+{
+    INT32U id;
+    INT8U len;
+    INT8U buf[8];
+    model.receive(makeFrame(0x290, 8));
+    model.receive(makeFrame(0x290, 8));
+    TEST_ASSERT_EQUAL(MCP_RXSTAT_RXB0 | MCP_RXSTAT_RXB1, CAN.checkReceiveBuffers());
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.readMsgBuf(&id, &len, buf));
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.readMsgBuf(&id, &len, buf));
+    TEST_ASSERT_EQUAL(CAN_NOMSG, CAN.checkReceive());
+}
+
+void test_read_can_frame()
+{
+    CanFrame frame;
+    model.receive(makeFrame(0x290, 8));
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.readFrame(&frame));
+    TEST_ASSERT_EQUAL_HEX32(0x290, frame.id);
+    TEST_ASSERT_EQUAL(0, frame.flags);
+    TEST_ASSERT_EQUAL(8, frame.len);
+    TEST_ASSERT_EQUAL(8, frame.data[7]);
+    TEST_ASSERT_LESS_THAN(2, frame.filterHit); // RXB0 filters
+}
+
+static uint8_t polledBytes;
+
+void test_poll_drains_both_buffers()
+{
+    polledBytes = 0;
+    model.receive(makeFrame(0x290, 8));
+    model.receive(makeFrame(0x290, 8));
+    TEST_ASSERT_EQUAL(2, CAN.poll([](CanFrame &frame) { polledBytes += frame.len; }));
+    TEST_ASSERT_EQUAL(16, polledBytes);
+}
+
+void test_send()
+{
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.sendMsgBuf(0x328, 0, 8, data));
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.sendMsgBufNB(0x328, 0, 8, data));
+
+    CanFrame frame;
+    frame.id = 0x328;
+    frame.flags = 0;
+    frame.len = 8;
+    memcpy(frame.data, data, 8);
+    frame.data[7] = 0x42;
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.sendFrameNB(&frame));
+
+    TEST_ASSERT_EQUAL(3, model.transmitted.size());
+    TEST_ASSERT_EQUAL_HEX32(0x328, model.transmitted[0].id);
+    TEST_ASSERT_EQUAL_HEX8(0x42, model.transmitted[2].data[7]);
+}
+
+void test_send_with_all_buffers_busy()
+{
+    model.setAutoTransmit(false);
+    for (uint8_t i = 0; i < MCP_N_TXBUFFERS; i++)
+    {
+        TEST_ASSERT_EQUAL(CAN_OK, CAN.sendMsgBufNB(0x328, 0, 8, data));
+    }
+    TEST_ASSERT_EQUAL(CAN_TXBUSY, CAN.sendMsgBufNB(0x328, 0, 8, data));
+    while (model.transmitNext())
+        ;
+    CAN.checkTXComplete();
+    TEST_ASSERT_EQUAL(CAN_OK, CAN.sendMsgBufNB(0x328, 0, 8, data));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_begin_writes_ibus_timing);
+    RUN_TEST(test_bit_timing_keeps_sjw_below_ps2);
+    RUN_TEST(test_bit_timing_rejects_unreachable_bitrates);
+    RUN_TEST(test_empty_controller_has_nothing);
+    RUN_TEST(test_read_frame);
+    RUN_TEST(test_second_frame_rolls_over_to_rxb1);
+    RUN_TEST(test_read_can_frame);
+    RUN_TEST(test_poll_drains_both_buffers);
+    RUN_TEST(test_send);
+    RUN_TEST(test_send_with_all_buffers_busy);
+    return UNITY_END();
+}
@@ -0,0 +1,97 @@
+/*
+  PowerManager sleeping after CAN_SLEEP_IDLE_MS and waking on bus activity.
+*/
+#include <Arduino.h>
+#include <unity.h>
+#include "mcp_can.h"
+#include "CanReceiver.h"
+#include "PowerManager.h"
+#include "../../host/mcp2515/MCP2515Model.h"
+#include "../../include/defines.h"
+
+#define FRAME_INTERVAL_US (111 * 1000000UL / 47619) // Back to back I-BUS frames
+#define WAKE_FRAMES       6
+
+static MCP2515Model model(CAN_CS_PIN, CAN_INT_PIN);
+static MCP_CAN CAN(CAN_CS_PIN);
+static CanReceiver receiver(&CAN, CAN_INT_PIN);
+static uint32_t frameAt;
+static uint32_t frames;
+static uint8_t sleeps;
+static uint8_t wakes;
+
+static void busTraffic()
+{
+    if ((int32_t)(micros() - frameAt) >= (int32_t)FRAME_INTERVAL_US)
+    {
+        frameAt = micros();
+        frames++;
+        MCP2515Model::Frame frame = {};
+        frame.id = 0x460;
+        frame.len = 8;
+        model.receive(frame);
+    }
+}
+
+static PowerManager powerManager(&CAN, &receiver, CAN_INT_PIN, []() { sleeps++; }, []() { wakes++; });
+
+void setUp()
+{
+    host::useVirtualClock(true);
+    host::setMicros(0);
+    CAN.begin(MCP_STDEXT, I_BUS);
+    CAN.setMode(MCP_NORMAL);
+    receiver.init([]() { receiver.onInterrupt(); });
+    frames = 0;
+    sleeps = 0;
+    wakes = 0;
+}
+
+void tearDown()
+{
+    host::setClockListener(nullptr);
+    host::useVirtualClock(false);
+    detachInterrupt(digitalPinToInterrupt(CAN_INT_PIN));
+}
+
+void test_stays_up_while_idle_time_not_reached()
+{
+    host::setMicros((CAN_SLEEP_IDLE_MS - 1) * 1000UL);
+    powerManager.update();
+    TEST_ASSERT_EQUAL(0, sleeps);
+    TEST_ASSERT_EQUAL(MCP_NORMAL, model.getMode());
+}
+
+void test_wakes_on_traffic_losing_only_the_first_frame()
+{
+    host::setMicros(CAN_SLEEP_IDLE_MS * 1000UL);
+    frameAt = micros() + 500000; // Car unlocked half a second after we sleep
+    host::setClockListener(busTraffic);
+
+    powerManager.update();
+    TEST_ASSERT_EQUAL(1, sleeps);
+    TEST_ASSERT_EQUAL(1, wakes);
+    TEST_ASSERT_EQUAL(MCP_NORMAL, model.getMode());
+
+    CanFrame frame;
+    uint32_t received = 0;
+    while (frames < WAKE_FRAMES && millis() < CAN_SLEEP_IDLE_MS + 1000)
+    {
+        delay(1);
+        while (receiver.read(&frame))
+        {
+            if (!received++)
+                powerManager.onFrame(frame);
+        }
+    }
+    TEST_ASSERT_EQUAL(WAKE_FRAMES, frames);
+    TEST_ASSERT_EQUAL(1, frames - received);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stays_up_while_idle_time_not_reached);
+    RUN_TEST(test_wakes_on_traffic_losing_only_the_first_frame);
+    return UNITY_END();
+}
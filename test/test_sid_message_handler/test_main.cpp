@@ -0,0 +1,280 @@
+/*
+  SidMessageHandler against the radio's messages on row 2, on the virtual
+  clock. The radio's frames are handed to onReceive(), ours are read back
+  from the model as the bus saw them.
+*/
+#include <Arduino.h>
+#include <unity.h>
+#include "mcp_can.h"
+#include "CanTxQueue.h"
+#include "SidMessageHandler/SidMessageHandler.h"
+#include "../../host/mcp2515/MCP2515Model.h"
+#include "../../include/defines.h"
+
+static MCP2515Model model(CAN_CS_PIN, CAN_INT_PIN);
+static MCP_CAN CAN(CAN_CS_PIN);
+
+/*
+  Sends the three parts of a radio message on row 2, SID_PART_GAP_MS apart.
+  Stops after the first parts if given fewer.
+*/
+static void radioMessage(SidMessageHandler *sid, const char *text, uint8_t parts = SID_MESSAGE_PARTS)
+{
+    static const uint8_t orders[SID_MESSAGE_PARTS] = {0x42, 0x01, 0x00};
+    for (uint8_t part = 0; part < parts; part++)
+    {
+        uint8_t data[8] = {orders[part], 0x96, 0x02};
+        for (uint8_t i = 0; i < 5 && text[part * 5 + i]; i++)
+        {
+            data[3 + i] = text[part * 5 + i];
+        }
+        sid->onReceive(static_cast<unsigned long>(CAN_ID::RADIO_MSG), data, millis());
+        delay(SID_PART_GAP_MS);
+    }
+}
+
+static uint8_t countSent(size_t from, uint8_t order)
+{
+    uint8_t count = 0;
+    for (size_t i = from; i < model.transmitted.size(); i++)
+    {
+        const MCP2515Model::Frame &frame = model.transmitted[i];
+        if (frame.id == static_cast<unsigned long>(CAN_ID::RADIO_MSG) && frame.data[0] == order)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void run(SidMessageHandler *sid, CanTxQueue *txQueue, uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        sid->update();
+        txQueue->update();
+        CAN.checkTXComplete();
+        delay(1);
+    }
+}
+
+static uint8_t countRequests(size_t from, uint8_t level = SID_ROW_REQUEST)
+{
+    uint8_t count = 0;
+    for (size_t i = from; i < model.transmitted.size(); i++)
+    {
+        const MCP2515Model::Frame &frame = model.transmitted[i];
+        if (frame.id == static_cast<unsigned long>(CAN_ID::RADIO_PRIORITY) && frame.data[REQUEST_LEVEL] == level)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+void setUp()
+{
+    host::useVirtualClock(true);
+    model.setAutoTransmit(true);
+    CAN.begin(MCP_STDEXT, I_BUS);
+    CAN.setMode(MCP_NORMAL);
+    model.transmitted.clear();
+}
+
+void tearDown()
+{
+    host::useVirtualClock(false);
+}
+
+void test_radio_message_aborts_restore()
+{
+    CanTxQueue txQueue(&CAN);
+    SidMessageHandler sid(&txQueue);
+    sid.setPriority(0, 0xFF);
+    sid.setPriority(2, RADIO);
+
+    radioMessage(&sid, "RADIO ONE");
+    sid.sendMessage("HELLO", 100);
+    run(&sid, &txQueue, 50);
+
+    // The radio starts over right after the first part of the restore
+    size_t restoreAt = model.transmitted.size();
+    for (uint8_t i = 0; i < 100 && !countSent(restoreAt, 0x42); i++)
+    {
+        run(&sid, &txQueue, 1);
+    }
+    TEST_ASSERT_EQUAL(1, countSent(restoreAt, 0x42));
+    radioMessage(&sid, "RADIO TWO", 1);
+    size_t radioAt = model.transmitted.size();
+    run(&sid, &txQueue, 100);
+    TEST_ASSERT_EQUAL(0, countSent(radioAt, 0x01));
+    TEST_ASSERT_EQUAL(0, countSent(radioAt, 0x00));
+}
+
+void test_scroll_step_sends_every_part()
+{
+    CanTxQueue txQueue(&CAN);
+    SidMessageHandler sid(&txQueue);
+    sid.setPriority(0, 0xFF);
+    sid.setPriority(2, RADIO);
+
+    // Only the last visible characters change from step to step
+    sid.sendMessage("AAAAAAAAAAAAAAB", 100);
+    run(&sid, &txQueue, 2 * SID_SCROLL_PAUSE_MS + 3 * SID_SCROLL_STEP_MS);
+    uint8_t messages = countSent(0, 0x42);
+    TEST_ASSERT_GREATER_THAN(1, messages);
+    TEST_ASSERT_EQUAL(messages, countSent(0, 0x01));
+    TEST_ASSERT_EQUAL(messages, countSent(0, 0x00));
+}
+
+void test_scroll_ends_on_last_characters()
+{
+    CanTxQueue txQueue(&CAN);
+    SidMessageHandler sid(&txQueue);
+    sid.setPriority(0, 0xFF);
+    sid.setPriority(2, RADIO);
+
+    // 15 characters past the display, the last step only moves one
+    sid.sendMessage("NOW PLAYING: TRIONIC 7 SAAB", 10000);
+    run(&sid, &txQueue, 10000);
+
+    char shown[SID_MAX_CHAR + 1] = {};
+    for (const MCP2515Model::Frame &frame : model.transmitted)
+    {
+        if (frame.id != static_cast<unsigned long>(CAN_ID::RADIO_MSG))
+        {
+            continue;
+        }
+        uint8_t part = 2 - (frame.data[0] & 0x3F);
+        for (uint8_t i = 0; i < 5 && part * 5 + i < SID_MAX_CHAR; i++)
+        {
+            shown[part * 5 + i] = frame.data[3 + i];
+        }
+    }
+    TEST_ASSERT_EQUAL_STRING("IONIC 7 SAAB", shown);
+    // The first view, then one message per step
+    TEST_ASSERT_EQUAL(1 + (15 + SID_SCROLL_STEP_CHARS - 1) / SID_SCROLL_STEP_CHARS, countSent(0, 0x42));
+}
+
+void test_lost_frames_are_sent_again()
+{
+    CanTxQueue txQueue(&CAN);
+    SidMessageHandler sid(&txQueue);
+    sid.setPriority(0, 0xFF);
+    sid.setPriority(2, RADIO);
+
+    // Restarting the controller loses the parts waiting in its TX buffers
+    model.setAutoTransmit(false);
+    sid.sendMessage("HELLO", 5000);
+    run(&sid, &txQueue, 50);
+    CAN.begin(MCP_STDEXT, I_BUS);
+    CAN.setMode(MCP_NORMAL);
+    txQueue.clear();
+    model.setAutoTransmit(true);
+    run(&sid, &txQueue, 50);
+
+    TEST_ASSERT_EQUAL(1, countSent(0, 0x42));
+    TEST_ASSERT_EQUAL(1, countSent(0, 0x01));
+    TEST_ASSERT_EQUAL(1, countSent(0, 0x00));
+}
+
+void test_new_message_requests_row_after_timeout()
+{
+    CanTxQueue txQueue(&CAN);
+    SidMessageHandler sid(&txQueue);
+    sid.setPriority(0, 0xFF);
+    sid.setPriority(2, 0x12); // Someone else's, never handed over
+
+    sid.sendMessage("ONE", 1000);
+    run(&sid, &txQueue, SID_ROW_GRANT_TIMEOUT_MS + 10);
+    TEST_ASSERT_EQUAL(SidRowArbiter::State::TimedOut, sid.getRowArbiter().getState());
+
+    size_t timedOutAt = model.transmitted.size();
+    sid.sendMessage("TWO", 1000);
+    run(&sid, &txQueue, 10);
+    TEST_ASSERT_EQUAL(SidRowArbiter::State::Requesting, sid.getRowArbiter().getState());
+    TEST_ASSERT_EQUAL(1, countRequests(timedOutAt));
+}
+
+void test_row_is_requested_again_after_backoff()
+{
+    CanTxQueue txQueue(&CAN);
+    SidMessageHandler sid(&txQueue);
+    sid.setPriority(0, 0xFF);
+    sid.setPriority(2, 0x12);
+
+    sid.sendMessage("WAITING", 1000, SidMessagePriority::Normal, 5000);
+    run(&sid, &txQueue, SID_ROW_GRANT_TIMEOUT_MS + 10);
+    size_t timedOutAt = model.transmitted.size();
+    run(&sid, &txQueue, SID_ROW_RETRY_MS - 20);
+    TEST_ASSERT_EQUAL(0, countRequests(timedOutAt));
+    run(&sid, &txQueue, 30);
+    TEST_ASSERT_EQUAL(1, countRequests(timedOutAt));
+    TEST_ASSERT_EQUAL(1, sid.getRowArbiter().stats.timeouts);
+}
+
+void test_late_grant_is_held_and_released()
+{
+    CanTxQueue txQueue(&CAN);
+    SidMessageHandler sid(&txQueue);
+    sid.setPriority(0, 0xFF);
+    sid.setPriority(2, 0x12);
+
+    sid.sendMessage("LATE", 3000, SidMessagePriority::Normal, 5000);
+    run(&sid, &txQueue, SID_ROW_GRANT_TIMEOUT_MS + 10);
+    TEST_ASSERT_EQUAL(SidRowArbiter::State::TimedOut, sid.getRowArbiter().getState());
+
+    // Handed over before the backoff asks again
+    size_t grantedAt = model.transmitted.size();
+    sid.setPriority(2, RADIO);
+    run(&sid, &txQueue, 10);
+    TEST_ASSERT_EQUAL(SidRowArbiter::State::Granted, sid.getRowArbiter().getState());
+    TEST_ASSERT_EQUAL(1, sid.getRowArbiter().stats.grants);
+    TEST_ASSERT_EQUAL(1, countSent(grantedAt, 0x42));
+    run(&sid, &txQueue, SID_ROW_REFRESH_MS);
+    TEST_ASSERT_EQUAL(1, countRequests(grantedAt));
+
+    run(&sid, &txQueue, 3000);
+    TEST_ASSERT_EQUAL(SidRowArbiter::State::Idle, sid.getRowArbiter().getState());
+    TEST_ASSERT_EQUAL(1, countRequests(grantedAt, SID_ROW_RELEASE));
+}
+
+void test_queued_text_is_copied()
+{
+    CanTxQueue txQueue(&CAN);
+    SidMessageHandler sid(&txQueue);
+    sid.setPriority(0, 0xFF);
+    sid.setPriority(2, 0x12); // Not ours yet, messages wait in the queue
+
+    char text[8];
+    strcpy(text, "FIRST");
+    sid.sendMessage(text, 1000);
+    strcpy(text, "REUSED");
+    sid.setPriority(2, RADIO);
+    run(&sid, &txQueue, 50);
+
+    TEST_ASSERT_EQUAL(1, countSent(0, 0x42));
+    const MCP2515Model::Frame *first = nullptr;
+    for (const MCP2515Model::Frame &frame : model.transmitted)
+    {
+        if (frame.id == static_cast<unsigned long>(CAN_ID::RADIO_MSG) && frame.data[0] == 0x42)
+        {
+            first = &frame;
+        }
+    }
+    TEST_ASSERT_EQUAL_MEMORY("FIRST", first->data + 3, 5);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_radio_message_aborts_restore);
+    RUN_TEST(test_scroll_step_sends_every_part);
+    RUN_TEST(test_scroll_ends_on_last_characters);
+    RUN_TEST(test_lost_frames_are_sent_again);
+    RUN_TEST(test_new_message_requests_row_after_timeout);
+    RUN_TEST(test_row_is_requested_again_after_backoff);
+    RUN_TEST(test_late_grant_is_held_and_released);
+    RUN_TEST(test_queued_text_is_copied);
+    return UNITY_END();
+}